@@ -1,38 +1,262 @@
 #include "ast.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-ASTNode* create_number_node(double value, int line, int column) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_NUMBER;
-    node->line = line;
-    node->column = column;
-    node->data.value = value;
+#define ARENA_FIRST_BLOCK_NODES 256
+#define ARENA_MAX_BLOCK_NODES (64 * 1024)
+
+struct ASTArenaBlock {
+    struct ASTArenaBlock* next;
+    size_t capacity;   // Number of nodes the block can hold
+    size_t used;       // Number of nodes handed out from this block
+    ASTNode nodes[];
+};
+
+struct ASTInternEntry {
+    ASTNode* node;
+    unsigned generation;  // Entry is live only if it matches the arena's
+};
+
+void ast_arena_init(ASTArena* arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+static ASTArenaBlock* arena_new_block(ASTArena* arena, size_t capacity) {
+    size_t size = sizeof(ASTArenaBlock) + capacity * sizeof(ASTNode);
+    ASTArenaBlock* block = (ASTArenaBlock*)malloc(size);
+    if (!block) return NULL;
+    arena->blocks_allocated++;
+    arena->bytes_allocated += size;
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+ASTNode* ast_arena_alloc(ASTArena* arena) {
+    ASTArenaBlock* block = arena->current;
+    
+    if (!block) {
+        // First allocation (or first after ast_arena_free)
+        if (!arena->head) {
+            arena->head = arena_new_block(arena, ARENA_FIRST_BLOCK_NODES);
+            if (!arena->head) return NULL;
+        }
+        block = arena->current = arena->head;
+    }
+    
+    if (block->used == block->capacity) {
+        // Move on to the next block, reusing blocks kept from before a reset
+        if (!block->next) {
+            size_t capacity = block->capacity * 2;
+            if (capacity > ARENA_MAX_BLOCK_NODES) capacity = ARENA_MAX_BLOCK_NODES;
+            block->next = arena_new_block(arena, capacity);
+            if (!block->next) return NULL;
+        }
+        block = arena->current = block->next;
+        block->used = 0;
+    }
+    
+    arena->nodes_allocated++;
+    return &block->nodes[block->used++];
+}
+
+void ast_arena_reset(ASTArena* arena) {
+    // Blocks are kept for reuse; later blocks get their fill level
+    // cleared when ast_arena_alloc advances into them
+    arena->current = arena->head;
+    if (arena->head) arena->head->used = 0;
+    
+    // Forget every interned node without touching the table
+    arena->generation++;
+    arena->intern_count = 0;
+}
+
+void ast_arena_free(ASTArena* arena) {
+    ASTArenaBlock* block = arena->head;
+    while (block) {
+        ASTArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->current = NULL;
+    
+    free(arena->intern_table);
+    arena->intern_table = NULL;
+    arena->intern_capacity = 0;
+    arena->intern_count = 0;
+}
+
+void ast_arena_set_hash_consing(ASTArena* arena, int enabled) {
+    arena->hash_consing = enabled;
+}
+
+// Hash of a node's own fields; children are already interned, so their
+// addresses identify them
+static size_t intern_hash(const ASTNode* node) {
+    uint64_t h = (uint64_t)node->type * 0x9E3779B97F4A7C15ULL;
+    switch (node->type) {
+        case NODE_NUMBER: {
+            uint64_t bits;
+            memcpy(&bits, &node->data.value, sizeof(bits));
+            h ^= bits;
+            break;
+        }
+        case NODE_VARIABLE:
+            h ^= (uint64_t)node->data.variable.symbol | (uint64_t)node->data.variable.def << 32;
+            break;
+        case NODE_BINARY_OP:
+            h ^= (uint64_t)(uintptr_t)node->data.binary_op.left;
+            h = (h ^ (h >> 29)) * 0xBF58476D1CE4E5B9ULL;
+            h ^= (uint64_t)(uintptr_t)node->data.binary_op.right;
+            h ^= (uint64_t)node->data.binary_op.operator << 3;
+            break;
+        default:
+            break;
+    }
+    h = (h ^ (h >> 31)) * 0x94D049BB133111EBULL;
+    return (size_t)(h ^ (h >> 32));
+}
+
+static int intern_same(const ASTNode* a, const ASTNode* b) {
+    if (a->type != b->type) return 0;
+    switch (a->type) {
+        case NODE_NUMBER:
+            return memcmp(&a->data.value, &b->data.value, sizeof(double)) == 0;
+        case NODE_VARIABLE:
+            return a->data.variable.symbol == b->data.variable.symbol &&
+                   a->data.variable.def == b->data.variable.def;
+        case NODE_BINARY_OP:
+            return a->data.binary_op.operator == b->data.binary_op.operator &&
+                   a->data.binary_op.left == b->data.binary_op.left &&
+                   a->data.binary_op.right == b->data.binary_op.right;
+        default:
+            return 0;
+    }
+}
+
+// Double the table, keeping only the entries of the current generation
+static int intern_grow(ASTArena* arena) {
+    size_t capacity = arena->intern_capacity ? arena->intern_capacity * 2 : 1024;
+    ASTInternEntry* table = (ASTInternEntry*)calloc(capacity, sizeof(ASTInternEntry));
+    if (!table) return 0;
+    
+    for (size_t i = 0; i < arena->intern_capacity; i++) {
+        ASTInternEntry* entry = &arena->intern_table[i];
+        if (!entry->node || entry->generation != arena->generation) continue;
+        size_t slot = intern_hash(entry->node) & (capacity - 1);
+        while (table[slot].node) slot = (slot + 1) & (capacity - 1);
+        table[slot] = *entry;
+    }
+    
+    free(arena->intern_table);
+    arena->intern_table = table;
+    arena->intern_capacity = capacity;
+    return 1;
+}
+
+// Return the interned copy of `key`, building it from the arena if needed
+static ASTNode* intern_node(ASTArena* arena, const ASTNode* key) {
+    if ((arena->intern_count + 1) * 2 > arena->intern_capacity && !intern_grow(arena)) {
+        return NULL;
+    }
+    
+    size_t mask = arena->intern_capacity - 1;
+    size_t slot = intern_hash(key) & mask;
+    for (;;) {
+        ASTInternEntry* entry = &arena->intern_table[slot];
+        if (!entry->node || entry->generation != arena->generation) break;
+        if (intern_same(entry->node, key)) {
+            arena->intern_hits++;
+            return entry->node;
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    ASTNode* node = ast_arena_alloc(arena);
+    if (!node) return NULL;
+    *node = *key;
+    arena->intern_table[slot].node = node;
+    arena->intern_table[slot].generation = arena->generation;
+    arena->intern_count++;
     return node;
 }
 
-ASTNode* create_variable_node(char name, int line, int column) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_VARIABLE;
+// Build a node from the arena, sharing it if hash consing is on
+static ASTNode* make_node(ASTArena* arena, const ASTNode* key) {
+    if (arena->hash_consing) {
+        return intern_node(arena, key);
+    }
+    
+    ASTNode* node = ast_arena_alloc(arena);
+    if (!node) return NULL;
+    *node = *key;
+    return node;
+}
+
+ASTNode* create_number_node(ASTArena* arena, double value, int line, int column) {
+    ASTNode key;
+    key.type = NODE_NUMBER;
+    key.line = line;
+    key.column = column;
+    key.data.value = value;
+    return make_node(arena, &key);
+}
+
+ASTNode* create_variable_node(ASTArena* arena, uint32_t symbol, const char* name, uint32_t def,
+                              int line, int column) {
+    ASTNode key;
+    key.type = NODE_VARIABLE;
+    key.line = line;
+    key.column = column;
+    key.data.variable.symbol = symbol;
+    key.data.variable.def = def;
+    key.data.variable.name = name;
+    return make_node(arena, &key);
+}
+
+ASTNode* create_binary_node(ASTArena* arena, ASTNode* left, OperatorType op, ASTNode* right, int line, int column) {
+    ASTNode key;
+    key.type = NODE_BINARY_OP;
+    key.line = line;
+    key.column = column;
+    key.data.binary_op.left = left;
+    key.data.binary_op.right = right;
+    key.data.binary_op.operator = op;
+    return make_node(arena, &key);
+}
+
+ASTNode* create_assign_node(ASTArena* arena, uint32_t symbol, const char* name, uint32_t def,
+                            ASTNode* value, int line, int column) {
+    ASTNode* node = ast_arena_alloc(arena);
+    if (!node) return NULL;
+    node->type = NODE_ASSIGN;
     node->line = line;
     node->column = column;
-    node->data.name = name;
+    node->data.assign.value = value;
+    node->data.assign.name = name;
+    node->data.assign.symbol = symbol;
+    node->data.assign.def = def;
     return node;
 }
 
-ASTNode* create_binary_node(ASTNode* left, OperatorType op, ASTNode* right, int line, int column) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = NODE_BINARY_OP;
+ASTNode* create_sequence_node(ASTArena* arena, ASTNode* first, ASTNode* second, int line, int column) {
+    ASTNode* node = ast_arena_alloc(arena);
+    if (!node) return NULL;
+    node->type = NODE_SEQUENCE;
     node->line = line;
     node->column = column;
-    node->data.binary_op.left = left;
-    node->data.binary_op.right = right;
-    node->data.binary_op.operator = op;
+    node->data.sequence.first = first;
+    node->data.sequence.second = second;
     return node;
 }
 
-ASTNode* create_error_node(int line, int column) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
+ASTNode* create_error_node(ASTArena* arena, int line, int column) {
+    ASTNode* node = ast_arena_alloc(arena);
+    if (!node) return NULL;
     node->type = NODE_ERROR;
     node->line = line;
     node->column = column;
@@ -40,84 +264,57 @@ ASTNode* create_error_node(int line, int column) {
 }
 
 void free_ast(ASTNode* node) {
-    if (!node) return;
-    if (node->type == NODE_BINARY_OP) {
-        free_ast(node->data.binary_op.left);
-        free_ast(node->data.binary_op.right);
-    }
-    free(node);
+    // Nodes live in the arena and are released in bulk by ast_arena_reset
+    (void)node;
 }
 
-void print_ast(const ASTNode* node, int indent) {
-    if (!node) {
-        printf("NULL Node\n");
-        return;
-    }
-    
-    for (int i = 0; i < indent; ++i) printf("  ");
-    
-    switch (node->type) {
-        case NODE_NUMBER:
-            printf("Number(%.2f)\n", node->data.value);
-            break;
-            
-        case NODE_VARIABLE:
-            printf("Variable(%c)\n", node->data.name);
-            break;
-            
-        case NODE_BINARY_OP:
-            printf("BinaryOp(");
-            switch (node->data.binary_op.operator) {
-                case OP_ADD: printf("+"); break;
-                case OP_SUBTRACT: printf("-"); break;
-                case OP_MULTIPLY: printf("*"); break;
-                case OP_DIVIDE: printf("/"); break;
-                case OP_POWER: printf("^"); break;
-                default: printf("unknown"); break;
-            }
-            printf(")\n");
-            
-            if (node->data.binary_op.left) {
-                print_ast(node->data.binary_op.left, indent + 1);
-            } else {
-                for (int i = 0; i < indent + 1; ++i) printf("  ");
-                printf("Left: NULL\n");
-            }
-            
-            if (node->data.binary_op.right) {
-                print_ast(node->data.binary_op.right, indent + 1);
-            } else {
-                for (int i = 0; i < indent + 1; ++i) printf("  ");
-                printf("Right: NULL\n");
-            }
-            break;
-            
-        case NODE_ERROR:
-            printf("ErrorNode\n");
-            break;
-            
-        default:
-            printf("Unknown node type\n");
-            break;
+void ast_walk_init(ASTWalkStack* stack) {
+    stack->frames = stack->inline_frames;
+    stack->count = 0;
+    stack->capacity = AST_WALK_INLINE;
+}
+
+void ast_walk_free(ASTWalkStack* stack) {
+    if (stack->frames != stack->inline_frames) {
+        free(stack->frames);
     }
+    ast_walk_init(stack);
 }
 
-// Helper function to write AST to a file with indentation
-static void write_ast_to_file_helper(const ASTNode* node, FILE* file, int indent) {
-    if (!node) {
-        fprintf(file, "NULL Node\n");
-        return;
+ASTWalkFrame* ast_walk_push(ASTWalkStack* stack, const ASTNode* node, int value) {
+    if (stack->count == stack->capacity) {
+        size_t capacity = stack->capacity * 2;
+        ASTWalkFrame* frames = (ASTWalkFrame*)malloc(capacity * sizeof(ASTWalkFrame));
+        if (!frames) return NULL;
+        memcpy(frames, stack->frames, stack->count * sizeof(ASTWalkFrame));
+        if (stack->frames != stack->inline_frames) {
+            free(stack->frames);
+        }
+        stack->frames = frames;
+        stack->capacity = capacity;
     }
     
+    ASTWalkFrame* frame = &stack->frames[stack->count++];
+    frame->node = node;
+    frame->other = NULL;
+    frame->state = 0;
+    frame->value = value;
+    return frame;
+}
+
+static void write_indent(FILE* file, int indent) {
     for (int i = 0; i < indent; ++i) fprintf(file, "  ");
-    
+}
+
+// The line describing one node, without its children
+static void write_ast_line(const ASTNode* node, FILE* file) {
     switch (node->type) {
         case NODE_NUMBER:
             fprintf(file, "Number(%.2f)\n", node->data.value);
             break;
             
         case NODE_VARIABLE:
-            fprintf(file, "Variable(%c)\n", node->data.name);
+            fprintf(file, "Variable(%s)\n", node->data.variable.name);
             break;
             
         case NODE_BINARY_OP:
@@ -131,32 +328,283 @@ static void write_ast_to_file_helper(const ASTNode* node, FILE* file, int indent
                 default: fprintf(file, "unknown"); break;
             }
             fprintf(file, ")\n");
-            
-            if (node->data.binary_op.left) {
-                write_ast_to_file_helper(node->data.binary_op.left, file, indent + 1);
-            } else {
-                for (int i = 0; i < indent + 1; ++i) fprintf(file, "  ");
-                fprintf(file, "Left: NULL\n");
-            }
-            
-            if (node->data.binary_op.right) {
-                write_ast_to_file_helper(node->data.binary_op.right, file, indent + 1);
-            } else {
-                for (int i = 0; i < indent + 1; ++i) fprintf(file, "  ");
-                fprintf(file, "Right: NULL\n");
-            }
             break;
             
         case NODE_ERROR:
             fprintf(file, "ErrorNode\n");
             break;
             
+        case NODE_ASSIGN:
+            fprintf(file, "Assign(%s)\n", node->data.assign.name);
+            break;
+            
+        case NODE_SEQUENCE:
+            fprintf(file, "Sequence\n");
+            break;
+            
         default:
             fprintf(file, "Unknown node type\n");
             break;
     }
 }
 
+// Write a tree in preorder, every child indented one level deeper than its parent
+static int write_ast_indented(const ASTNode* node, FILE* file, int indent) {
+    if (!node) {
+        fprintf(file, "NULL Node\n");
+        return 1;
+    }
+    
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    int ok = ast_walk_push(&stack, node, indent) != NULL;
+    while (ok && stack.count > 0) {
+        ASTWalkFrame frame = stack.frames[--stack.count];
+        write_indent(file, frame.value);
+        if (!frame.node) {
+            // A missing right child, written after the left subtree
+            fprintf(file, "Right: NULL\n");
+            continue;
+        }
+        
+        write_ast_line(frame.node, file);
+        const ASTNode* left;
+        const ASTNode* right;
+        int children = ast_children(frame.node, &left, &right);
+        if (children == 0) continue;
+        if (children == 1) {
+            if (left) {
+                ok = ast_walk_push(&stack, left, frame.value + 1) != NULL;
+            } else {
+                write_indent(file, frame.value + 1);
+                fprintf(file, "Value: NULL\n");
+            }
+            continue;
+        }
+        
+        // The right child is pushed first so the left one comes out first
+        ok = ast_walk_push(&stack, right, frame.value + 1) != NULL;
+        if (ok && left) {
+            ok = ast_walk_push(&stack, left, frame.value + 1) != NULL;
+        } else if (ok) {
+            write_indent(file, frame.value + 1);
+            fprintf(file, "Left: NULL\n");
+        }
+    }
+    ast_walk_free(&stack);
+    
+    if (!ok) {
+        fprintf(stderr, "Error: Out of memory writing the AST\n");
+    }
+    return ok;
+}
+
+void print_ast(const ASTNode* node, int indent) {
+    write_ast_indented(node, stdout, indent);
+}
+
+void write_ast_to_stream(const ASTNode* node, FILE* file) {
+    write_ast_indented(node, file, 0);
+}
+
+int ast_has_errors(const ASTNode* node) {
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    
+    // Follow left children, keeping right subtrees for later; leaves on
+    // the right are checked on the spot so chains need no stack
+    int errors = 0;
+    for (;;) {
+        if (!node || node->type == NODE_ERROR) {
+            errors = 1;
+            break;
+        }
+        const ASTNode* left;
+        const ASTNode* right;
+        int children = ast_children(node, &left, &right);
+        if (children == 2) {
+            const ASTNode* first;
+            const ASTNode* second;
+            if (!right || right->type == NODE_ERROR) {
+                errors = 1;
+                break;
+            }
+            if (ast_children(right, &first, &second) > 0 && !ast_walk_push(&stack, right, 0)) {
+                errors = 1; // Out of memory: assume the worst
+                break;
+            }
+        }
+        if (children > 0) {
+            node = left;
+            continue;
+        }
+        if (stack.count == 0) break;
+        node = stack.frames[--stack.count].node;
+    }
+    
+    ast_walk_free(&stack);
+    return errors;
+}
+
+size_t ast_count_nodes(const ASTNode* node) {
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    
+    size_t count = 0;
+    while (node) {
+        count++;
+        const ASTNode* left;
+        const ASTNode* right;
+        const ASTNode* first;
+        const ASTNode* second;
+        if (ast_children(node, &left, &right) > 0) {
+            if (right && ast_children(right, &first, &second) > 0) {
+                if (!ast_walk_push(&stack, right, 0)) {
+                    count = 0;
+                    break;
+                }
+            } else if (right) {
+                count++;
+            }
+            node = left;
+        } else {
+            node = NULL;
+        }
+        if (!node && stack.count > 0) {
+            node = stack.frames[--stack.count].node;
+        }
+    }
+    
+    ast_walk_free(&stack);
+    return count;
+}
+
+// Slot of a node pointer in an open-addressing set of `capacity` slots
+static size_t node_slot(const ASTNode* node, size_t capacity) {
+    size_t h = (size_t)(uintptr_t)node;
+    h ^= h >> 17;
+    h *= (size_t)0x9E3779B97F4A7C15ULL;
+    return (h ^ (h >> 29)) & (capacity - 1);
+}
+
+// Add a node to the set, growing it to stay at most half full
+// @return 1 if it was added, 0 if already present, -1 if out of memory
+static int node_set_add(const ASTNode*** set, size_t* capacity, size_t count, const ASTNode* node) {
+    if ((count + 1) * 2 > *capacity) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : 64;
+        const ASTNode** grown = (const ASTNode**)calloc(grown_capacity, sizeof(ASTNode*));
+        if (!grown) return -1;
+        for (size_t i = 0; i < *capacity; i++) {
+            if (!(*set)[i]) continue;
+            size_t slot = node_slot((*set)[i], grown_capacity);
+            while (grown[slot]) slot = (slot + 1) & (grown_capacity - 1);
+            grown[slot] = (*set)[i];
+        }
+        free((void*)*set);
+        *set = grown;
+        *capacity = grown_capacity;
+    }
+
+    size_t slot = node_slot(node, *capacity);
+    while ((*set)[slot]) {
+        if ((*set)[slot] == node) return 0;
+        slot = (slot + 1) & (*capacity - 1);
+    }
+    (*set)[slot] = node;
+    return 1;
+}
+
+size_t ast_count_unique_nodes(const ASTNode* node) {
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    const ASTNode** seen = NULL;
+    size_t capacity = 0;
+    size_t count = 0;
+
+    // Children of a node are only visited the first time it is reached
+    int ok = !node || ast_walk_push(&stack, node, 0) != NULL;
+    while (ok && stack.count > 0) {
+        const ASTNode* current = stack.frames[--stack.count].node;
+        int added = node_set_add(&seen, &capacity, count, current);
+        if (added < 0) ok = 0;
+        if (added <= 0) continue;
+        count++;
+
+        const ASTNode* first;
+        const ASTNode* second;
+        ast_children(current, &first, &second);
+        if (second) ok = ast_walk_push(&stack, second, 0) != NULL;
+        if (ok && first) ok = ast_walk_push(&stack, first, 0) != NULL;
+    }
+
+    free((void*)seen);
+    ast_walk_free(&stack);
+    return ok ? count : 0;
+}
+
+int ast_equal(const ASTNode* a, const ASTNode* b) {
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    
+    int equal = 1;
+    for (;;) {
+        if (a == b) {
+            if (!a) {
+                equal = 0;
+                break;
+            }
+            // A shared subtree is equal to itself
+        } else if (!a || !b || a->type != b->type) {
+            equal = 0;
+            break;
+        } else if (a->type == NODE_NUMBER) {
+            equal = a->data.value == b->data.value;
+        } else if (a->type == NODE_VARIABLE) {
+            equal = a->data.variable.symbol == b->data.variable.symbol &&
+                    a->data.variable.def == b->data.variable.def;
+        } else if (a->type == NODE_ASSIGN) {
+            if (a->data.assign.symbol != b->data.assign.symbol ||
+                a->data.assign.def != b->data.assign.def) {
+                equal = 0;
+                break;
+            }
+            a = a->data.assign.value;
+            b = b->data.assign.value;
+            continue;
+        } else if (a->type == NODE_BINARY_OP || a->type == NODE_SEQUENCE) {
+            const ASTNode* a_left;
+            const ASTNode* a_right;
+            const ASTNode* b_left;
+            const ASTNode* b_right;
+            ast_children(a, &a_left, &a_right);
+            ast_children(b, &b_left, &b_right);
+            ASTWalkFrame* frame = NULL;
+            if (a->type == NODE_SEQUENCE ||
+                a->data.binary_op.operator == b->data.binary_op.operator) {
+                frame = ast_walk_push(&stack, a_right, 0);
+            }
+            if (!frame) {
+                equal = 0; // Different operators, or out of memory
+                break;
+            }
+            frame->other = b_right;
+            a = a_left;
+            b = b_left;
+            continue;
+        } else {
+            equal = 0; // Error nodes never compare equal
+        }
+        
+        if (!equal || stack.count == 0) break;
+        stack.count--;
+        a = stack.frames[stack.count].node;
+        b = stack.frames[stack.count].other;
+    }
+    
+    ast_walk_free(&stack);
+    return equal;
+}
+
 int write_ast_to_file(const ASTNode* node, const char* filename) {
     FILE* file = fopen(filename, "w");
     if (!file) {
@@ -165,8 +613,8 @@ int write_ast_to_file(const ASTNode* node, const char* filename) {
     }
     
     fprintf(file, "AST Structure:\n");
-    write_ast_to_file_helper(node, file, 0);
+    int ok = write_ast_indented(node, file, 0);
     
     fclose(file);
-    return 1;
+    return ok;
 }
@@ -1,13 +1,16 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdint.h>
 #include <stdio.h>
 
 typedef enum {
     NODE_BINARY_OP,
     NODE_NUMBER,
     NODE_VARIABLE,
-    NODE_ERROR
+    NODE_ERROR,
+    NODE_ASSIGN,
+    NODE_SEQUENCE
 } NodeType;
 
 typedef enum {
@@ -18,6 +21,20 @@ typedef enum {
     OP_POWER
 } OperatorType;
 
+/* A program is a list of statements separated by ';', each an expression
+ * or an assignment `name = expression`. Two or more statements form a
+ * chain of NODE_SEQUENCE nodes, which run `first`, then `second`, and
+ * have the value of `second`; the parser leans the chain to the left,
+ * ((s1; s2); s3), so the statements are its leaves in program order.
+ * Assignments only appear as statements, never inside an expression.
+ *
+ * Every assignment is a definition, numbered 0, 1, ... in program order.
+ * A variable that was assigned earlier in the program reads the latest
+ * such definition: its `def` is that number. A variable not assigned
+ * before it is read is an input (def is AST_NO_DEF).
+ */
+#define AST_NO_DEF UINT32_MAX
+
 typedef struct ASTNode {
     NodeType type;
     int line;
@@ -29,14 +46,109 @@ typedef struct ASTNode {
             OperatorType operator;
         } binary_op;
         double value;
-        char name;
+        struct {
+            uint32_t symbol;   // ID in the compiler's symbol table
+            uint32_t def;      // Definition read, or AST_NO_DEF for an input
+            const char* name;  // Interned name of the symbol
+        } variable;
+        struct {
+            struct ASTNode* value;
+            const char* name;
+            uint32_t symbol;
+            uint32_t def;      // Number of this definition in its program
+        } assign;
+        struct {
+            struct ASTNode* first;
+            struct ASTNode* second;
+        } sequence;
     } data;
 } ASTNode;
 
-ASTNode* create_number_node(double value, int line, int column);
-ASTNode* create_variable_node(char name, int line, int column);
-ASTNode* create_binary_node(ASTNode* left, OperatorType op, ASTNode* right, int line, int column);
-ASTNode* create_error_node(int line, int column);
+/* The children of a node in evaluation order (NULL where one is missing)
+ * @return The number of children of its type: 2 for operators and
+ *         sequences, 1 for assignments, 0 for leaves
+ */
+static inline int ast_children(const ASTNode* node, const ASTNode** first, const ASTNode** second) {
+    switch (node->type) {
+        case NODE_BINARY_OP:
+            *first = node->data.binary_op.left;
+            *second = node->data.binary_op.right;
+            return 2;
+        case NODE_SEQUENCE:
+            *first = node->data.sequence.first;
+            *second = node->data.sequence.second;
+            return 2;
+        case NODE_ASSIGN:
+            *first = node->data.assign.value;
+            *second = NULL;
+            return 1;
+        default:
+            *first = NULL;
+            *second = NULL;
+            return 0;
+    }
+}
+
+/* Bump allocator for AST nodes. Nodes are carved from large blocks in
+ * allocation order and released all at once by ast_arena_reset, which
+ * keeps the blocks for the next expression.
+ */
+typedef struct ASTArenaBlock ASTArenaBlock;
+typedef struct ASTInternEntry ASTInternEntry;
+
+typedef struct {
+    ASTArenaBlock* head;     // First block in the chain
+    ASTArenaBlock* current;  // Block new nodes are taken from
+    
+    // Hash consing: structurally identical nodes are shared, turning trees
+    // into DAGs. Entries of earlier expressions are invalidated in O(1) by
+    // bumping the generation on reset.
+    int hash_consing;
+    ASTInternEntry* intern_table;
+    size_t intern_capacity;  // Power of two (0 until first use)
+    size_t intern_count;     // Entries of the current generation
+    unsigned generation;
+    size_t intern_hits;      // Nodes reused instead of allocated (cumulative)
+    
+    // Allocation counters for --stats (cumulative, kept across resets)
+    size_t nodes_allocated;
+    size_t blocks_allocated;
+    size_t bytes_allocated;
+} ASTArena;
+
+void ast_arena_init(ASTArena* arena);
+ASTNode* ast_arena_alloc(ASTArena* arena);
+
+/* Release every node of the arena in O(1); the memory is kept for reuse */
+void ast_arena_reset(ASTArena* arena);
+
+/* Return all blocks of the arena to the system */
+void ast_arena_free(ASTArena* arena);
+
+/* Enable or disable hash consing for nodes built in this arena.
+ * While enabled, create_number_node, create_variable_node and
+ * create_binary_node return an existing node when an identical one was
+ * already built since the last reset (error, assignment and sequence
+ * nodes are never shared; variables are only shared with variables
+ * reading the same definition).
+ * Shared nodes keep the position of their first occurrence and must not
+ * be modified.
+ */
+void ast_arena_set_hash_consing(ASTArena* arena, int enabled);
+
+/* Node constructors; every node is allocated from the given arena */
+ASTNode* create_number_node(ASTArena* arena, double value, int line, int column);
+ASTNode* create_variable_node(ASTArena* arena, uint32_t symbol, const char* name, uint32_t def,
+                              int line, int column);
+ASTNode* create_binary_node(ASTArena* arena, ASTNode* left, OperatorType op, ASTNode* right,
+                            int line, int column);
+ASTNode* create_assign_node(ASTArena* arena, uint32_t symbol, const char* name, uint32_t def,
+                            ASTNode* value, int line, int column);
+ASTNode* create_sequence_node(ASTArena* arena, ASTNode* first, ASTNode* second, int line, int column);
+ASTNode* create_error_node(ASTArena* arena, int line, int column);
+/* Nodes are owned by their arena; this is kept for API compatibility and
+ * does not release memory. Use ast_arena_reset once a tree is done.
+ */
 void free_ast(ASTNode* node);
 void print_ast(const ASTNode* node, int indent);
 
@@ -47,4 +159,66 @@ void print_ast(const ASTNode* node, int indent);
  */
 int write_ast_to_file(const ASTNode* node, const char* filename);
 
+/* Write the AST to an already open stream (no header)
+ * @param node The root node of the AST
+ * @param file The stream to write to
+ */
+void write_ast_to_stream(const ASTNode* node, FILE* file);
+
+/* Check whether the AST contains any error nodes
+ * @param node The root node of the AST
+ * @return 1 if an error node (or a missing child) is present, 0 otherwise
+ */
+int ast_has_errors(const ASTNode* node);
+
+/* Count the nodes of a tree
+ * @param node The root node of the AST
+ * @return The number of nodes (0 for NULL)
+ */
+size_t ast_count_nodes(const ASTNode* node);
+
+/* Count the distinct nodes of a tree whose subtrees may be shared (hash
+ * consing, strength reduction): a shared node counts once, however many
+ * paths lead to it
+ * @return The number of nodes (0 for NULL or if out of memory)
+ */
+size_t ast_count_unique_nodes(const ASTNode* node);
+
+/* Check whether two trees are structurally identical
+ * (variables are compared by symbol ID and definition, so both must come
+ * from one compiler)
+ * @return 1 if both have the same shape, operators, constants and variables;
+ *         0 otherwise (trees containing error nodes are never equal)
+ */
+int ast_equal(const ASTNode* a, const ASTNode* b);
+
+/* Explicit stack for walking a tree without recursion, so the depth of an
+ * expression is bounded by memory instead of the C stack. The first
+ * AST_WALK_INLINE frames are held in the stack itself; deeper trees move
+ * them to the heap. A stack must not be copied once initialized.
+ */
+#define AST_WALK_INLINE 64
+
+typedef struct {
+    const ASTNode* node;
+    const ASTNode* other;  // Walker-specific: the node it is compared with, a child's result, ...
+    int state;             // Walker-specific progress through the node (0 when pushed)
+    int value;             // Walker-specific: indentation, a child's index or label, ...
+} ASTWalkFrame;
+
+typedef struct {
+    ASTWalkFrame* frames;
+    size_t count;
+    size_t capacity;
+    ASTWalkFrame inline_frames[AST_WALK_INLINE];
+} ASTWalkStack;
+
+void ast_walk_init(ASTWalkStack* stack);
+void ast_walk_free(ASTWalkStack* stack);
+
+/* Push a frame for node with state 0
+ * @return The new frame (valid until the next push), or NULL if out of memory
+ */
+ASTWalkFrame* ast_walk_push(ASTWalkStack* stack, const ASTNode* node, int value);
+
 #endif // AST_H
@@ -0,0 +1,980 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime, open_memstream, fileno
+#include "batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cache.h"
+#include "codegen.h"
+#include "flat_ast.h"
+#include "optimizer.h"
+#include "serialize.h"
+#include "vm.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Output streams of one batch; NULL when that output is not requested
+typedef struct {
+    FILE* ast;
+    FILE* stack;
+    FILE* addr;
+    FILE* eval;
+    BinaryWriter* binary;     // Compiled expressions for <base>.pqb
+} BatchStreams;
+
+// Output file names of one input
+typedef struct {
+    char ast[256];
+    char stack[256];
+    char addr[256];
+    char eval[256];
+    char binary[256];
+} BatchFileNames;
+
+typedef struct {
+    long count;
+    long failed;
+    size_t nodes_before;
+    size_t nodes_after;
+} BatchTotals;
+
+static double elapsed_seconds(const struct timespec* start, const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Output names follow process_file for files and process_expression for stdin
+static void batch_file_names(const char* filename, BatchFileNames* names) {
+    strcpy(names->ast, "ast_output.txt");
+    strcpy(names->stack, "stack_output.txt");
+    strcpy(names->addr, "3addr_output.txt");
+    strcpy(names->eval, "eval_output.txt");
+    strcpy(names->binary, "output.pqb");
+    if (!filename) return;
+
+    char base_filename[240];
+    strncpy(base_filename, filename, sizeof(base_filename) - 1);
+    base_filename[sizeof(base_filename) - 1] = '\0';
+
+    char* dot = strrchr(base_filename, '.');
+    if (dot) {
+        *dot = '\0'; // Remove extension
+    }
+
+    snprintf(names->ast, sizeof(names->ast), "%s_ast.txt", base_filename);
+    snprintf(names->stack, sizeof(names->stack), "%s_stack.txt", base_filename);
+    snprintf(names->addr, sizeof(names->addr), "%s_3addr.txt", base_filename);
+    snprintf(names->eval, sizeof(names->eval), "%s_eval.txt", base_filename);
+    snprintf(names->binary, sizeof(names->binary), "%s.pqb", base_filename);
+}
+
+static BinaryWriter* create_binary_writer() {
+    BinaryWriter* writer = (BinaryWriter*)malloc(sizeof(BinaryWriter));
+    if (!writer) {
+        fprintf(stderr, "Error: Out of memory for the binary output\n");
+        return NULL;
+    }
+    binary_writer_init(writer);
+    return writer;
+}
+
+static void destroy_binary_writer(BinaryWriter* writer) {
+    if (!writer) return;
+    binary_writer_free(writer);
+    free(writer);
+}
+
+// Open one batch output stream and write its header
+static FILE* open_batch_output(const char* filename, const char* header) {
+    FILE* output = fopen(filename, "w");
+    if (!output) {
+        fprintf(stderr, "Error: Could not open file %s for writing\n", filename);
+        return NULL;
+    }
+    fprintf(output, "%s", header);
+    return output;
+}
+
+static void open_batch_outputs(const BatchOptions* options, const BatchFileNames* names,
+                               BatchStreams* out) {
+    memset(out, 0, sizeof(*out));
+    if (options->show_ast) {
+        out->ast = open_batch_output(names->ast, "AST Structure:\n");
+    }
+    if (options->gen_stack) {
+        out->stack = open_batch_output(names->stack,
+                                       "# Stack Machine Code\n# ==================\n");
+    }
+    if (options->gen_3addr) {
+        out->addr = open_batch_output(names->addr,
+                                      "# Three-Address Code\n# =================\n");
+    }
+    if (options->evaluate) {
+        out->eval = open_batch_output(names->eval, "# Results\n# =======\n");
+    }
+    if (options->write_binary) {
+        out->binary = create_binary_writer();
+    }
+}
+
+// Count what was written to a text output for --stats
+static void count_written(CompileStats* stats, FILE* output) {
+    if (stats && stats->enabled) {
+        long size = ftell(output);
+        if (size > 0) stats->bytes_written += (uint64_t)size;
+    }
+}
+
+static void close_batch_outputs(const BatchFileNames* names, BatchStreams* out, CompileStats* stats) {
+    if (out->ast) {
+        count_written(stats, out->ast);
+        fclose(out->ast);
+        printf("AST structures written to %s\n", names->ast);
+    }
+    if (out->stack) {
+        count_written(stats, out->stack);
+        fclose(out->stack);
+        printf("Stack machine code written to %s\n", names->stack);
+    }
+    if (out->addr) {
+        count_written(stats, out->addr);
+        fclose(out->addr);
+        printf("Three-address code written to %s\n", names->addr);
+    }
+    if (out->eval) {
+        count_written(stats, out->eval);
+        fclose(out->eval);
+        printf("Results written to %s\n", names->eval);
+    }
+    if (out->binary) {
+        if (binary_writer_save(out->binary, names->binary)) {
+            printf("Binary code written to %s\n", names->binary);
+        }
+        destroy_binary_writer(out->binary);
+    }
+    memset(out, 0, sizeof(*out));
+}
+
+static void print_batch_summary(const BatchTotals* totals, double seconds, int jobs,
+                                const BatchOptions* options, size_t nodes_shared) {
+    printf("\nCompiled %ld expression%s (%ld failed) in %.3f s",
+           totals->count, totals->count == 1 ? "" : "s", totals->failed, seconds);
+    if (seconds > 0) {
+        printf(" (%.0f expressions/s)", totals->count / seconds);
+    }
+    if (jobs > 1) {
+        printf(" on %d threads", jobs);
+    }
+    printf("\n");
+    if (options->optimize && totals->nodes_after <= totals->nodes_before) {
+        printf("Optimization: removed %zu of %zu nodes\n",
+               totals->nodes_before - totals->nodes_after, totals->nodes_before);
+    } else if (options->optimize) {
+        printf("Optimization: %zu nodes became %zu\n", totals->nodes_before, totals->nodes_after);
+    }
+    if (options->hash_consing) {
+        printf("Hash consing: %zu nodes shared\n", nodes_shared);
+    }
+}
+
+// Code generation options that change the generated code, for cache keys
+static uint32_t cache_salt(const BatchOptions* options) {
+    return (options->optimize ? 1u : 0u) | (options->hash_consing ? 2u : 0u) |
+           (options->use_flat ? 4u : 0u) | ((uint32_t)options->registers << 8);
+}
+
+// Compile every statement of the compiler's current input.
+// Expressions are numbered from first_expression + 1.
+static void compile_statements(Compiler* compiler, const BatchOptions* options,
+                               BatchStreams* out, long first_expression, BatchTotals* totals) {
+    // The flat generators only write the classic one-temporary-per-node form
+    int use_flat = options->use_flat && !options->registers;
+    FILE* eval_out = out->eval;
+
+    // Reused for every expression when generating code from the flat AST
+    FlatAST flat;
+    flat_ast_init(&flat);
+
+    // Code is built in memory and serialized from reused programs
+    IRProgram stack_ir, addr_ir;
+    ir_init(&stack_ir);
+    ir_init(&addr_ir);
+    
+    // One bytecode buffer and one VM stack serve every expression; variable
+    // values follow the compiler's symbol table as it grows
+    Bytecode bc;
+    VM vm;
+    SymbolValues values;
+    bytecode_init(&bc);
+    symbol_values_init(&values);
+    if (eval_out && !vm_init(&vm, 256)) {
+        fprintf(stderr, "Error: Out of memory for the VM stack\n");
+        eval_out = NULL;
+    }
+
+    // The cache holds stack and three-address code; a hit skips parsing
+    // unless another output needs the tree
+    CompileCache* cache = (out->stack || out->addr) ? options->cache : NULL;
+    uint32_t forms = (out->stack ? CACHE_STACK : 0) | (out->addr ? CACHE_THREE_ADDR : 0);
+    uint32_t salt = cache_salt(options);
+    int need_tree = out->ast || eval_out || out->binary;
+    CacheKey key;
+    CacheCopy cached_copy;
+    SymbolTable locals; // Variables of the keyed statement, as numbered in cached code
+    cache_key_init(&key);
+    cache_copy_init(&cached_copy);
+    symbol_table_init(&locals);
+
+    set_newline_separated(compiler, 1);
+    parser_reset(compiler);
+
+    long count = first_expression;
+    while (parser_begin_statement(compiler)) {
+        int line = compiler->parser.line;
+        int column = compiler->parser.column;
+
+        // Key the statement by its tokens before parsing it
+        const CacheRecord* cached = NULL;
+        int keyed = 0;
+        if (cache) {
+            const Token* tokens;
+            uint32_t token_count;
+            keyed = parser_read_statement(compiler, &tokens, &token_count) &&
+                    cache_key_build(&key, salt, tokens, token_count, &compiler->symbols, &locals);
+            if (keyed) cached = cache_lookup(cache, &key, forms, &cached_copy);
+        }
+
+        ASTNode* root = NULL;
+        int failed;
+        if (cached && !need_tree) {
+            parser_end_statement(compiler); // Nothing to parse: drop the tokens
+            failed = cache_record_failed(cached);
+        } else {
+            root = parse_program(compiler);
+            int clean = parser_end_statement(compiler);
+            failed = !root || !clean || ast_has_errors(root);
+        }
+        count++;
+        totals->count++;
+
+        if (failed) {
+            totals->failed++;
+            error_report(compiler, ERROR_SYNTAX, line, column, "Invalid expression");
+        }
+
+        size_t nodes_before = 0;
+        size_t nodes_after = 0;
+        if (root && options->optimize) {
+            uint64_t start = stats_begin(&compiler->stats);
+            OptimizeStats stats;
+            root = optimize_ast(&compiler->arena, root, &stats);
+            nodes_before = stats.nodes_before;
+            nodes_after = stats.nodes_after;
+            stats_end(&compiler->stats, STATS_OPTIMIZE, start);
+        }
+        if (cached) {
+            cache_record_nodes(cached, &nodes_before, &nodes_after);
+        }
+        totals->nodes_before += nodes_before;
+        totals->nodes_after += nodes_after;
+
+        if (root && out->ast) {
+            uint64_t start = stats_begin(&compiler->stats);
+            fprintf(out->ast, "\n# Expression %ld\n", count);
+            write_ast_to_stream(root, out->ast);
+            stats_end(&compiler->stats, STATS_AST_OUTPUT, start);
+        }
+
+        // Stack and three-address code: from the cache or generated now
+        int has_code = cached ? cache_record_parsed(cached) : root != NULL;
+        IRProgram stack_view, addr_view;
+        const IRProgram* stack_code = &stack_ir;
+        const IRProgram* addr_code = &addr_ir;
+        const SymbolTable* code_symbols = &compiler->symbols;
+        int stack_ok = 0;
+        int addr_ok = 0;
+        if (cached) {
+            cache_record_stack(cached, &stack_view);
+            cache_record_three_addr(cached, &addr_view);
+            stack_code = &stack_view;
+            addr_code = &addr_view;
+            code_symbols = &locals;
+            stack_ok = addr_ok = 1;
+        } else if (root && use_flat && (out->stack || out->addr) && !flat_ast_from_tree(&flat, root)) {
+            fprintf(stderr, "Error: Out of memory building the flat AST\n");
+            use_flat = 0;
+        }
+        if (has_code && out->stack) {
+            uint64_t start = stats_begin(&compiler->stats);
+            if (!cached) {
+                stack_ok = use_flat ? generate_stack_ir_flat(&flat, &stack_ir)
+                                    : generate_stack_ir(root, &stack_ir);
+            }
+            fprintf(out->stack, "\n# Expression %ld\n", count);
+            if (stack_ok) {
+                ir_write_stack(stack_code, code_symbols, out->stack);
+                compiler->stats.instructions += stack_code->count;
+            } else {
+                fprintf(out->stack, "ERROR\n");
+            }
+            stats_end(&compiler->stats, STATS_STACK, start);
+        }
+        if (has_code && out->addr) {
+            uint64_t start = stats_begin(&compiler->stats);
+            if (!cached) {
+                if (use_flat) {
+                    addr_ok = generate_three_addr_ir_flat(&flat, &addr_ir);
+                } else if (options->registers > 0) {
+                    addr_ok = generate_register_ir(compiler, root, options->registers, &addr_ir);
+                } else {
+                    addr_ok = generate_three_addr_ir(compiler, root, &addr_ir);
+                }
+            }
+            fprintf(out->addr, "\n# Expression %ld\n", count);
+            if (addr_ok) {
+                ir_write_three_addr(addr_code, code_symbols, out->addr);
+                compiler->stats.instructions += addr_code->count;
+            } else {
+                fprintf(out->addr, "ERROR\n");
+            }
+            stats_end(&compiler->stats, STATS_THREE_ADDR, start);
+        }
+        if (keyed && !cached) {
+            cache_store(cache, &key, failed, root != NULL,
+                        out->stack && stack_ok ? &stack_ir : NULL,
+                        out->addr && addr_ok ? &addr_ir : NULL, nodes_before, nodes_after,
+                        &compiler->symbols, &locals);
+        }
+
+        if (root && eval_out) {
+            double result;
+            if (bytecode_compile(&bc, root) &&
+                symbol_values_resolve(&values, &compiler->symbols, options->bindings) &&
+                vm_execute(&vm, &bc, values.values, &result)) {
+                fprintf(eval_out, "%g\n", result);
+            } else {
+                fprintf(eval_out, "ERROR\n");
+            }
+        }
+
+        // Failed expressions get an entry too, so entry N is expression N
+        if (out->binary && !binary_writer_add(out->binary, compiler, root)) {
+            fprintf(stderr, "Error: Out of memory for the binary output\n");
+            destroy_binary_writer(out->binary);
+            out->binary = NULL;
+        }
+
+        // All nodes of this expression go away in O(1), and the next one
+        // gets its own error limit
+        ast_arena_reset(&compiler->arena);
+        error_reset(compiler);
+    }
+
+    set_newline_separated(compiler, 0);
+    cache_key_free(&key);
+    cache_copy_free(&cached_copy);
+    symbol_table_free(&locals);
+    flat_ast_free(&flat);
+    ir_free(&stack_ir);
+    ir_free(&addr_ir);
+    bytecode_free(&bc);
+    symbol_values_free(&values);
+    if (eval_out) {
+        vm_free(&vm);
+    }
+}
+
+void process_batch(Compiler* compiler, const char* filename, const BatchOptions* options) {
+    FILE* input = stdin;
+    if (filename) {
+        input = fopen(filename, "r");
+        if (!input) {
+            fprintf(stderr, "Error: Could not open file: %s\n", filename);
+            return;
+        }
+    }
+
+    BatchFileNames names;
+    BatchStreams out;
+    batch_file_names(filename, &names);
+    open_batch_outputs(options, &names, &out);
+
+    // Initialize error handling
+    error_init(compiler);
+
+    // Set up the lexer and parser once for the whole input
+    set_token_stream(compiler, input);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    BatchTotals totals = {0, 0, 0, 0};
+    size_t shared_before = compiler->arena.intern_hits;
+    compile_statements(compiler, options, &out, 0, &totals);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    release_token_stream(compiler);
+
+    close_batch_outputs(&names, &out, &compiler->stats);
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    print_batch_summary(&totals, elapsed_seconds(&start, &end), 1, options,
+                        compiler->arena.intern_hits - shared_before);
+}
+
+#ifdef _WIN32
+
+// No POSIX threads or memory streams: compile the files one after another
+int process_batch_parallel(const char* const* filenames, int file_count, int jobs,
+                           const BatchOptions* options) {
+    (void)jobs;
+    Compiler* compiler = compiler_create();
+    if (!compiler) return 0;
+    ast_arena_set_hash_consing(&compiler->arena, options->hash_consing);
+    compiler->codegen.registers = options->registers;
+    compiler->stats.enabled = options->stats != NULL;
+    for (int i = 0; i < file_count; i++) {
+        process_batch(compiler, filenames[i], options);
+    }
+    if (options->stats) {
+        stats_add_arena(&compiler->stats, &compiler->arena);
+        stats_merge(options->stats, &compiler->stats);
+    }
+    compiler_destroy(compiler);
+    return 1;
+}
+
+#else
+
+#define CHUNK_MIN_BYTES (16 * 1024)
+#define CHUNK_MAX_BYTES (1024 * 1024)
+#define CHUNKS_PER_JOB 16
+
+// Index of each per-chunk output buffer
+enum { OUT_AST, OUT_STACK, OUT_ADDR, OUT_EVAL, OUT_ERRORS, OUT_COUNT };
+
+// One input file, held in memory for the whole run
+typedef struct {
+    const char* filename;
+    char* data;
+    size_t size;
+    int mapped;             // data is an mmap'd region rather than malloc'd
+    BatchFileNames names;
+    BatchStreams out;       // Open while its chunks are being merged
+} BatchInput;
+
+// A run of whole lines of one input, compiled by a single worker
+typedef struct {
+    int input;              // Index into the inputs
+    size_t offset;
+    size_t length;
+    int first_line;
+    long first_expression;  // Expressions in the input before this chunk
+
+    // Filled in by the worker
+    char* buffers[OUT_COUNT];
+    size_t sizes[OUT_COUNT];
+    BinaryWriter* binary;
+    BatchTotals totals;
+    int done;
+} BatchChunk;
+
+// Per-worker double-ended queue of chunk indices. The owner takes from
+// the front (oldest chunk first, so merging can start early); thieves
+// take from the back.
+typedef struct {
+    pthread_mutex_t lock;
+    int* tasks;
+    int head;
+    int tail;
+} WorkQueue;
+
+typedef struct {
+    BatchInput* inputs;
+    BatchChunk* chunks;
+    int chunk_count;
+    WorkQueue* queues;
+    int jobs;
+    const BatchOptions* options;
+
+    pthread_mutex_t done_lock;   // Guards BatchChunk.done
+    pthread_cond_t done_cond;
+} ParallelBatch;
+
+typedef struct {
+    ParallelBatch* batch;
+    int id;
+    size_t nodes_shared;
+    CompileStats stats;
+} BatchWorker;
+
+static int take_task(ParallelBatch* batch, int id) {
+    WorkQueue* own = &batch->queues[id];
+    int task = -1;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail) {
+        task = own->tasks[own->head++];
+    }
+    pthread_mutex_unlock(&own->lock);
+    if (task >= 0) return task;
+
+    // Own queue is empty: steal from the back of another worker's queue
+    for (int k = 1; k < batch->jobs && task < 0; k++) {
+        WorkQueue* victim = &batch->queues[(id + k) % batch->jobs];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            task = victim->tasks[--victim->tail];
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return task;
+}
+
+static void compile_chunk(Compiler* compiler, ParallelBatch* batch, BatchChunk* chunk) {
+    const BatchOptions* options = batch->options;
+    const BatchInput* input = &batch->inputs[chunk->input];
+    FILE* streams[OUT_COUNT] = {NULL};
+    int wanted[OUT_COUNT] = {
+        options->show_ast, options->gen_stack, options->gen_3addr, options->evaluate, 1
+    };
+
+    for (int k = 0; k < OUT_COUNT; k++) {
+        if (wanted[k]) {
+            streams[k] = open_memstream(&chunk->buffers[k], &chunk->sizes[k]);
+        }
+    }
+
+    if (options->write_binary) {
+        chunk->binary = create_binary_writer();
+    }
+    BatchStreams out = {streams[OUT_AST], streams[OUT_STACK], streams[OUT_ADDR], streams[OUT_EVAL],
+                        chunk->binary};
+
+    // The error limit is per expression (compile_statements resets it),
+    // so a chunk reports exactly what --batch reports for its lines
+    error_init(compiler);
+    error_set_sink(compiler, streams[OUT_ERRORS]);
+    set_input_string(compiler, input->data + chunk->offset, chunk->length);
+    compiler->lexer.yylineno = chunk->first_line;
+
+    compile_statements(compiler, options, &out, chunk->first_expression, &chunk->totals);
+    chunk->binary = out.binary;  // NULL if it ran out of memory
+
+    release_input(compiler);
+    error_set_sink(compiler, NULL);
+    for (int k = 0; k < OUT_COUNT; k++) {
+        if (streams[k]) fclose(streams[k]);
+    }
+}
+
+static void* batch_worker_main(void* arg) {
+    BatchWorker* worker = (BatchWorker*)arg;
+    ParallelBatch* batch = worker->batch;
+
+    // Every worker owns one compiler context for all of its chunks
+    Compiler* compiler = compiler_create();
+    if (!compiler) {
+        fprintf(stderr, "Error: Out of memory for worker %d\n", worker->id);
+    } else {
+        ast_arena_set_hash_consing(&compiler->arena, batch->options->hash_consing);
+        compiler->codegen.registers = batch->options->registers;
+        compiler->stats.enabled = batch->options->stats != NULL;
+    }
+
+    int task;
+    while ((task = take_task(batch, worker->id)) >= 0) {
+        BatchChunk* chunk = &batch->chunks[task];
+        if (compiler) {
+            compile_chunk(compiler, batch, chunk);
+        }
+
+        pthread_mutex_lock(&batch->done_lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&batch->done_cond);
+        pthread_mutex_unlock(&batch->done_lock);
+    }
+
+    if (compiler) {
+        worker->nodes_shared = compiler->arena.intern_hits;
+        stats_add_arena(&compiler->stats, &compiler->arena);
+        worker->stats = compiler->stats;
+        compiler_destroy(compiler);
+    }
+    return NULL;
+}
+
+static int load_input(BatchInput* input) {
+    FILE* file = fopen(input->filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open file: %s\n", input->filename);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode)) {
+        input->size = (size_t)st.st_size;
+        if (input->size == 0) {
+            fclose(file);
+            return 1;
+        }
+        void* data = mmap(NULL, input->size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (data != MAP_FAILED) {
+            input->data = (char*)data;
+            input->mapped = 1;
+            fclose(file);
+            return 1;
+        }
+    }
+
+    // Not mappable (e.g. a named pipe): read it into memory
+    size_t capacity = 1 << 20;
+    input->size = 0;
+    input->data = (char*)malloc(capacity);
+    while (input->data) {
+        input->size += fread(input->data + input->size, 1, capacity - input->size, file);
+        if (input->size < capacity) break;
+        capacity *= 2;
+        char* grown = (char*)realloc(input->data, capacity);
+        if (!grown) {
+            free(input->data);
+            input->data = NULL;
+        } else {
+            input->data = grown;
+        }
+    }
+    fclose(file);
+    if (!input->data) {
+        fprintf(stderr, "Error: Out of memory reading %s\n", input->filename);
+        return 0;
+    }
+    return 1;
+}
+
+static void unload_input(BatchInput* input) {
+    if (input->mapped) {
+        munmap(input->data, input->size);
+    } else {
+        free(input->data);
+    }
+    input->data = NULL;
+}
+
+// Split an input at line boundaries, counting lines and statements so
+// every chunk knows its first line number and expression number
+static int split_input(BatchInput* inputs, int index, size_t target,
+                       BatchChunk** chunks, int* chunk_count, int* chunk_capacity) {
+    const BatchInput* input = &inputs[index];
+    size_t offset = 0;
+    int line = 1;
+    long expressions = 0;
+
+    while (offset < input->size) {
+        size_t end = offset + target;
+        if (end >= input->size) {
+            end = input->size;
+        } else {
+            const char* newline = memchr(input->data + end, '\n', input->size - end);
+            end = newline ? (size_t)(newline - input->data) + 1 : input->size;
+        }
+
+        if (*chunk_count == *chunk_capacity) {
+            int capacity = *chunk_capacity ? *chunk_capacity * 2 : 64;
+            BatchChunk* grown = (BatchChunk*)realloc(*chunks, capacity * sizeof(BatchChunk));
+            if (!grown) return 0;
+            *chunks = grown;
+            *chunk_capacity = capacity;
+        }
+
+        BatchChunk* chunk = &(*chunks)[(*chunk_count)++];
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->input = index;
+        chunk->offset = offset;
+        chunk->length = end - offset;
+        chunk->first_line = line;
+        chunk->first_expression = expressions;
+
+        // A statement is any line with something other than whitespace
+        int has_content = 0;
+        for (size_t i = offset; i < end; i++) {
+            char c = input->data[i];
+            if (c == '\n') {
+                expressions += has_content;
+                has_content = 0;
+                line++;
+            } else if (c != ' ' && c != '\t' && c != '\r' && c != '\v' && c != '\f') {
+                has_content = 1;
+            }
+        }
+        expressions += has_content;
+
+        offset = end;
+    }
+    return 1;
+}
+
+// Append a finished chunk to the outputs of its input, in input order
+static void merge_chunk(ParallelBatch* batch, BatchChunk* chunk) {
+    BatchInput* input = &batch->inputs[chunk->input];
+    FILE* targets[OUT_COUNT] = {
+        input->out.ast, input->out.stack, input->out.addr, input->out.eval, stderr
+    };
+
+    for (int k = 0; k < OUT_COUNT; k++) {
+        if (chunk->buffers[k]) {
+            if (targets[k]) fwrite(chunk->buffers[k], 1, chunk->sizes[k], targets[k]);
+            free(chunk->buffers[k]);
+            chunk->buffers[k] = NULL;
+        }
+    }
+
+    // A missing chunk would renumber the entries after it, so drop the whole file
+    if (input->out.binary && !(chunk->binary && binary_writer_append(input->out.binary, chunk->binary))) {
+        fprintf(stderr, "Error: Out of memory for the binary output\n");
+        destroy_binary_writer(input->out.binary);
+        input->out.binary = NULL;
+    }
+    destroy_binary_writer(chunk->binary);
+    chunk->binary = NULL;
+}
+
+int process_batch_parallel(const char* const* filenames, int file_count, int jobs,
+                           const BatchOptions* options) {
+    if (jobs < 1) jobs = 1;
+
+    ParallelBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.jobs = jobs;
+    batch.options = options;
+    batch.inputs = (BatchInput*)calloc(file_count, sizeof(BatchInput));
+    if (!batch.inputs) return 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Load every input and cut it into chunks of whole lines
+    int ok = 1;
+    size_t total_size = 0;
+    for (int i = 0; i < file_count && ok; i++) {
+        batch.inputs[i].filename = filenames[i];
+        batch_file_names(filenames[i], &batch.inputs[i].names);
+        ok = load_input(&batch.inputs[i]);
+        total_size += batch.inputs[i].size;
+    }
+
+    size_t target = total_size / ((size_t)jobs * CHUNKS_PER_JOB);
+    if (target < CHUNK_MIN_BYTES) target = CHUNK_MIN_BYTES;
+    if (target > CHUNK_MAX_BYTES) target = CHUNK_MAX_BYTES;
+
+    int chunk_capacity = 0;
+    for (int i = 0; i < file_count && ok; i++) {
+        ok = split_input(batch.inputs, i, target, &batch.chunks, &batch.chunk_count, &chunk_capacity);
+    }
+
+    // Deal the chunks round-robin so workers advance through the input together
+    if (ok) {
+        batch.queues = (WorkQueue*)calloc(jobs, sizeof(WorkQueue));
+        ok = batch.queues != NULL;
+    }
+    for (int w = 0; w < jobs && ok; w++) {
+        WorkQueue* queue = &batch.queues[w];
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->tasks = (int*)malloc((batch.chunk_count / jobs + 1) * sizeof(int));
+        if (!queue->tasks) {
+            ok = 0;
+            break;
+        }
+        for (int c = w; c < batch.chunk_count; c += jobs) {
+            queue->tasks[queue->tail++] = c;
+        }
+    }
+
+    BatchWorker* workers = NULL;
+    pthread_t* threads = NULL;
+    int started = 0;
+    if (ok) {
+        workers = (BatchWorker*)calloc(jobs, sizeof(BatchWorker));
+        threads = (pthread_t*)calloc(jobs, sizeof(pthread_t));
+        ok = workers && threads;
+    }
+    if (ok) {
+        pthread_mutex_init(&batch.done_lock, NULL);
+        pthread_cond_init(&batch.done_cond, NULL);
+        for (; started < jobs; started++) {
+            workers[started].batch = &batch;
+            workers[started].id = started;
+            if (pthread_create(&threads[started], NULL, batch_worker_main, &workers[started]) != 0) {
+                fprintf(stderr, "Error: Could not start worker thread %d\n", started);
+                break;
+            }
+        }
+        if (started == 0) ok = 0;
+    }
+
+    // Merge chunk outputs in input order while the workers keep going
+    BatchTotals totals = {0, 0, 0, 0};
+    int open_input = -1;
+    for (int c = 0; c < batch.chunk_count && ok; c++) {
+        BatchChunk* chunk = &batch.chunks[c];
+
+        pthread_mutex_lock(&batch.done_lock);
+        while (!chunk->done) {
+            pthread_cond_wait(&batch.done_cond, &batch.done_lock);
+        }
+        pthread_mutex_unlock(&batch.done_lock);
+
+        if (chunk->input != open_input) {
+            if (open_input >= 0) {
+                close_batch_outputs(&batch.inputs[open_input].names, &batch.inputs[open_input].out,
+                                    options->stats);
+            }
+            open_input = chunk->input;
+            open_batch_outputs(options, &batch.inputs[open_input].names, &batch.inputs[open_input].out);
+        }
+
+        merge_chunk(&batch, chunk);
+        totals.count += chunk->totals.count;
+        totals.failed += chunk->totals.failed;
+        totals.nodes_before += chunk->totals.nodes_before;
+        totals.nodes_after += chunk->totals.nodes_after;
+    }
+    if (open_input >= 0) {
+        close_batch_outputs(&batch.inputs[open_input].names, &batch.inputs[open_input].out,
+                            options->stats);
+    }
+
+    size_t nodes_shared = 0;
+    for (int w = 0; w < started; w++) {
+        pthread_join(threads[w], NULL);
+        nodes_shared += workers[w].nodes_shared;
+        if (options->stats) stats_merge(options->stats, &workers[w].stats);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (ok) {
+        print_batch_summary(&totals, elapsed_seconds(&start, &end), started, options, nodes_shared);
+    }
+
+    // Clean up
+    if (started > 0) {
+        pthread_mutex_destroy(&batch.done_lock);
+        pthread_cond_destroy(&batch.done_cond);
+    }
+    if (batch.queues) {
+        for (int w = 0; w < jobs; w++) {
+            if (batch.queues[w].tasks) {
+                free(batch.queues[w].tasks);
+                pthread_mutex_destroy(&batch.queues[w].lock);
+            }
+        }
+        free(batch.queues);
+    }
+    for (int c = 0; c < batch.chunk_count; c++) {
+        for (int k = 0; k < OUT_COUNT; k++) free(batch.chunks[c].buffers[k]);
+        destroy_binary_writer(batch.chunks[c].binary);
+    }
+    for (int i = 0; i < file_count; i++) {
+        if (batch.inputs[i].data) unload_input(&batch.inputs[i]);
+    }
+    free(batch.chunks);
+    free(batch.inputs);
+    free(workers);
+    free(threads);
+    return ok;
+}
+
+#endif // _WIN32
+
+int process_binary(const char* filename, const BatchOptions* options) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    BinaryFile file;
+    if (!binary_file_open(&file, filename)) return 0;
+
+    // Outputs are named after the .pqb file, as if it were the source
+    BatchOptions text_options = *options;
+    text_options.write_binary = 0;
+    BatchFileNames names;
+    BatchStreams out;
+    batch_file_names(filename, &names);
+    open_batch_outputs(&text_options, &names, &out);
+
+    SymbolTable symbols;   // View of the current entry's variable names
+    SymbolValues values;
+    symbol_table_init(&symbols);
+    symbol_values_init(&values);
+    VM vm;
+    FILE* eval_out = out.eval;
+    if (eval_out && !vm_init(&vm, 256)) {
+        fprintf(stderr, "Error: Out of memory for the VM stack\n");
+        eval_out = NULL;
+    }
+
+    int ok = 1;
+    for (uint32_t i = 0; i < file.entry_count; i++) {
+        uint32_t node_count;
+        binary_file_nodes(&file, i, &node_count);
+        if (node_count == 0) continue; // Nothing was parsed
+
+        long count = (long)i + 1;
+        if (!binary_file_entry_valid(&file, i)) {
+            fprintf(stderr, "Error: %s is corrupt (expression %ld)\n", filename, count);
+            ok = 0;
+            continue;
+        }
+        if (out.ast) {
+            fprintf(out.ast, "\n# Expression %ld\n", count);
+            binary_file_write_ast(&file, i, out.ast);
+        }
+        if (!out.stack && !out.addr && !eval_out) continue;
+        if (!binary_file_symbols(&file, i, &symbols)) {
+            fprintf(stderr, "Error: Out of memory for the names of expression %ld\n", count);
+            ok = 0;
+            continue;
+        }
+
+        // Code is used in place: no parsing, code generation or copying
+        Bytecode bc;
+        binary_file_bytecode(&file, i, &bc);
+        if (out.stack) {
+            fprintf(out.stack, "\n# Expression %ld\n", count);
+            bytecode_disassemble(&bc, &symbols, out.stack);
+        }
+        if (out.addr) {
+            IRProgram ir;
+            binary_file_three_addr(&file, i, &ir);
+            fprintf(out.addr, "\n# Expression %ld\n", count);
+            ir_write_three_addr(&ir, &symbols, out.addr);
+        }
+        if (eval_out) {
+            double result;
+            values.count = 0; // The entry's IDs restart from 0
+            if (symbol_values_resolve(&values, &symbols, options->bindings) &&
+                vm_execute(&vm, &bc, values.values, &result)) {
+                fprintf(eval_out, "%g\n", result);
+            } else {
+                fprintf(eval_out, "ERROR\n");
+            }
+        }
+    }
+
+    if (eval_out) {
+        vm_free(&vm);
+    }
+    symbol_table_free(&symbols);
+    symbol_values_free(&values);
+    close_batch_outputs(&names, &out, options->stats);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("\nLoaded %u expression%s from %s in %.3f s\n", file.entry_count,
+           file.entry_count == 1 ? "" : "s", filename, elapsed_seconds(&start, &end));
+    binary_file_close(&file);
+    return ok;
+}
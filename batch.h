@@ -0,0 +1,49 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cache.h"
+#include "compiler.h"
+
+// What to produce for every expression of a batch
+typedef struct {
+    int show_ast;                   // Write <base>_ast.txt
+    int gen_stack;                  // Write <base>_stack.txt
+    int gen_3addr;                  // Write <base>_3addr.txt
+    int use_flat;                   // Generate code from the flat AST
+    int evaluate;                   // Write <base>_eval.txt using the bytecode VM
+    int optimize;                   // Run optimize_ast before code generation
+    int hash_consing;               // Share identical subexpressions
+    int registers;                  // Register-allocate 3addr code onto this many registers (0 = off)
+    int write_binary;               // Write <base>.pqb (see serialize.h)
+    const SymbolBindings* bindings; // Variable values used by evaluate (NULL = all 0)
+    CompileCache* cache;            // Reuse stack/3addr code of earlier runs (NULL = off)
+    CompileStats* stats;            // Add phase times and counters here (NULL = off)
+} BatchOptions;
+
+/* Compile every newline-separated expression of a file (or stdin if
+ * filename is NULL) with a single lexer/parser state and one set of
+ * output streams, then print a throughput summary.
+ * Statistics are kept in compiler->stats if it is enabled.
+ */
+void process_batch(Compiler* compiler, const char* filename, const BatchOptions* options);
+
+/* Compile many files on `jobs` worker threads.
+ * Every file is split into chunks at line boundaries; the chunks are
+ * spread over per-worker queues, and idle workers steal from the others.
+ * Outputs are merged back in input order, so every <base>_*.txt file is
+ * identical to what process_batch writes. The statistics of all workers
+ * are added to options->stats.
+ * @return 1 on success, 0 if an input could not be read or threads could not start
+ */
+int process_batch_parallel(const char* const* filenames, int file_count, int jobs,
+                           const BatchOptions* options);
+
+/* Regenerate the requested outputs from a binary file written by a batch
+ * with write_binary set. Entries are read in place from the mapped file;
+ * outputs are named after it (<base>_stack.txt and so on). Damaged
+ * entries are reported and skipped.
+ * @return 1 on success, 0 if the file could not be read or an entry is damaged
+ */
+int process_binary(const char* filename, const BatchOptions* options);
+
+#endif // BATCH_H
@@ -0,0 +1,171 @@
+/* Evaluation throughput benchmark: one expression over many rows.
+ *
+ * Build from the repository root:
+ *   gcc -O2 -I. -o bench_eval bench/bench_eval.c ast.c codegen.c compiler.c error.c \
+ *       flat_ast.c ir.c jit.c lexer.c optimizer.c parser.c stats.c symbols.c trace.c vm.c -lm
+ * Run:
+ *   ./bench_eval "a * b + c / 2" 10000000
+ *   ./bench_eval -O "a ^ 3 / 4" 10000000     (optimize the tree first)
+ */
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "compiler.h"
+#include "optimizer.h"
+#include "vm.h"
+#include "jit.h"
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Mark every variable the program loads (used has bc->var_count entries)
+static void find_loads(const Bytecode* bc, char* used) {
+    uint32_t pc = 0;
+    while (pc < bc->length) {
+        switch ((BytecodeOp)bc->code[pc++]) {
+            case BC_PUSH: pc += sizeof(uint32_t); break;
+            case BC_STORE: case BC_LOCAL: pc += 2 * sizeof(uint32_t); break;
+            case BC_LOAD: {
+                uint32_t symbol;
+                memcpy(&symbol, bc->code + pc, sizeof(uint32_t));
+                pc += sizeof(uint32_t);
+                used[symbol] = 1;
+                break;
+            }
+            default: break;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int optimize = argc > 1 && strcmp(argv[1], "-O") == 0;
+    if (optimize) {
+        argc--;
+        argv++;
+    }
+    const char* expr = argc > 1 ? argv[1] : "a * b + c / 2 - (a - c) * 3";
+    size_t rows = argc > 2 ? (size_t)atol(argv[2]) : 10000000;
+    
+    Compiler* compiler = compiler_create();
+    if (!compiler) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    set_token_string(compiler, expr);
+    parser_reset(compiler);
+    ASTNode* root = parse_program(compiler);
+    if (root && optimize) {
+        root = optimize_ast(&compiler->arena, root, NULL);
+    }
+    
+    Bytecode bc;
+    VM vm;
+    bytecode_init(&bc);
+    if (!root || ast_has_errors(root) || !bytecode_compile(&bc, root) || !vm_init(&vm, bc.max_stack)) {
+        fprintf(stderr, "Could not compile: %s\n", expr);
+        return 1;
+    }
+    release_token_stream(compiler);
+    
+    // Random input columns for the referenced variables only
+    uint32_t var_count = bc.var_count;
+    char* used = (char*)calloc(var_count + 1, 1);
+    const double** columns = (const double**)calloc(var_count + 1, sizeof(double*));
+    double* vars = (double*)calloc(var_count + 1, sizeof(double));
+    if (!used || !columns || !vars) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    find_loads(&bc, used);
+    srand(42);
+    for (uint32_t v = 0; v < var_count; v++) {
+        if (!used[v]) continue;
+        double* column = (double*)malloc(rows * sizeof(double));
+        if (!column) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        for (size_t r = 0; r < rows; r++) column[r] = (double)rand() / RAND_MAX + 0.5;
+        columns[v] = column;
+    }
+    double* output = (double*)malloc(rows * sizeof(double));
+    double* reference = (double*)malloc(rows * sizeof(double));
+    if (!output || !reference) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    
+    // Row at a time through the scalar interpreter
+    double start = now_seconds();
+    for (size_t r = 0; r < rows; r++) {
+        for (uint32_t v = 0; v < var_count; v++) {
+            if (columns[v]) vars[v] = columns[v][r];
+        }
+        vm_execute(&vm, &bc, vars, &reference[r]);
+    }
+    double scalar_time = now_seconds() - start;
+    
+    // Block at a time through the column interpreter
+    start = now_seconds();
+    int ok = vm_execute_columns(&vm, &bc, columns, output, rows);
+    double block_time = now_seconds() - start;
+    
+    size_t mismatches = 0;
+    for (size_t r = 0; r < rows; r++) {
+        if (output[r] != reference[r]) mismatches++;
+    }
+    
+    // Native code: one call per row, then two rows per SSE2 instruction
+    JitCode jit;
+    double jit_time = 0;
+    double jit_packed_time = 0;
+    int have_jit = jit_compile(&jit, &bc);
+    if (have_jit) {
+        start = now_seconds();
+        for (size_t r = 0; r < rows; r++) {
+            for (uint32_t v = 0; v < var_count; v++) {
+                if (columns[v]) vars[v] = columns[v][r];
+            }
+            output[r] = jit.scalar(vars);
+        }
+        jit_time = now_seconds() - start;
+        for (size_t r = 0; r < rows; r++) {
+            if (output[r] != reference[r]) mismatches++;
+        }
+        
+        start = now_seconds();
+        ok = ok && jit_execute_columns(&jit, columns, output, rows);
+        jit_packed_time = now_seconds() - start;
+        for (size_t r = 0; r < rows; r++) {
+            if (output[r] != reference[r]) mismatches++;
+        }
+        jit_free(&jit);
+    }
+    
+    printf("expression: %s%s\n", expr, optimize ? " (optimized)" : "");
+    printf("rows: %zu\n", rows);
+    printf("scalar_rows_per_sec: %.0f\n", rows / scalar_time);
+    printf("block_rows_per_sec: %.0f\n", rows / block_time);
+    printf("speedup: %.2f\n", scalar_time / block_time);
+    if (have_jit) {
+        printf("jit_rows_per_sec: %.0f\n", rows / jit_time);
+        printf("jit_packed_rows_per_sec: %.0f\n", rows / jit_packed_time);
+    }
+    printf("mismatches: %zu\n", ok ? mismatches : rows);
+    
+    for (uint32_t v = 0; v < var_count; v++) free((void*)columns[v]);
+    free(columns);
+    free(used);
+    free(vars);
+    free(output);
+    free(reference);
+    vm_free(&vm);
+    bytecode_free(&bc);
+    compiler_destroy(compiler);
+    return mismatches != 0 || !ok;
+}
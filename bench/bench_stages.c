@@ -0,0 +1,440 @@
+/* Compiler stage benchmark over synthetic expressions.
+ *
+ * Generates expressions of several shapes and times every stage on its
+ * own: scanning (yylex), parsing (parse_program), the optimizer
+ * (optimize_ast), and stack and three-address code generation
+ * (generate_stack_code_stream / generate_three_addr_code_stream, writing
+ * to the null device). Results are "key: value" lines, or one JSON
+ * document with --json, so runs can be compared by a script.
+ *
+ * Shapes:
+ *   random  random operators and tree shape, parentheses where needed
+ *   wide    balanced trees (depth log2 of the leaf count)
+ *   deep    right-nested chains: a - (b - (c - ...))
+ *   chain   left-leaning chains without parentheses: a + b + c + ...
+ *   nest    one leaf inside deeply nested parentheses: ((((a + 1))))
+ *
+ * Build from the repository root:
+ *   gcc -O2 -I. -o bench_stages bench/bench_stages.c ast.c codegen.c compiler.c error.c \
+ *       flat_ast.c ir.c lexer.c optimizer.c parser.c stats.c symbols.c trace.c -lm
+ * Run:
+ *   ./bench_stages [--shape S]... [--size LEAVES] [--count N] [--repeat R]
+ *                  [--seed S] [--json] [--emit FILE]
+ * --emit writes the generated expressions, one per line, instead of
+ * timing them (input for --batch, --jobs or --serve).
+ *
+ * Every shape runs in a child process of its own, so its peak RSS is its
+ * own and not the largest of the shapes run before it.
+ */
+#define _POSIX_C_SOURCE 200809L // clock_gettime, fork
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "compiler.h"
+#include "optimizer.h"
+
+enum { SHAPE_RANDOM, SHAPE_WIDE, SHAPE_DEEP, SHAPE_CHAIN, SHAPE_NEST, SHAPE_COUNT };
+static const char* shape_names[SHAPE_COUNT] = {"random", "wide", "deep", "chain", "nest"};
+
+enum { STAGE_LEX, STAGE_PARSE, STAGE_OPTIMIZE, STAGE_STACK, STAGE_3ADDR, STAGE_COUNT };
+static const char* stage_names[STAGE_COUNT] = {"lex", "parse", "optimize", "stack", "3addr"};
+
+// Growable text buffer holding the generated corpus
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} Text;
+
+static void text_append(Text* text, const char* s, size_t n) {
+    if (text->length + n + 1 > text->capacity) {
+        size_t capacity = text->capacity ? text->capacity : 64 * 1024;
+        while (capacity < text->length + n + 1) capacity *= 2;
+        text->data = (char*)realloc(text->data, capacity);
+        if (!text->data) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        text->capacity = capacity;
+    }
+    memcpy(text->data + text->length, s, n);
+    text->length += n;
+    text->data[text->length] = '\0';
+}
+
+static void text_puts(Text* text, const char* s) {
+    text_append(text, s, strlen(s));
+}
+
+static unsigned long long rng_state;
+
+static unsigned random_below(unsigned n) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned)((rng_state * 2685821657736338717ull) >> 33) % n;
+}
+
+static void emit_leaf(Text* text) {
+    char leaf[32];
+    switch (random_below(3)) {
+        case 0: snprintf(leaf, sizeof(leaf), "%c", 'a' + random_below(26)); break;
+        case 1: snprintf(leaf, sizeof(leaf), "%u", 1 + random_below(99)); break;
+        default: snprintf(leaf, sizeof(leaf), "%u.%u", random_below(10), random_below(100)); break;
+    }
+    text_puts(text, leaf);
+}
+
+static int precedence(char op) {
+    return (op == '*' || op == '/') ? 2 : 1;
+}
+
+// A tree of `leaves` leaves below an operator `parent` (0 at the top);
+// parentheses only where precedence or associativity needs them
+static void emit_tree(Text* text, unsigned leaves, int balanced, char parent, int right_operand) {
+    if (leaves <= 1) {
+        emit_leaf(text);
+        return;
+    }
+    static const char ops[] = "+-*/";
+    char op = ops[random_below(4)];
+    unsigned left = balanced ? leaves / 2 : 1 + random_below(leaves - 1);
+
+    int parens = parent && (precedence(op) < precedence(parent) ||
+                            (right_operand && precedence(op) == precedence(parent) &&
+                             (parent == '-' || parent == '/')));
+    if (parens) text_puts(text, "(");
+    emit_tree(text, left, balanced, op, 0);
+    char middle[4] = {' ', op, ' ', '\0'};
+    text_puts(text, middle);
+    emit_tree(text, leaves - left, balanced, op, 1);
+    if (parens) text_puts(text, ")");
+}
+
+static void emit_expression(Text* text, int shape, unsigned leaves) {
+    switch (shape) {
+        case SHAPE_RANDOM:
+            emit_tree(text, leaves, 0, 0, 0);
+            break;
+        case SHAPE_WIDE:
+            emit_tree(text, leaves, 1, 0, 0);
+            break;
+        case SHAPE_DEEP:
+            for (unsigned i = 1; i < leaves; i++) {
+                emit_leaf(text);
+                text_puts(text, i + 1 < leaves ? " - (" : " - ");
+            }
+            emit_leaf(text);
+            for (unsigned i = 2; i < leaves; i++) text_puts(text, ")");
+            break;
+        case SHAPE_CHAIN:
+            emit_leaf(text);
+            for (unsigned i = 1; i < leaves; i++) {
+                text_puts(text, random_below(2) ? " + " : " * ");
+                emit_leaf(text);
+            }
+            break;
+        case SHAPE_NEST:
+            for (unsigned i = 0; i < leaves; i++) text_puts(text, "(");
+            emit_leaf(text);
+            text_puts(text, " + 1");
+            for (unsigned i = 0; i < leaves; i++) text_puts(text, ")");
+            break;
+    }
+    text_puts(text, "\n");
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Peak RSS of this process (RUSAGE_SELF) or its largest child (RUSAGE_CHILDREN)
+static long peak_rss_kb(int who) {
+    struct rusage usage;
+    if (getrusage(who, &usage) != 0) return -1;
+    return usage.ru_maxrss; // Kilobytes on Linux
+}
+
+typedef struct {
+    size_t expressions;
+    size_t bytes;
+    size_t tokens;
+    size_t nodes;
+    double seconds[STAGE_COUNT];      // Best of the repetitions
+    long peak_rss_kb;                 // Of the child process that ran the shape
+} ShapeResult;
+
+// Parse the whole corpus into the compiler's arena
+static size_t parse_corpus(Compiler* compiler, const Text* corpus, ASTNode** roots) {
+    ast_arena_reset(&compiler->arena);
+    set_token_string(compiler, corpus->data);
+    set_newline_separated(compiler, 1);
+    parser_reset(compiler);
+    size_t count = 0;
+    while (parser_begin_statement(compiler)) {
+        roots[count++] = parse_program(compiler);
+        parser_end_statement(compiler);
+    }
+    set_newline_separated(compiler, 0);
+    return count;
+}
+
+static void run_shape(Compiler* compiler, const Text* corpus, size_t expressions, int repeat,
+                      FILE* sink, ShapeResult* result) {
+    ASTNode** roots = (ASTNode**)calloc(expressions + 1, sizeof(ASTNode*));
+    ASTNode** optimized = (ASTNode**)calloc(expressions + 1, sizeof(ASTNode*));
+    if (!roots || !optimized) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    memset(result, 0, sizeof(*result));
+    result->expressions = expressions;
+    result->bytes = corpus->length;
+    for (int s = 0; s < STAGE_COUNT; s++) result->seconds[s] = 1e30;
+
+    for (int r = 0; r < repeat; r++) {
+        // Scanning only
+        double start = now_seconds();
+        set_token_string(compiler, corpus->data);
+        set_newline_separated(compiler, 1);
+        size_t tokens = 0;
+        int token;
+        while ((token = yylex(compiler)) != TOKEN_EOF) {
+            if (token != TOKEN_NEWLINE) tokens++;
+        }
+        set_newline_separated(compiler, 0);
+        double seconds = now_seconds() - start;
+        if (seconds < result->seconds[STAGE_LEX]) result->seconds[STAGE_LEX] = seconds;
+        result->tokens = tokens;
+
+        // Scanning and parsing
+        start = now_seconds();
+        size_t parsed = parse_corpus(compiler, corpus, roots);
+        seconds = now_seconds() - start;
+        if (seconds < result->seconds[STAGE_PARSE]) result->seconds[STAGE_PARSE] = seconds;
+
+        // The remaining stages run on the parsed trees
+        start = now_seconds();
+        for (size_t i = 0; i < parsed; i++) {
+            OptimizeStats stats;
+            optimized[i] = optimize_ast(&compiler->arena, roots[i], &stats);
+        }
+        seconds = now_seconds() - start;
+        if (seconds < result->seconds[STAGE_OPTIMIZE]) result->seconds[STAGE_OPTIMIZE] = seconds;
+
+        start = now_seconds();
+        for (size_t i = 0; i < parsed; i++) {
+            if (roots[i]) generate_stack_code_stream(compiler, roots[i], sink);
+        }
+        fflush(sink);
+        seconds = now_seconds() - start;
+        if (seconds < result->seconds[STAGE_STACK]) result->seconds[STAGE_STACK] = seconds;
+
+        start = now_seconds();
+        for (size_t i = 0; i < parsed; i++) {
+            if (roots[i]) generate_three_addr_code_stream(compiler, roots[i], sink);
+        }
+        fflush(sink);
+        seconds = now_seconds() - start;
+        if (seconds < result->seconds[STAGE_3ADDR]) result->seconds[STAGE_3ADDR] = seconds;
+
+        result->nodes = 0;
+        for (size_t i = 0; i < parsed; i++) result->nodes += ast_count_nodes(roots[i]);
+    }
+
+    ast_arena_reset(&compiler->arena);
+    free(roots);
+    free(optimized);
+}
+
+// Run a shape in a forked child and read its result back through a pipe
+// @return 1 on success, 0 if the child could not be run or failed
+static int run_shape_isolated(Compiler* compiler, const Text* corpus, size_t expressions, int repeat,
+                              FILE* sink, ShapeResult* result) {
+    int fds[2];
+    if (pipe(fds) != 0) return 0;
+    fflush(stdout); // The child must not write the parent's buffered output again
+    fflush(sink);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        run_shape(compiler, corpus, expressions, repeat, sink, result);
+        result->peak_rss_kb = peak_rss_kb(RUSAGE_SELF);
+        ssize_t written = write(fds[1], result, sizeof(*result));
+        _exit(written == (ssize_t)sizeof(*result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    size_t received = 0;
+    while (received < sizeof(*result)) {
+        ssize_t n = read(fds[0], (char*)result + received, sizeof(*result) - received);
+        if (n <= 0) break;
+        received += (size_t)n;
+    }
+    close(fds[0]);
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return 0;
+    return received == sizeof(*result);
+}
+
+int main(int argc, char** argv) {
+    int shapes[SHAPE_COUNT] = {0};
+    int any_shape = 0;
+    unsigned size = 64;
+    size_t count = 10000;
+    int repeat = 3;
+    unsigned long long seed = 42;
+    int json = 0;
+    const char* emit = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--shape") == 0 && value) {
+            int found = 0;
+            for (int s = 0; s < SHAPE_COUNT; s++) {
+                if (strcmp(value, shape_names[s]) == 0 || strcmp(value, "all") == 0) {
+                    shapes[s] = found = 1;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "Unknown shape: %s\n", value);
+                return 1;
+            }
+            any_shape = 1;
+            i++;
+        } else if (strcmp(argv[i], "--size") == 0 && value) {
+            size = (unsigned)atol(value);
+            i++;
+        } else if (strcmp(argv[i], "--count") == 0 && value) {
+            count = (size_t)atol(value);
+            i++;
+        } else if (strcmp(argv[i], "--repeat") == 0 && value) {
+            repeat = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--seed") == 0 && value) {
+            seed = strtoull(value, NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "--emit") == 0 && value) {
+            emit = value;
+            i++;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--shape random|wide|deep|chain|nest|all]... [--size LEAVES]\n"
+                            "       [--count N] [--repeat R] [--seed S] [--json] [--emit FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!any_shape) {
+        for (int s = 0; s < SHAPE_COUNT; s++) shapes[s] = 1;
+    }
+    if (size < 1) size = 1;
+    if (count < 1) count = 1;
+    if (repeat < 1) repeat = 1;
+
+    Compiler* compiler = compiler_create();
+    FILE* sink = fopen("/dev/null", "w");
+    if (!compiler || !sink) {
+        fprintf(stderr, "Could not set up the benchmark\n");
+        return 1;
+    }
+
+    FILE* emit_file = NULL;
+    if (emit) {
+        emit_file = fopen(emit, "w");
+        if (!emit_file) {
+            fprintf(stderr, "Could not open %s for writing\n", emit);
+            return 1;
+        }
+    }
+
+    if (emit) {
+        // Only the corpus is written
+    } else if (json) {
+        printf("{\n  \"size\": %u,\n  \"count\": %zu,\n  \"repeat\": %d,\n  \"seed\": %llu,\n  \"shapes\": {",
+               size, count, repeat, seed);
+    } else {
+        printf("size: %u\ncount: %zu\nrepeat: %d\nseed: %llu\n", size, count, repeat, seed);
+    }
+
+    int first = 1;
+    for (int s = 0; s < SHAPE_COUNT; s++) {
+        if (!shapes[s]) continue;
+
+        // Every shape gets the same stream of random numbers
+        rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+        Text corpus = {NULL, 0, 0};
+        for (size_t i = 0; i < count; i++) emit_expression(&corpus, s, size);
+
+        if (emit_file) {
+            fwrite(corpus.data, 1, corpus.length, emit_file);
+            free(corpus.data);
+            continue;
+        }
+
+        ShapeResult result;
+        int ran = run_shape_isolated(compiler, &corpus, count, repeat, sink, &result);
+        free(corpus.data);
+        if (!ran) {
+            fprintf(stderr, "Could not run the %s shape\n", shape_names[s]);
+            return 1;
+        }
+
+        const char* name = shape_names[s];
+        if (json) {
+            printf("%s\n    \"%s\": {\"expressions\": %zu, \"bytes\": %zu, \"tokens\": %zu, \"nodes\": %zu, "
+                   "\"peak_rss_kb\": %ld, \"stages\": {",
+                   first ? "" : ",", name, result.expressions, result.bytes, result.tokens,
+                   result.nodes, result.peak_rss_kb);
+            for (int t = 0; t < STAGE_COUNT; t++) {
+                double seconds = result.seconds[t];
+                printf("%s\n      \"%s\": {\"seconds\": %.6f, \"tokens_per_sec\": %.0f, \"nodes_per_sec\": %.0f}",
+                       t ? "," : "", stage_names[t], seconds, result.tokens / seconds, result.nodes / seconds);
+            }
+            printf("\n    }}");
+        } else {
+            printf("%s.expressions: %zu\n", name, result.expressions);
+            printf("%s.bytes: %zu\n", name, result.bytes);
+            printf("%s.tokens: %zu\n", name, result.tokens);
+            printf("%s.nodes: %zu\n", name, result.nodes);
+            for (int t = 0; t < STAGE_COUNT; t++) {
+                double seconds = result.seconds[t];
+                printf("%s.%s.seconds: %.6f\n", name, stage_names[t], seconds);
+                printf("%s.%s.tokens_per_sec: %.0f\n", name, stage_names[t], result.tokens / seconds);
+                printf("%s.%s.nodes_per_sec: %.0f\n", name, stage_names[t], result.nodes / seconds);
+            }
+            printf("%s.peak_rss_kb: %ld\n", name, result.peak_rss_kb);
+        }
+        first = 0;
+    }
+
+    // The largest of the benchmark itself and the shapes
+    long peak = peak_rss_kb(RUSAGE_SELF);
+    long children = peak_rss_kb(RUSAGE_CHILDREN);
+    if (children > peak) peak = children;
+    if (emit) {
+        // Nothing was timed
+    } else if (json) {
+        printf("\n  },\n  \"peak_rss_kb\": %ld\n}\n", peak);
+    } else {
+        printf("peak_rss_kb: %ld\n", peak);
+    }
+
+    if (emit_file) fclose(emit_file);
+    fclose(sink);
+    compiler_destroy(compiler);
+    return 0;
+}
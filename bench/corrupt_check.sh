@@ -0,0 +1,98 @@
+#!/bin/sh
+# Regression check for damaged compiled files: a .pqb with a bad node or a
+# missing tail must make --load exit 1; a damaged cache record must be
+# dropped and compiled again; and no damage may crash either.
+#
+# Run from the repository root after building parseiq:
+#   sh bench/corrupt_check.sh [path/to/parseiq]
+
+PARSEIQ=${1:-./parseiq}
+case $PARSEIQ in /*) ;; *) PARSEIQ=$(pwd)/$PARSEIQ ;; esac
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+failures=0
+
+fail() {
+    echo "FAIL: $*"
+    failures=$((failures + 1))
+}
+
+# Overwrite one byte of a file with 0xff
+poke() {
+    printf '\377' | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+# Exit status of a command, which must not be killed by a signal
+run() {
+    "$@" >/dev/null 2>&1
+    status=$?
+    [ $status -lt 128 ] || fail "$* crashed (status $status)"
+    return $status
+}
+
+cat > exprs.txt <<'EOF'
+a + b * c
+x = 2; y = x ^ 3 + z; y / (x - 1)
+(p - q) * (p - q) / 4
+1 + 2 * 3 - t ^ 2
+EOF
+
+# Binary files (--load)
+"$PARSEIQ" --batch --binary --stack exprs.txt >/dev/null || { echo "FAIL: --binary"; exit 1; }
+size=$(wc -c < exprs.pqb)
+
+cp exprs.pqb bad_kind.pqb
+poke bad_kind.pqb 56  # Kind of the first node (header 32 + offset 24)
+run "$PARSEIQ" --load --ast --stack --3addr --eval bad_kind.pqb
+[ $status -eq 1 ] || fail "--load of an unknown node kind exited $status"
+
+head -c $((size - 8)) exprs.pqb > truncated.pqb
+run "$PARSEIQ" --load --stack truncated.pqb
+[ $status -eq 1 ] || fail "--load of a truncated file exited $status"
+
+offset=0
+while [ $offset -lt "$size" ]; do
+    cp exprs.pqb flipped.pqb
+    poke flipped.pqb $offset
+    run "$PARSEIQ" --load --ast --stack --3addr --eval flipped.pqb
+    offset=$((offset + 7))
+done
+
+# Compilation cache (--cache): records are 8-byte aligned after the header
+"$PARSEIQ" --batch --stack --3addr exprs.txt >/dev/null
+cat exprs_stack.txt exprs_3addr.txt > expected.txt
+"$PARSEIQ" --batch --stack --3addr --cache clean exprs.txt >/dev/null
+size=$(wc -c < clean/cache.pqc)
+
+mkdir bad_flags
+cp clean/cache.pqc bad_flags/
+poke bad_flags/cache.pqc 59  # Top byte of the first record's flags
+run "$PARSEIQ" --batch --stack --3addr --verbose --cache bad_flags exprs.txt
+[ $status -eq 0 ] || fail "a damaged cache record made --cache exit $status"
+cat exprs_stack.txt exprs_3addr.txt | cmp -s - expected.txt ||
+    fail "a damaged cache record changed the output"
+"$PARSEIQ" --batch --stack --3addr --verbose --cache bad_flags exprs.txt 2>&1 |
+    grep -q "Cache: 4 hits, 0 misses" || fail "the dropped cache record was not stored again"
+
+mkdir truncated
+head -c $((size - 8)) clean/cache.pqc > truncated/cache.pqc
+run "$PARSEIQ" --batch --stack --3addr --cache truncated exprs.txt
+[ $status -eq 0 ] || fail "a truncated cache file made --cache exit $status"
+cat exprs_stack.txt exprs_3addr.txt | cmp -s - expected.txt ||
+    fail "a truncated cache file changed the output"
+
+offset=0
+while [ $offset -lt "$size" ]; do
+    rm -rf flipped
+    mkdir flipped
+    cp clean/cache.pqc flipped/
+    poke flipped/cache.pqc $offset
+    run "$PARSEIQ" --batch --stack --3addr --cache flipped exprs.txt
+    offset=$((offset + 7))
+done
+
+if [ $failures -eq 0 ]; then
+    echo "corrupt_check: ok"
+fi
+[ $failures -eq 0 ]
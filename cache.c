@@ -0,0 +1,645 @@
+#include "cache.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define make_directory(path) _mkdir(path)
+#define process_id() _getpid()
+#else
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define make_directory(path) mkdir(path, 0777)
+#define process_id() getpid()
+#endif
+
+// Entry flags beyond the code forms
+#define CACHE_FAILED 0x4u
+#define CACHE_PARSED 0x8u
+
+/* One entry, followed by its sections (each 8-byte aligned):
+ * key bytes, stack constants, three-address constants, stack code,
+ * three-address code. Entries are stored in the file exactly like this.
+ */
+struct CacheRecord {
+    uint64_t hash;
+    uint64_t last_used;             // Cache clock at the last lookup or store
+    uint32_t size;                  // Whole record in bytes, a multiple of 8
+    uint32_t key_length;
+    uint32_t flags;                 // CACHE_STACK, CACHE_THREE_ADDR, CACHE_FAILED, CACHE_PARSED
+    uint32_t nodes_before;
+    uint32_t nodes_after;
+    uint32_t stack_count;
+    uint32_t stack_constant_count;
+    uint32_t addr_count;
+    uint32_t addr_constant_count;
+    uint32_t addr_temp_count;
+    uint32_t addr_registers;
+    uint32_t addr_registers_used;
+    uint32_t addr_spill_slots;
+    uint32_t reserved;
+    IROperand addr_result;
+};
+
+typedef struct {
+    char magic[4];                  // CACHE_MAGIC
+    uint32_t version;               // CACHE_VERSION
+    uint64_t clock;
+    uint64_t record_count;
+    uint64_t reserved;
+} CacheFileHeader;
+
+_Static_assert(sizeof(struct CacheRecord) == 80, "CacheRecord layout");
+_Static_assert(sizeof(CacheFileHeader) == 32, "CacheFileHeader layout");
+
+struct CompileCache {
+    char path[1024];                // <directory>/cache.pqc
+    uint64_t limit;
+    uint64_t clock;                 // Ticks on every hit and store (LRU order)
+
+    uint8_t* file_data;             // Records read from the cache file
+    size_t file_size;
+
+    // Live entries and an open-addressing index over them (index + 1, 0 = empty)
+    CacheRecord** records;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* table;
+    uint32_t table_size;            // Power of two
+    uint64_t bytes;                 // Size of all live records
+
+    long hits;
+    long misses;
+    long stores;
+    long evictions;
+    int dirty;                      // Entries were added or dropped since the file was read
+    uint64_t saved_clock;           // Clock of the cache file
+    uint32_t touched;               // Entries of the file used since it was read
+
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+};
+
+#ifdef _WIN32
+// Batches run on one thread without POSIX threads
+#define cache_lock(cache) ((void)0)
+#define cache_unlock(cache) ((void)0)
+#else
+#define cache_lock(cache) pthread_mutex_lock(&(cache)->lock)
+#define cache_unlock(cache) pthread_mutex_unlock(&(cache)->lock)
+#endif
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+// Byte offsets of the sections of a record
+typedef struct {
+    size_t key;
+    size_t stack_constants;
+    size_t addr_constants;
+    size_t stack_code;
+    size_t addr_code;
+    size_t size;
+} RecordLayout;
+
+static void record_layout(const CacheRecord* record, RecordLayout* layout) {
+    layout->key = sizeof(CacheRecord);
+    layout->stack_constants = layout->key + align8(record->key_length);
+    layout->addr_constants = layout->stack_constants + (size_t)record->stack_constant_count * sizeof(double);
+    layout->stack_code = layout->addr_constants + (size_t)record->addr_constant_count * sizeof(double);
+    layout->addr_code = layout->stack_code + align8((size_t)record->stack_count * sizeof(IRInstr));
+    layout->size = layout->addr_code + align8((size_t)record->addr_count * sizeof(IRInstr));
+}
+
+static const uint8_t* record_bytes(const CacheRecord* record, size_t offset) {
+    return (const uint8_t*)record + offset;
+}
+
+// Release a record that is no longer in the cache; records read from the
+// file live in file_data, which is freed as a whole
+static void release_record(CompileCache* cache, CacheRecord* record) {
+    const uint8_t* bytes = (const uint8_t*)record;
+    if (cache->file_data && bytes >= cache->file_data && bytes < cache->file_data + cache->file_size) {
+        return;
+    }
+    free(record);
+}
+
+void cache_key_init(CacheKey* key) {
+    memset(key, 0, sizeof(*key));
+}
+
+void cache_key_free(CacheKey* key) {
+    free(key->bytes);
+    cache_key_init(key);
+}
+
+void cache_copy_init(CacheCopy* copy) {
+    memset(copy, 0, sizeof(*copy));
+}
+
+void cache_copy_free(CacheCopy* copy) {
+    free(copy->bytes);
+    cache_copy_init(copy);
+}
+
+static int key_append(CacheKey* key, const void* bytes, uint32_t length) {
+    if (key->length + length > key->capacity) {
+        uint32_t capacity = key->capacity ? key->capacity : 256;
+        while (capacity < key->length + length) capacity *= 2;
+        uint8_t* grown = (uint8_t*)realloc(key->bytes, capacity);
+        if (!grown) return 0;
+        key->bytes = grown;
+        key->capacity = capacity;
+    }
+    memcpy(key->bytes + key->length, bytes, length);
+    key->length += length;
+    return 1;
+}
+
+int cache_key_build(CacheKey* key, uint32_t salt, const Token* tokens, uint32_t count,
+                    const SymbolTable* symbols, SymbolTable* locals) {
+    key->length = 0;
+    symbol_table_clear(locals);
+    int ok = key_append(key, &salt, sizeof(salt));
+
+    // Token types and values only: positions and spacing do not change the code
+    for (uint32_t i = 0; i < count && ok; i++) {
+        uint8_t type = (uint8_t)tokens[i].type;
+        ok = key_append(key, &type, 1);
+        switch (tokens[i].type) {
+            case TOKEN_INT:
+                if (ok) ok = key_append(key, &tokens[i].value.ival, sizeof(int));
+                break;
+            case TOKEN_FLOAT:
+                if (ok) ok = key_append(key, &tokens[i].value.fval, sizeof(double));
+                break;
+            case TOKEN_VARIABLE: {
+                // The name, not the compiler-specific ID
+                const char* name = symbols->names[tokens[i].value.symbol];
+                uint32_t length = (uint32_t)strlen(name);
+                if (ok) ok = key_append(key, &length, sizeof(length)) && key_append(key, name, length);
+                if (ok) ok = symbol_intern(locals, name, length) != SYMBOL_NONE;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (!ok) return 0;
+
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t i = 0; i < key->length; i++) {
+        hash = (hash ^ key->bytes[i]) * 1099511628211ull;
+    }
+    key->hash = hash;
+    return 1;
+}
+
+// Slot of the key in the index: the entry's slot, or the empty slot ending the probe
+static uint32_t find_slot(const CompileCache* cache, uint64_t hash, const uint8_t* bytes, uint32_t length) {
+    uint32_t mask = cache->table_size - 1;
+    uint32_t slot = (uint32_t)hash & mask;
+    while (cache->table[slot]) {
+        const CacheRecord* record = cache->records[cache->table[slot] - 1];
+        if (record->hash == hash && record->key_length == length &&
+            memcmp(record_bytes(record, sizeof(CacheRecord)), bytes, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int rebuild_table(CompileCache* cache, uint32_t table_size) {
+    uint32_t* table = (uint32_t*)calloc(table_size, sizeof(uint32_t));
+    if (!table) return 0;
+    free(cache->table);
+    cache->table = table;
+    cache->table_size = table_size;
+    for (uint32_t i = 0; i < cache->count; i++) {
+        const CacheRecord* record = cache->records[i];
+        uint32_t slot = find_slot(cache, record->hash, record_bytes(record, sizeof(CacheRecord)),
+                                  record->key_length);
+        cache->table[slot] = i + 1;
+    }
+    return 1;
+}
+
+// Add a record or replace the one with the same key
+static int insert_record(CompileCache* cache, CacheRecord* record) {
+    if ((cache->count + 1) * 2 > cache->table_size &&
+        !rebuild_table(cache, cache->table_size ? cache->table_size * 2 : 1024)) {
+        return 0;
+    }
+
+    uint32_t slot = find_slot(cache, record->hash, record_bytes(record, sizeof(CacheRecord)),
+                              record->key_length);
+    if (cache->table[slot]) {
+        CacheRecord** existing = &cache->records[cache->table[slot] - 1];
+        cache->bytes -= (*existing)->size;
+        release_record(cache, *existing);
+        *existing = record;
+    } else {
+        if (cache->count == cache->capacity) {
+            uint32_t capacity = cache->capacity ? cache->capacity * 2 : 1024;
+            CacheRecord** records = (CacheRecord**)realloc(cache->records, capacity * sizeof(CacheRecord*));
+            if (!records) return 0;
+            cache->records = records;
+            cache->capacity = capacity;
+        }
+        cache->records[cache->count++] = record;
+        cache->table[slot] = cache->count;
+    }
+    cache->bytes += record->size;
+    return 1;
+}
+
+// Number the variables of a key as cache_key_build does
+// @return 0 if the key is not a well-formed token sequence
+static int key_variables(const uint8_t* bytes, uint32_t length, SymbolTable* locals) {
+    symbol_table_clear(locals);
+    uint32_t pos = sizeof(uint32_t); // Salt
+    if (length < pos) return 0;
+    while (pos < length) {
+        uint8_t type = bytes[pos++];
+        uint32_t size = 0;
+        switch (type) {
+            case TOKEN_INT: size = sizeof(int); break;
+            case TOKEN_FLOAT: size = sizeof(double); break;
+            case TOKEN_VARIABLE: {
+                uint32_t name_length;
+                if (length - pos < sizeof(name_length)) return 0;
+                memcpy(&name_length, bytes + pos, sizeof(name_length));
+                pos += sizeof(name_length);
+                if (length - pos < name_length ||
+                    symbol_intern(locals, (const char*)bytes + pos, name_length) == SYMBOL_NONE) {
+                    return 0;
+                }
+                size = name_length;
+                break;
+            }
+            default:
+                if (type > TOKEN_EOF) return 0;
+                break;
+        }
+        if (length - pos < size) return 0;
+        pos += size;
+    }
+    return 1;
+}
+
+// Check a record read from the file: known flags, and code whose operands
+// are in range of its own constants, temporaries and key variables
+static int record_valid(const CacheRecord* record, SymbolTable* locals) {
+    if (record->flags & ~(CACHE_STACK | CACHE_THREE_ADDR | CACHE_FAILED | CACHE_PARSED)) return 0;
+    if (!key_variables(record_bytes(record, sizeof(CacheRecord)), record->key_length, locals)) return 0;
+
+    IRProgram stack, three_addr;
+    cache_record_stack(record, &stack);
+    cache_record_three_addr(record, &three_addr);
+    return ir_valid(&stack, locals->count) && ir_valid(&three_addr, locals->count);
+}
+
+// Read the cache file; on any problem the cache simply starts empty, or
+// keeps only the records that are intact
+static void load_cache_file(CompileCache* cache) {
+    FILE* input = fopen(cache->path, "rb");
+    if (!input) return;
+
+    long size = -1;
+    if (fseek(input, 0, SEEK_END) == 0) size = ftell(input);
+    rewind(input);
+    if (size < (long)sizeof(CacheFileHeader)) {
+        fclose(input);
+        return;
+    }
+
+    uint8_t* data = (uint8_t*)malloc((size_t)size);
+    if (!data || fread(data, 1, (size_t)size, input) != (size_t)size) {
+        free(data);
+        fclose(input);
+        return;
+    }
+    fclose(input);
+
+    const CacheFileHeader* header = (const CacheFileHeader*)data;
+    if (memcmp(header->magic, CACHE_MAGIC, 4) != 0 || header->version != CACHE_VERSION) {
+        fprintf(stderr, "Warning: ignoring outdated or foreign cache file %s\n", cache->path);
+        free(data);
+        return;
+    }
+
+    cache->file_data = data;
+    cache->file_size = (size_t)size;
+    cache->clock = header->clock;
+    cache->saved_clock = header->clock;
+
+    // A record with bad contents is dropped; one with a bad size ends the file
+    SymbolTable locals;
+    symbol_table_init(&locals);
+    uint64_t dropped = 0;
+    size_t offset = sizeof(CacheFileHeader);
+    for (uint64_t i = 0; i < header->record_count; i++) {
+        CacheRecord* record = (CacheRecord*)(data + offset);
+        RecordLayout layout;
+        if (cache->file_size - offset < sizeof(CacheRecord)) break;
+        record_layout(record, &layout);
+        if (record->size % 8 != 0 || record->size < layout.size || record->size > cache->file_size - offset) break;
+        if (!record_valid(record, &locals)) {
+            dropped++;
+        } else if (!insert_record(cache, record)) {
+            break;
+        }
+        offset += record->size;
+    }
+    symbol_table_free(&locals);
+    if (offset != cache->file_size || dropped > 0) {
+        fprintf(stderr, "Warning: cache file %s is truncated or corrupt; keeping %u entries\n",
+                cache->path, cache->count);
+        cache->dirty = 1;
+    }
+}
+
+CompileCache* cache_open(const char* directory, uint64_t limit) {
+    if (make_directory(directory) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Could not create cache directory %s\n", directory);
+        return NULL;
+    }
+
+    CompileCache* cache = (CompileCache*)calloc(1, sizeof(CompileCache));
+    if (!cache) {
+        fprintf(stderr, "Error: Out of memory for the cache\n");
+        return NULL;
+    }
+    snprintf(cache->path, sizeof(cache->path), "%s/%s", directory, CACHE_FILE_NAME);
+    cache->limit = limit;
+#ifndef _WIN32
+    pthread_mutex_init(&cache->lock, NULL);
+#endif
+
+    load_cache_file(cache);
+    return cache;
+}
+
+// Most recently used first
+static int compare_last_used(const void* a, const void* b) {
+    uint64_t x = (*(const CacheRecord* const*)a)->last_used;
+    uint64_t y = (*(const CacheRecord* const*)b)->last_used;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Keep the most recently used entries that fit in `limit` bytes of file
+static void evict_records(CompileCache* cache, uint64_t limit) {
+    qsort(cache->records, cache->count, sizeof(CacheRecord*), compare_last_used);
+    uint64_t bytes = sizeof(CacheFileHeader);
+    uint32_t kept = 0;
+    while (kept < cache->count && bytes + cache->records[kept]->size <= limit) {
+        bytes += cache->records[kept++]->size;
+    }
+    if (kept == cache->count) return;
+
+    for (uint32_t i = kept; i < cache->count; i++) {
+        release_record(cache, cache->records[i]);
+    }
+    cache->evictions += cache->count - kept;
+    cache->count = kept;
+    cache->bytes = bytes - sizeof(CacheFileHeader);
+    cache->dirty = 1;
+    rebuild_table(cache, cache->table_size ? cache->table_size : 1024);
+}
+
+int cache_save(CompileCache* cache) {
+    // Recency only matters to evictions, which happen near the limit
+    int reordered = cache->touched > 0 && cache->touched >= cache->count / 4 &&
+                    cache->bytes >= cache->limit / 2;
+    if (!cache->dirty && !reordered) return 1;
+
+    evict_records(cache, cache->limit);
+
+    // Write a new file and move it over the old one, so readers never see half of it
+    char temp_path[1100];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", cache->path, (int)process_id());
+    FILE* output = fopen(temp_path, "wb");
+    if (!output) {
+        fprintf(stderr, "Error: Could not open file %s for writing\n", temp_path);
+        return 0;
+    }
+
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.clock = cache->clock;
+    header.record_count = cache->count;
+
+    int ok = fwrite(&header, sizeof(header), 1, output) == 1;
+    for (uint32_t i = 0; i < cache->count && ok; i++) {
+        ok = fwrite(cache->records[i], cache->records[i]->size, 1, output) == 1;
+    }
+    if (fclose(output) != 0) ok = 0;
+#ifdef _WIN32
+    if (ok) remove(cache->path);
+#endif
+    if (ok) ok = rename(temp_path, cache->path) == 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write %s\n", cache->path);
+        remove(temp_path);
+        return 0;
+    }
+    cache->dirty = 0;
+    cache->saved_clock = cache->clock;
+    cache->touched = 0;
+    return 1;
+}
+
+void cache_close(CompileCache* cache) {
+    if (!cache) return;
+    for (uint32_t i = 0; i < cache->count; i++) release_record(cache, cache->records[i]);
+    free(cache->records);
+    free(cache->table);
+    free(cache->file_data);
+#ifndef _WIN32
+    pthread_mutex_destroy(&cache->lock);
+#endif
+    free(cache);
+}
+
+const CacheRecord* cache_lookup(CompileCache* cache, const CacheKey* key, uint32_t forms,
+                                CacheCopy* copy) {
+    cache_lock(cache);
+    CacheRecord* record = NULL;
+    if (cache->count > 0) {
+        uint32_t slot = find_slot(cache, key->hash, key->bytes, key->length);
+        if (cache->table[slot]) record = cache->records[cache->table[slot] - 1];
+    }
+
+    // Without an AST there is no code of any form to miss
+    if (record && (record->flags & CACHE_PARSED) && (record->flags & forms) != forms) {
+        record = NULL;
+    }
+    // A hit only moves the entry in the LRU order; the file is rewritten
+    // for that alone once enough entries moved (see cache_save)
+    if (record && record->size > copy->capacity) {
+        uint8_t* grown = (uint8_t*)realloc(copy->bytes, record->size);
+        if (grown) {
+            copy->bytes = grown;
+            copy->capacity = record->size;
+        } else {
+            record = NULL;
+        }
+    }
+    if (record) {
+        if (record->last_used <= cache->saved_clock) cache->touched++;
+        record->last_used = ++cache->clock;
+        cache->hits++;
+        memcpy(copy->bytes, record, record->size);
+    } else {
+        cache->misses++;
+    }
+    cache_unlock(cache);
+    return record ? (const CacheRecord*)copy->bytes : NULL;
+}
+
+// Copy an operand, renumbering a variable to its ID in the key's locals
+static void copy_operand(IROperand* dst, IROperand operand, const SymbolTable* symbols,
+                         const SymbolTable* locals) {
+    dst->kind = operand.kind;
+    dst->index = operand.index;
+    if (operand.kind == IR_VAR) {
+        const char* name = symbols->names[operand.index];
+        dst->index = symbol_find(locals, name, strlen(name));
+    }
+}
+
+// Copy instructions field by field so padding bytes stay zero
+static void copy_code(IRInstr* dst, const IRProgram* ir, const SymbolTable* symbols,
+                      const SymbolTable* locals) {
+    for (uint32_t i = 0; i < ir->count; i++) {
+        dst[i].opcode = ir->code[i].opcode;
+        copy_operand(&dst[i].dst, ir->code[i].dst, symbols, locals);
+        copy_operand(&dst[i].left, ir->code[i].left, symbols, locals);
+        copy_operand(&dst[i].right, ir->code[i].right, symbols, locals);
+    }
+}
+
+int cache_store(CompileCache* cache, const CacheKey* key, int failed, int parsed,
+                const IRProgram* stack, const IRProgram* three_addr,
+                size_t nodes_before, size_t nodes_after,
+                const SymbolTable* symbols, const SymbolTable* locals) {
+    CacheRecord shape;
+    memset(&shape, 0, sizeof(shape));
+    shape.key_length = key->length;
+    if (stack) {
+        shape.stack_count = stack->count;
+        shape.stack_constant_count = stack->constant_count;
+    }
+    if (three_addr) {
+        shape.addr_count = three_addr->count;
+        shape.addr_constant_count = three_addr->constant_count;
+    }
+    RecordLayout layout;
+    record_layout(&shape, &layout);
+
+    CacheRecord* record = (CacheRecord*)calloc(1, layout.size);
+    if (!record) return 0;
+    *record = shape;
+    record->hash = key->hash;
+    record->size = (uint32_t)layout.size;
+    record->flags = (failed ? CACHE_FAILED : 0) | (parsed ? CACHE_PARSED : 0);
+    record->nodes_before = (uint32_t)nodes_before;
+    record->nodes_after = (uint32_t)nodes_after;
+    uint8_t* base = (uint8_t*)record;
+    memcpy(base + layout.key, key->bytes, key->length);
+    if (stack) {
+        record->flags |= CACHE_STACK;
+        if (stack->constant_count > 0) {
+            memcpy(base + layout.stack_constants, stack->constants, stack->constant_count * sizeof(double));
+        }
+        copy_code((IRInstr*)(base + layout.stack_code), stack, symbols, locals);
+    }
+    if (three_addr) {
+        record->flags |= CACHE_THREE_ADDR;
+        record->addr_temp_count = three_addr->temp_count;
+        record->addr_registers = three_addr->registers;
+        record->addr_registers_used = three_addr->registers_used;
+        record->addr_spill_slots = three_addr->spill_slots;
+        copy_operand(&record->addr_result, three_addr->result, symbols, locals);
+        if (three_addr->constant_count > 0) {
+            memcpy(base + layout.addr_constants, three_addr->constants,
+                   three_addr->constant_count * sizeof(double));
+        }
+        copy_code((IRInstr*)(base + layout.addr_code), three_addr, symbols, locals);
+    }
+
+    cache_lock(cache);
+    record->last_used = ++cache->clock;
+    int ok = insert_record(cache, record);
+    if (ok) {
+        cache->stores++;
+        cache->dirty = 1;
+        // Evict in batches, so a full cache does not sort on every store
+        if (sizeof(CacheFileHeader) + cache->bytes > cache->limit) {
+            evict_records(cache, cache->limit - cache->limit / 8);
+        }
+    } else {
+        free(record);
+    }
+    cache_unlock(cache);
+    return ok;
+}
+
+int cache_record_failed(const CacheRecord* record) {
+    return (record->flags & CACHE_FAILED) != 0;
+}
+
+int cache_record_parsed(const CacheRecord* record) {
+    return (record->flags & CACHE_PARSED) != 0;
+}
+
+void cache_record_nodes(const CacheRecord* record, size_t* nodes_before, size_t* nodes_after) {
+    *nodes_before = record->nodes_before;
+    *nodes_after = record->nodes_after;
+}
+
+void cache_record_stack(const CacheRecord* record, IRProgram* view) {
+    RecordLayout layout;
+    record_layout(record, &layout);
+    ir_init(view);
+    view->form = IR_FORM_STACK;
+    view->code = (IRInstr*)record_bytes(record, layout.stack_code);
+    view->count = record->stack_count;
+    view->constants = (double*)record_bytes(record, layout.stack_constants);
+    view->constant_count = record->stack_constant_count;
+}
+
+void cache_record_three_addr(const CacheRecord* record, IRProgram* view) {
+    RecordLayout layout;
+    record_layout(record, &layout);
+    ir_init(view);
+    view->form = IR_FORM_THREE_ADDR;
+    view->code = (IRInstr*)record_bytes(record, layout.addr_code);
+    view->count = record->addr_count;
+    view->constants = (double*)record_bytes(record, layout.addr_constants);
+    view->constant_count = record->addr_constant_count;
+    view->temp_count = record->addr_temp_count;
+    view->result = record->addr_result;
+    view->registers = record->addr_registers;
+    view->registers_used = record->addr_registers_used;
+    view->spill_slots = record->addr_spill_slots;
+}
+
+void cache_print_stats(const CompileCache* cache, FILE* output) {
+    long lookups = cache->hits + cache->misses;
+    fprintf(output, "\nCache: %ld hits, %ld misses (%.1f%% hit rate), %ld stored, %ld evicted\n",
+            cache->hits, cache->misses, lookups ? 100.0 * cache->hits / lookups : 0.0,
+            cache->stores, cache->evictions);
+    fprintf(output, "Cache: %u entries, %.1f of %.1f KiB in %s\n", cache->count,
+            (double)cache->bytes / 1024, (double)cache->limit / 1024, cache->path);
+}
@@ -0,0 +1,129 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ir.h"
+#include "symbols.h"
+#include "tokens.h"
+
+/* Persistent compilation cache
+ *
+ * Maps the token stream of an expression (whitespace does not matter, as
+ * the key is built from tokens) to its generated stack and three-address
+ * code, so an expression compiled by an earlier run is not parsed or
+ * compiled again. The whole cache is one file, <directory>/cache.pqc,
+ * read once when opened and rewritten by cache_save. When it grows past
+ * its size limit the least recently used entries are evicted, in memory
+ * as soon as a store crosses the limit.
+ *
+ * Variables are keyed by name. Cached code numbers them by their first
+ * appearance in the expression (the IDs of the `locals` table filled by
+ * cache_key_build), not by the IDs of the compiler that stored it.
+ *
+ * Lookups and stores may come from several threads at once.
+ */
+
+#define CACHE_FILE_NAME "cache.pqc"
+#define CACHE_MAGIC "PQCC"
+#define CACHE_VERSION 7       // Bumped whenever the same tokens compile differently
+#define CACHE_DEFAULT_LIMIT (64u * 1024 * 1024)
+
+// Code forms held by an entry
+#define CACHE_STACK      0x1u
+#define CACHE_THREE_ADDR 0x2u
+
+typedef struct CompileCache CompileCache;
+typedef struct CacheRecord CacheRecord;
+
+/* Normalized token stream of one expression */
+typedef struct {
+    uint8_t* bytes;
+    uint32_t length;
+    uint32_t capacity;
+    uint64_t hash;
+} CacheKey;
+
+void cache_key_init(CacheKey* key);
+void cache_key_free(CacheKey* key);
+
+/* Copy of an entry made by cache_lookup, so the entry itself may be
+ * evicted by another thread while the copy is in use; reuse one per thread */
+typedef struct {
+    uint8_t* bytes;
+    uint32_t capacity;
+} CacheCopy;
+
+void cache_copy_init(CacheCopy* copy);
+void cache_copy_free(CacheCopy* copy);
+
+/* Build the key of an expression
+ * @param salt Code generation options that change the output (the same
+ *             tokens compiled with other options are another entry)
+ * @param tokens The expression's tokens, without the terminating NEWLINE/EOF
+ * @param symbols The symbol table of the tokens' variables
+ * @param locals Cleared, then receives the expression's variables in order
+ *               of first appearance; cached code refers to these IDs
+ * @return 1 on success, 0 if out of memory
+ */
+int cache_key_build(CacheKey* key, uint32_t salt, const Token* tokens, uint32_t count,
+                    const SymbolTable* symbols, SymbolTable* locals);
+
+/* Open (or create) the cache in a directory
+ * @param limit Size limit of the cache file in bytes
+ * @return The cache, or NULL (with a message on stderr) if the directory
+ *         cannot be created. An unreadable or outdated cache file is
+ *         replaced by an empty cache.
+ */
+CompileCache* cache_open(const char* directory, uint64_t limit);
+
+/* Evict least recently used entries down to the size limit and rewrite
+ * the cache file if entries were added or dropped. Lookups alone only
+ * rewrite it once their new recency order can decide evictions: the
+ * cache is over half its limit and a quarter of its entries were used.
+ * @return 1 on success, 0 if the file could not be written
+ */
+int cache_save(CompileCache* cache);
+
+/* Free the cache without saving it */
+void cache_close(CompileCache* cache);
+
+/* Look up an expression that must have every form in `forms`
+ * (CACHE_STACK, CACHE_THREE_ADDR), counting a hit or a miss
+ * @param copy Receives a copy of the entry
+ * @return The copy, valid until the next lookup with it, or NULL if
+ *         missing (or out of memory for the copy)
+ */
+const CacheRecord* cache_lookup(CompileCache* cache, const CacheKey* key, uint32_t forms,
+                                CacheCopy* copy);
+
+/* Store the result of compiling an expression, replacing any entry with
+ * the same key. Past the size limit, least recently used entries are
+ * evicted down to 7/8 of it, so evictions come in batches.
+ * @param failed The expression was reported as invalid
+ * @param parsed An AST was built (otherwise there is no code at all)
+ * @param stack Stack code, or NULL if not generated
+ * @param three_addr Three-address code, or NULL if not generated
+ * @param nodes_before Node count before optimization (0 if not optimized)
+ * @param nodes_after Node count after optimization
+ * @param symbols The symbol table the code's variable IDs refer to
+ * @param locals The table cache_key_build filled for this key
+ * @return 1 on success, 0 if out of memory
+ */
+int cache_store(CompileCache* cache, const CacheKey* key, int failed, int parsed,
+                const IRProgram* stack, const IRProgram* three_addr,
+                size_t nodes_before, size_t nodes_after,
+                const SymbolTable* symbols, const SymbolTable* locals);
+
+/* Accessors of an entry; the views point into the copy and must not be
+ * freed or grown. Their variables are IDs of the key's `locals` table. */
+int cache_record_failed(const CacheRecord* record);
+int cache_record_parsed(const CacheRecord* record);
+void cache_record_nodes(const CacheRecord* record, size_t* nodes_before, size_t* nodes_after);
+void cache_record_stack(const CacheRecord* record, IRProgram* view);
+void cache_record_three_addr(const CacheRecord* record, IRProgram* view);
+
+/* Print hit/miss/store/eviction counters and the cache size */
+void cache_print_stats(const CompileCache* cache, FILE* output);
+
+#endif // CACHE_H
@@ -1,43 +1,103 @@
 #include "codegen.h"
+#include "flat_ast.h"
+#include "compiler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
-// Helper function to generate stack code recursively
-static void generate_stack_code_helper(const ASTNode* node, FILE* output) {
-    if (!node) return;
-    
+// IR opcode of a binary operator
+static IROpcode operator_opcode(OperatorType op) {
+    switch (op) {
+        case OP_ADD: return IR_ADD;
+        case OP_SUBTRACT: return IR_SUB;
+        case OP_MULTIPLY: return IR_MUL;
+        case OP_DIVIDE: return IR_DIV;
+        case OP_POWER: return IR_POW;
+    }
+    return IR_ERROR;
+}
+
+static const IROperand no_operand = {IR_NONE, 0};
+
+// The definition a stack LOAD reads, none for an input
+static IROperand def_operand(uint32_t def) {
+    return def == AST_NO_DEF ? no_operand : ir_operand(IR_DEF, def);
+}
+
+// Emit the instruction of one node; its operands are already on the stack
+static int emit_stack_instr(const ASTNode* node, IRProgram* ir) {
     switch (node->type) {
-        case NODE_NUMBER:
-            fprintf(output, "PUSH %.2f\n", node->data.value);
-            break;
+        case NODE_NUMBER: {
+            IROperand constant = ir_constant(ir, node->data.value);
+            if (constant.kind != IR_CONST) return 0;
+            return ir_emit(ir, IR_PUSH, no_operand, constant, no_operand);
+        }
             
         case NODE_VARIABLE:
-            fprintf(output, "LOAD %c\n", node->data.name);
-            break;
+            return ir_emit(ir, IR_LOAD, no_operand, ir_operand(IR_VAR, node->data.variable.symbol),
+                           def_operand(node->data.variable.def));
             
         case NODE_BINARY_OP:
-            // Generate code for operands first (postorder traversal)
-            generate_stack_code_helper(node->data.binary_op.left, output);
-            generate_stack_code_helper(node->data.binary_op.right, output);
+            return ir_emit(ir, operator_opcode(node->data.binary_op.operator),
+                           no_operand, no_operand, no_operand);
             
-            // Generate operation instruction
-            switch (node->data.binary_op.operator) {
-                case OP_ADD: fprintf(output, "ADD\n"); break;
-                case OP_SUBTRACT: fprintf(output, "SUB\n"); break;
-                case OP_MULTIPLY: fprintf(output, "MUL\n"); break;
-                case OP_DIVIDE: fprintf(output, "DIV\n"); break;
-                case OP_POWER: fprintf(output, "POW\n"); break;
-            }
-            break;
+        case NODE_ASSIGN:
+            return ir_emit(ir, IR_STORE, no_operand, ir_operand(IR_VAR, node->data.assign.symbol),
+                           ir_operand(IR_DEF, node->data.assign.def));
+            
+        case NODE_SEQUENCE:
+            break; // POP was emitted between the statements
             
         case NODE_ERROR:
-            fprintf(output, "ERROR\n");
-            break;
+            return ir_emit(ir, IR_ERROR, no_operand, no_operand, no_operand);
+    }
+    return 1;
+}
+
+int generate_stack_ir(const ASTNode* node, IRProgram* ir) {
+    ir_clear(ir, IR_FORM_STACK);
+    if (!node) return 1;
+    
+    // Postorder walk: a node's instruction follows the code of its operands
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    int ok = ast_walk_push(&stack, node, 0) != NULL;
+    while (ok && stack.count > 0) {
+        ASTWalkFrame* frame = &stack.frames[stack.count - 1];
+        const ASTNode* current = frame->node;
+        const ASTNode* first;
+        const ASTNode* second;
+        if (frame->state < ast_children(current, &first, &second)) {
+            // Only the value of the last statement stays on the stack
+            if (frame->state == 1 && current->type == NODE_SEQUENCE) {
+                ok = ir_emit(ir, IR_POP, no_operand, no_operand, no_operand);
+            }
+            const ASTNode* child = frame->state++ == 0 ? first : second;
+            if (ok && child) ok = ast_walk_push(&stack, child, 0) != NULL;
+            continue;
+        }
+        stack.count--;
+        ok = emit_stack_instr(current, ir);
+    }
+    ast_walk_free(&stack);
+    return ok;
+}
+
+void generate_stack_code_stream(Compiler* compiler, const ASTNode* node, FILE* output) {
+    IRProgram ir;
+    ir_init(&ir);
+    if (generate_stack_ir(node, &ir)) {
+        ir_write_stack(&ir, &compiler->symbols, output);
+    } else {
+        fprintf(output, "ERROR\n");
     }
+    ir_free(&ir);
 }
 
-int generate_stack_code(const ASTNode* node, const char* filename) {
+int generate_stack_code(Compiler* compiler, const ASTNode* node, const char* filename) {
+    CompileStats* stats = &compiler->stats;
+    uint64_t start = stats_begin(stats);
     FILE* output = stdout;
     int close_file = 0;
     
@@ -53,99 +113,620 @@ int generate_stack_code(const ASTNode* node, const char* filename) {
     fprintf(output, "# Stack Machine Code\n");
     fprintf(output, "# ==================\n\n");
     
-    generate_stack_code_helper(node, output);
+    // Built in the code generator's program, where the instructions can be counted
+    IRProgram* ir = &compiler->codegen.ir;
+    if (generate_stack_ir(node, ir)) {
+        ir_write_stack(ir, &compiler->symbols, output);
+        stats->instructions += ir->count;
+    } else {
+        fprintf(output, "ERROR\n");
+    }
     
     if (close_file) {
+        if (stats->enabled) stats->bytes_written += (uint64_t)ftell(output);
         fclose(output);
     }
     
+    stats_end(stats, STATS_STACK, start);
     return 1;
 }
 
-// Helper function for three-address code generation
-static int temp_var_counter = 0;
+// Temporaries already computed for shared (hash-consed) nodes, so each
+// unique subexpression of a DAG is emitted once. Entries of earlier calls
+// are invalidated by bumping the generation.
+typedef struct TempMemoEntry {
+    const ASTNode* node;
+    int temp;             // Index of the temporary + 1 (0 = not emitted yet)
+    int label;            // Sethi-Ullman register need, for generate_register_ir
+    unsigned generation;
+} TempMemoEntry;
+
+// A statement of the program being generated
+typedef struct CodegenStatement {
+    const ASTNode* node;
+    int live;             // Its code is needed
+    int stored;           // The last assignment of its variable, stored to it
+} CodegenStatement;
+
+void codegen_init(CodegenState* cg) {
+    cg->temp_memo = NULL;
+    cg->temp_memo_capacity = 0;
+    cg->temp_memo_count = 0;
+    cg->temp_memo_generation = 0;
+    cg->operands = NULL;
+    cg->operand_count = 0;
+    cg->operand_capacity = 0;
+    cg->statements = NULL;
+    cg->statement_count = 0;
+    cg->statement_capacity = 0;
+    cg->def_operands = NULL;
+    cg->def_read = NULL;
+    cg->def_count = 0;
+    cg->def_capacity = 0;
+    cg->assigned = NULL;
+    cg->assigned_capacity = 0;
+    cg->registers = 0;
+    ir_init(&cg->ir);
+}
 
-// Structure to hold the result of code generation
-typedef struct {
-    char* var_name;  // Name of the variable holding the result
-    int is_temp;     // Whether this is a temporary variable
-} CodeGenResult;
+void codegen_free(CodegenState* cg) {
+    free(cg->temp_memo);
+    free(cg->operands);
+    free(cg->statements);
+    free(cg->def_operands);
+    free(cg->def_read);
+    free(cg->assigned);
+    ir_free(&cg->ir);
+    codegen_init(cg);
+}
+
+static size_t temp_memo_slot(const ASTNode* node, size_t capacity) {
+    size_t h = (size_t)(uintptr_t)node;
+    h ^= h >> 17;
+    h *= (size_t)0x9E3779B97F4A7C15ULL;
+    return (h ^ (h >> 29)) & (capacity - 1);
+}
 
-// Helper function to generate a new temporary variable name
-static char* new_temp_var() {
-    char* var_name = (char*)malloc(10);
-    sprintf(var_name, "t%d", ++temp_var_counter);
-    return var_name;
+static void temp_memo_reset(CodegenState* cg) {
+    cg->temp_memo_generation++;
+    cg->temp_memo_count = 0;
 }
 
-// Helper function to generate three-address code recursively
-static CodeGenResult generate_three_addr_code_helper(const ASTNode* node, FILE* output) {
-    CodeGenResult result = {NULL, 0};
+// Memo entry of node in the current generation, or NULL
+static TempMemoEntry* temp_memo_lookup(CodegenState* cg, const ASTNode* node) {
+    if (cg->temp_memo_capacity == 0) return NULL;
     
-    if (!node) {
-        result.var_name = strdup("ERROR");
-        return result;
+    size_t slot = temp_memo_slot(node, cg->temp_memo_capacity);
+    while (cg->temp_memo[slot].node && cg->temp_memo[slot].generation == cg->temp_memo_generation) {
+        if (cg->temp_memo[slot].node == node) return &cg->temp_memo[slot];
+        slot = (slot + 1) & (cg->temp_memo_capacity - 1);
+    }
+    return NULL;
+}
+
+// Temporary holding the value of node, or 0 if it has not been computed
+static int temp_memo_find(CodegenState* cg, const ASTNode* node) {
+    TempMemoEntry* entry = temp_memo_lookup(cg, node);
+    return entry ? entry->temp : 0;
+}
+
+// Add an entry for node (not yet present); NULL if out of memory.
+// The pointer is only valid until the next insertion.
+static TempMemoEntry* temp_memo_insert(CodegenState* cg, const ASTNode* node) {
+    if ((cg->temp_memo_count + 1) * 2 > cg->temp_memo_capacity) {
+        size_t capacity = cg->temp_memo_capacity ? cg->temp_memo_capacity * 2 : 256;
+        TempMemoEntry* table = (TempMemoEntry*)calloc(capacity, sizeof(TempMemoEntry));
+        if (!table) return NULL; // Without the memo shared nodes are just recomputed
+        for (size_t i = 0; i < cg->temp_memo_capacity; i++) {
+            if (!cg->temp_memo[i].node || cg->temp_memo[i].generation != cg->temp_memo_generation) continue;
+            size_t slot = temp_memo_slot(cg->temp_memo[i].node, capacity);
+            while (table[slot].node) slot = (slot + 1) & (capacity - 1);
+            table[slot] = cg->temp_memo[i];
+        }
+        free(cg->temp_memo);
+        cg->temp_memo = table;
+        cg->temp_memo_capacity = capacity;
     }
     
+    size_t slot = temp_memo_slot(node, cg->temp_memo_capacity);
+    while (cg->temp_memo[slot].node && cg->temp_memo[slot].generation == cg->temp_memo_generation) {
+        slot = (slot + 1) & (cg->temp_memo_capacity - 1);
+    }
+    TempMemoEntry* entry = &cg->temp_memo[slot];
+    entry->node = node;
+    entry->temp = 0;
+    entry->label = 0;
+    entry->generation = cg->temp_memo_generation;
+    cg->temp_memo_count++;
+    return entry;
+}
+
+static void temp_memo_add(CodegenState* cg, const ASTNode* node, int temp) {
+    TempMemoEntry* entry = temp_memo_insert(cg, node);
+    if (entry) entry->temp = temp;
+}
+
+// Operand for a new temporary defined by the next instruction
+static IROperand new_temp(const IRProgram* ir) {
+    return ir_operand(IR_TEMP, ir->temp_count);
+}
+
+// Push the operand of a finished subtree for its parent
+static int push_operand(CodegenState* cg, IROperand operand) {
+    if (cg->operand_count == cg->operand_capacity) {
+        size_t capacity = cg->operand_capacity ? cg->operand_capacity * 2 : 64;
+        IROperand* operands = (IROperand*)realloc(cg->operands, capacity * sizeof(IROperand));
+        if (!operands) return 0;
+        cg->operands = operands;
+        cg->operand_capacity = capacity;
+    }
+    cg->operands[cg->operand_count++] = operand;
+    return 1;
+}
+
+static IROperand pop_operand(CodegenState* cg) {
+    return cg->operands[--cg->operand_count];
+}
+
+// Operand of a variable: the input itself, or the operand holding the
+// value of the assignment it reads, which is not computed again
+static IROperand variable_operand(const CodegenState* cg, const ASTNode* node) {
+    uint32_t def = node->data.variable.def;
+    if (def == AST_NO_DEF) return ir_operand(IR_VAR, node->data.variable.symbol);
+    return def < cg->def_count ? cg->def_operands[def] : ir_operand(IR_INVALID, 0);
+}
+
+// Visit a child: a frame to walk it, or an invalid operand if it is missing
+static int visit_child(CodegenState* cg, ASTWalkStack* stack, const ASTNode* child) {
+    if (!child) return push_operand(cg, ir_operand(IR_INVALID, 0));
+    return ast_walk_push(stack, child, 0) != NULL;
+}
+
+// Emit the instruction of one node, whose operands (if any) are on the
+// operand stack, and push the operand holding its value
+static int emit_three_addr_instr(CodegenState* cg, const ASTNode* node, IRProgram* ir) {
     switch (node->type) {
         case NODE_NUMBER: {
-            char* var_name = new_temp_var();
-            fprintf(output, "%s = %.2f\n", var_name, node->data.value);
-            result.var_name = var_name;
-            result.is_temp = 1;
-            break;
+            IROperand temp = new_temp(ir);
+            IROperand constant = ir_constant(ir, node->data.value);
+            if (constant.kind != IR_CONST || !ir_emit(ir, IR_COPY, temp, constant, no_operand)) {
+                return 0;
+            }
+            temp_memo_add(cg, node, (int)temp.index + 1);
+            return push_operand(cg, temp);
         }
             
-        case NODE_VARIABLE: {
-            // For variables, we just use the variable name directly
-            result.var_name = (char*)malloc(2);
-            result.var_name[0] = node->data.name;
-            result.var_name[1] = '\0';
-            result.is_temp = 0;
-            break;
-        }
+        case NODE_VARIABLE:
+            // For variables, we just use the variable directly (or the value
+            // of the assignment it reads)
+            return push_operand(cg, variable_operand(cg, node));
             
         case NODE_BINARY_OP: {
-            // Generate code for left and right operands
-            CodeGenResult left = generate_three_addr_code_helper(node->data.binary_op.left, output);
-            CodeGenResult right = generate_three_addr_code_helper(node->data.binary_op.right, output);
+            IROperand right = pop_operand(cg);
+            IROperand left = pop_operand(cg);
             
             // Create a new temporary variable for the result
-            char* var_name = new_temp_var();
+            IROperand temp = new_temp(ir);
+            if (!ir_emit(ir, operator_opcode(node->data.binary_op.operator), temp, left, right)) {
+                return 0;
+            }
+            temp_memo_add(cg, node, (int)temp.index + 1);
+            return push_operand(cg, temp);
+        }
             
-            // Generate the operation
-            char op_char;
-            switch (node->data.binary_op.operator) {
-                case OP_ADD: op_char = '+'; break;
-                case OP_SUBTRACT: op_char = '-'; break;
-                case OP_MULTIPLY: op_char = '*'; break;
-                case OP_DIVIDE: op_char = '/'; break;
-                case OP_POWER: op_char = '^'; break;
-                default: op_char = '?'; break;
+        default:
+            break;
+    }
+    return push_operand(cg, ir_operand(IR_INVALID, 0));
+}
+
+// Emit the code of one expression, leaving its operand on the operand stack
+static int generate_three_addr_tree(CodegenState* cg, const ASTNode* node, IRProgram* ir) {
+    // Postorder walk; every finished subtree leaves its operand on the operand stack
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    int ok = visit_child(cg, &stack, node);
+    while (ok && stack.count > 0) {
+        ASTWalkFrame* frame = &stack.frames[stack.count - 1];
+        const ASTNode* current = frame->node;
+        
+        if (frame->state == 0) {
+            // A shared subexpression that was already emitted reuses its temporary
+            int known_temp = temp_memo_find(cg, current);
+            if (known_temp) {
+                stack.count--;
+                ok = push_operand(cg, ir_operand(IR_TEMP, (uint32_t)(known_temp - 1)));
+                continue;
+            }
+        }
+        if (current->type == NODE_BINARY_OP && frame->state < 2) {
+            const ASTNode* child = frame->state++ == 0 ? current->data.binary_op.left
+                                                       : current->data.binary_op.right;
+            ok = visit_child(cg, &stack, child);
+            continue;
+        }
+        stack.count--;
+        ok = emit_three_addr_instr(cg, current, ir);
+    }
+    ast_walk_free(&stack);
+    return ok;
+}
+
+// Emits the code of one expression, leaving its operand on the operand stack
+typedef int (*ExpressionGenerator)(CodegenState* cg, const ASTNode* node, IRProgram* ir);
+
+// Append a statement of the program, making room for the value of its
+// definition if it is an assignment
+static int add_statement(CodegenState* cg, const ASTNode* node) {
+    if (cg->statement_count == cg->statement_capacity) {
+        size_t capacity = cg->statement_capacity ? cg->statement_capacity * 2 : 16;
+        CodegenStatement* statements = (CodegenStatement*)realloc(cg->statements,
+                                                                  capacity * sizeof(CodegenStatement));
+        if (!statements) return 0;
+        cg->statements = statements;
+        cg->statement_capacity = capacity;
+    }
+    CodegenStatement* statement = &cg->statements[cg->statement_count++];
+    statement->node = node;
+    statement->live = 0;
+    statement->stored = 0;
+    if (!node || node->type != NODE_ASSIGN) return 1;
+    
+    uint32_t def = node->data.assign.def;
+    if (def >= cg->def_capacity) {
+        uint32_t capacity = cg->def_capacity ? cg->def_capacity : 16;
+        while (capacity <= def) capacity *= 2;
+        IROperand* operands = (IROperand*)realloc(cg->def_operands, capacity * sizeof(IROperand));
+        if (!operands) return 0;
+        cg->def_operands = operands;
+        uint8_t* read = (uint8_t*)realloc(cg->def_read, capacity);
+        if (!read) return 0;
+        cg->def_read = read;
+        cg->def_capacity = capacity;
+    }
+    while (cg->def_count <= def) {
+        cg->def_operands[cg->def_count] = ir_operand(IR_INVALID, 0);
+        cg->def_read[cg->def_count++] = 0;
+    }
+    return 1;
+}
+
+// The statements of a program are the leaves of its sequence nodes, in order
+static int collect_statements(CodegenState* cg, const ASTNode* root) {
+    cg->statement_count = 0;
+    
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    int ok = ast_walk_push(&stack, root, 0) != NULL;
+    while (ok && stack.count > 0) {
+        ASTWalkFrame* frame = &stack.frames[stack.count - 1];
+        const ASTNode* current = frame->node;
+        if (current && current->type == NODE_SEQUENCE) {
+            if (frame->state < 2) {
+                const ASTNode* child = frame->state++ == 0 ? current->data.sequence.first
+                                                           : current->data.sequence.second;
+                ok = ast_walk_push(&stack, child, 0) != NULL;
+            } else {
+                stack.count--;
+            }
+            continue;
+        }
+        stack.count--;
+        ok = add_statement(cg, current);
+    }
+    ast_walk_free(&stack);
+    return ok;
+}
+
+// Slot of a symbol in the set of assigned variables, or the empty slot
+// where it would go
+static uint32_t* assigned_slot(const CodegenState* cg, uint32_t symbol) {
+    size_t mask = cg->assigned_capacity - 1;
+    size_t slot = ((size_t)symbol * 0x9E3779B1u) & mask;
+    while (cg->assigned[slot] && cg->assigned[slot] != symbol + 1) {
+        slot = (slot + 1) & mask;
+    }
+    return &cg->assigned[slot];
+}
+
+// Flag the definitions an expression reads; shared nodes are walked once
+// (the memo marks the nodes already seen)
+static int mark_reads(CodegenState* cg, const ASTNode* node) {
+    if (!node) return 1;
+    
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    int ok = ast_walk_push(&stack, node, 0) != NULL;
+    while (ok && stack.count > 0) {
+        const ASTNode* current = stack.frames[--stack.count].node;
+        if (temp_memo_lookup(cg, current)) continue;
+        temp_memo_insert(cg, current); // Out of memory only means walking it again
+        
+        if (current->type == NODE_VARIABLE && current->data.variable.def < cg->def_count) {
+            cg->def_read[current->data.variable.def] = 1;
+        } else if (current->type == NODE_BINARY_OP) {
+            const ASTNode* left = current->data.binary_op.left;
+            const ASTNode* right = current->data.binary_op.right;
+            if (right) ok = ast_walk_push(&stack, right, 0) != NULL;
+            if (ok && left) ok = ast_walk_push(&stack, left, 0) != NULL;
+        }
+    }
+    ast_walk_free(&stack);
+    return ok;
+}
+
+// Decide which statements need code, last to first: the last statement
+// (the value of the program), the last assignment of every variable
+// (stored to it) and the assignments a needed statement reads. The rest
+// is dead: assignments overwritten before they are read, and expression
+// statements whose value is dropped.
+static int mark_live_statements(CodegenState* cg) {
+    size_t capacity = 16;
+    while (capacity < cg->statement_count * 2) capacity *= 2;
+    if (capacity > cg->assigned_capacity) {
+        uint32_t* assigned = (uint32_t*)realloc(cg->assigned, capacity * sizeof(uint32_t));
+        if (!assigned) return 0;
+        cg->assigned = assigned;
+        cg->assigned_capacity = capacity;
+    }
+    memset(cg->assigned, 0, cg->assigned_capacity * sizeof(uint32_t));
+    
+    int ok = 1;
+    for (size_t i = cg->statement_count; i-- > 0 && ok;) {
+        CodegenStatement* statement = &cg->statements[i];
+        const ASTNode* node = statement->node;
+        statement->live = i == cg->statement_count - 1;
+        if (node && node->type == NODE_ASSIGN) {
+            uint32_t* slot = assigned_slot(cg, node->data.assign.symbol);
+            statement->stored = *slot == 0;
+            *slot = node->data.assign.symbol + 1;
+            if (statement->stored || cg->def_read[node->data.assign.def]) statement->live = 1;
+            node = node->data.assign.value;
+        }
+        if (statement->live) ok = mark_reads(cg, node);
+    }
+    return ok;
+}
+
+// Emit a program statement by statement, skipping dead ones; a lone
+// expression is emitted as is
+// @param result Receives the operand of the program's value
+static int generate_program(CodegenState* cg, const ASTNode* root, IRProgram* ir,
+                            ExpressionGenerator generate, IROperand* result) {
+    cg->def_count = 0;
+    if (!root || (root->type != NODE_SEQUENCE && root->type != NODE_ASSIGN)) {
+        int ok = generate(cg, root, ir);
+        *result = ok ? pop_operand(cg) : ir_operand(IR_INVALID, 0);
+        return ok;
+    }
+    
+    // The liveness pass marks nodes in the memo; code generation starts afresh
+    int ok = collect_statements(cg, root) && mark_live_statements(cg);
+    temp_memo_reset(cg);
+    *result = ir_operand(IR_INVALID, 0);
+    
+    for (size_t i = 0; i < cg->statement_count && ok; i++) {
+        const CodegenStatement* statement = &cg->statements[i];
+        if (!statement->live) continue;
+        
+        const ASTNode* node = statement->node;
+        const ASTNode* value = node && node->type == NODE_ASSIGN ? node->data.assign.value : node;
+        ok = generate(cg, value, ir);
+        if (!ok) break;
+        IROperand operand = pop_operand(cg);
+        
+        if (value != node) {
+            // An input that is assigned later is copied first: its variable
+            // no longer holds the value once the store has been made
+            if (operand.kind == IR_VAR && *assigned_slot(cg, operand.index)) {
+                IROperand temp = new_temp(ir);
+                ok = ir_emit(ir, IR_COPY, temp, operand, no_operand);
+                operand = temp;
             }
             
-            fprintf(output, "%s = %s %c %s\n", var_name, left.var_name, op_char, right.var_name);
+            // Later reads of the variable use this operand directly
+            cg->def_operands[node->data.assign.def] = operand;
+            if (ok && statement->stored) {
+                ok = ir_emit(ir, IR_COPY, ir_operand(IR_VAR, node->data.assign.symbol), operand,
+                             no_operand);
+            }
+        }
+        *result = operand;
+    }
+    return ok;
+}
+
+int generate_three_addr_ir(Compiler* compiler, const ASTNode* node, IRProgram* ir) {
+    CodegenState* cg = &compiler->codegen;
+    
+    // Temporaries are numbered per program; forget shared nodes of the last one
+    ir_clear(ir, IR_FORM_THREE_ADDR);
+    temp_memo_reset(cg);
+    cg->operand_count = 0;
+    
+    IROperand result;
+    int ok = generate_program(cg, node, ir, generate_three_addr_tree, &result);
+    ir->result = ok ? result : ir_operand(IR_INVALID, 0);
+    return ok;
+}
+
+// Sethi-Ullman label of a node labelled by label_tree: registers needed
+// to evaluate it without spilling. Leaves are immediate operands and need
+// none; a node missing from the memo (out of memory) counts as 0, which
+// only affects the evaluation order.
+static int register_label(CodegenState* cg, const ASTNode* node) {
+    if (!node || node->type != NODE_BINARY_OP) return 0;
+    TempMemoEntry* entry = temp_memo_lookup(cg, node);
+    return entry ? entry->label : 0;
+}
+
+// Label every binary node of a tree, children first. Labels of shared
+// nodes are memoized, so a DAG is labelled in linear time.
+static int label_tree(CodegenState* cg, const ASTNode* root) {
+    if (!root || root->type != NODE_BINARY_OP) return 1;
+    
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    int ok = ast_walk_push(&stack, root, 0) != NULL;
+    while (ok && stack.count > 0) {
+        ASTWalkFrame* frame = &stack.frames[stack.count - 1];
+        const ASTNode* current = frame->node;
+        if (frame->state == 0 && temp_memo_lookup(cg, current)) {
+            stack.count--; // Shared and already labelled
+            continue;
+        }
+        if (frame->state < 2) {
+            const ASTNode* child = frame->state++ == 0 ? current->data.binary_op.left
+                                                       : current->data.binary_op.right;
+            if (child && child->type == NODE_BINARY_OP) {
+                ok = ast_walk_push(&stack, child, 0) != NULL;
+            }
+            continue;
+        }
+        stack.count--;
+        
+        int left = register_label(cg, current->data.binary_op.left);
+        int right = register_label(cg, current->data.binary_op.right);
+        TempMemoEntry* entry = temp_memo_insert(cg, current);
+        if (entry) entry->label = left == right ? left + 1 : (left > right ? left : right);
+    }
+    ast_walk_free(&stack);
+    return ok;
+}
+
+// Operand of a leaf or missing node, which needs no instruction
+static IROperand leaf_operand(const CodegenState* cg, const ASTNode* node, IRProgram* ir, int* ok) {
+    if (!node) return ir_operand(IR_INVALID, 0);
+    
+    switch (node->type) {
+        case NODE_NUMBER: {
+            // Constants are immediate operands
+            IROperand constant = ir_constant(ir, node->data.value);
+            if (constant.kind != IR_CONST) *ok = 0;
+            return constant;
+        }
             
-            // Clean up temporary variables
-            if (left.is_temp) free(left.var_name);
-            if (right.is_temp) free(right.var_name);
+        case NODE_VARIABLE:
+            return variable_operand(cg, node);
             
-            result.var_name = var_name;
-            result.is_temp = 1;
-            break;
-        }
+        default:
+            return ir_operand(IR_INVALID, 0);
+    }
+}
+
+// Visit a child in pass 2: a frame for an operator, its operand otherwise
+static int visit_register_child(CodegenState* cg, ASTWalkStack* stack, const ASTNode* child,
+                                IRProgram* ir) {
+    if (child && child->type == NODE_BINARY_OP) {
+        return ast_walk_push(stack, child, 0) != NULL;
+    }
+    int ok = 1;
+    IROperand operand = leaf_operand(cg, child, ir, &ok);
+    return ok && push_operand(cg, operand);
+}
+
+// Emit instructions for a tree in Sethi-Ullman order, leaving the operand
+// of its value on the operand stack
+static int generate_register_ir_tree(CodegenState* cg, const ASTNode* root, IRProgram* ir) {
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    int ok = visit_register_child(cg, &stack, root, ir);
+    while (ok && stack.count > 0) {
+        ASTWalkFrame* frame = &stack.frames[stack.count - 1];
+        const ASTNode* current = frame->node;
+        const ASTNode* left_node = current->data.binary_op.left;
+        const ASTNode* right_node = current->data.binary_op.right;
+        
+        if (frame->state == 0) {
+            // A shared subexpression that was already emitted reuses its temporary
+            TempMemoEntry* entry = temp_memo_lookup(cg, current);
+            if (entry && entry->temp) {
+                stack.count--;
+                ok = push_operand(cg, ir_operand(IR_TEMP, (uint32_t)(entry->temp - 1)));
+                continue;
+            }
             
-        case NODE_ERROR: {
-            result.var_name = strdup("ERROR");
-            result.is_temp = 1;
-            break;
+            // The operand needing more registers goes first, so its registers
+            // are free again while the other one is computed
+            frame->value = register_label(cg, right_node) > register_label(cg, left_node);
         }
+        if (frame->state < 2) {
+            // frame->value: the right operand is evaluated first
+            int right_now = frame->state++ == 0 ? frame->value : !frame->value;
+            ok = visit_register_child(cg, &stack, right_now ? right_node : left_node, ir);
+            continue;
+        }
+        stack.count--;
+        
+        IROperand second = pop_operand(cg);
+        IROperand first = pop_operand(cg);
+        IROperand left = frame->value ? second : first;
+        IROperand right = frame->value ? first : second;
+        IROperand temp = new_temp(ir);
+        ok = ir_emit(ir, operator_opcode(current->data.binary_op.operator), temp, left, right) &&
+             push_operand(cg, temp);
+        
+        TempMemoEntry* entry = temp_memo_lookup(cg, current);
+        if (entry) entry->temp = (int)temp.index + 1;
+    }
+    ast_walk_free(&stack);
+    return ok;
+}
+
+// Emit one expression of a register-allocated program: pass 1 labels
+// every subtree, pass 2 emits in label order
+static int generate_register_expression(CodegenState* cg, const ASTNode* node, IRProgram* ir) {
+    return label_tree(cg, node) && generate_register_ir_tree(cg, node, ir);
+}
+
+int generate_register_ir(Compiler* compiler, const ASTNode* node, int registers, IRProgram* ir) {
+    CodegenState* cg = &compiler->codegen;
+    ir_clear(ir, IR_FORM_THREE_ADDR);
+    temp_memo_reset(cg);
+    cg->operand_count = 0;
+    
+    IROperand result;
+    int ok = generate_program(cg, node, ir, generate_register_expression, &result);
+    if (!ok) result = ir_operand(IR_INVALID, 0);
+    
+    // A leaf result still has to be moved into a register
+    if (ok && result.kind != IR_TEMP) {
+        IROperand temp = new_temp(ir);
+        ok = ir_emit(ir, IR_COPY, temp, result, no_operand);
+        result = temp;
+    }
+    ir->result = result;
+    
+    return ok && ir_allocate_registers(ir, registers);
+}
+
+void generate_register_code_stream(Compiler* compiler, const ASTNode* node, int registers, FILE* output) {
+    IRProgram* ir = &compiler->codegen.ir;
+    if (!generate_register_ir(compiler, node, registers, ir)) {
+        fprintf(output, "ERROR\n");
+        return;
     }
     
-    return result;
+    ir_write_three_addr(ir, &compiler->symbols, output);
 }
 
-int generate_three_addr_code(const ASTNode* node, const char* filename) {
+void generate_three_addr_code_stream(Compiler* compiler, const ASTNode* node, FILE* output) {
+    CodegenState* cg = &compiler->codegen;
+    if (cg->registers > 0) {
+        generate_register_code_stream(compiler, node, cg->registers, output);
+        return;
+    }
+    
+    if (generate_three_addr_ir(compiler, node, &cg->ir)) {
+        ir_write_three_addr(&cg->ir, &compiler->symbols, output);
+    } else {
+        fprintf(output, "ERROR\n");
+    }
+}
+
+int generate_three_addr_code(Compiler* compiler, const ASTNode* node, const char* filename) {
+    CompileStats* stats = &compiler->stats;
+    uint64_t start = stats_begin(stats);
     FILE* output = stdout;
     int close_file = 0;
     
@@ -161,20 +742,226 @@ int generate_three_addr_code(const ASTNode* node, const char* filename) {
     fprintf(output, "# Three-Address Code\n");
     fprintf(output, "# =================\n\n");
     
-    // Reset temporary variable counter
-    temp_var_counter = 0;
-    
-    CodeGenResult result = generate_three_addr_code_helper(node, output);
-    
-    // Print the final result variable
-    fprintf(output, "\n# Result is in variable: %s\n", result.var_name);
-    
-    // Clean up
-    if (result.is_temp) free(result.var_name);
+    generate_three_addr_code_stream(compiler, node, output);
+    stats->instructions += compiler->codegen.ir.count;
     
     if (close_file) {
+        if (stats->enabled) stats->bytes_written += (uint64_t)ftell(output);
         fclose(output);
     }
     
+    stats_end(stats, STATS_THREE_ADDR, start);
     return 1;
 }
+
+// Flags of the nodes of a flat program for code generation
+enum {
+    FLAT_POP = 1,       // A statement whose value is dropped (stack code)
+    FLAT_LIVE = 2,      // Code is needed (three-address code)
+    FLAT_STORED = 4     // The last assignment of its variable
+};
+
+int generate_stack_ir_flat(const FlatAST* flat, IRProgram* ir) {
+    ir_clear(ir, IR_FORM_STACK);
+    
+    // A program of several statements pops the value of all but the last,
+    // and its loads name the definition they read: numbers[i] is the
+    // definition number of assignment i (they count in program order)
+    uint8_t* flags = NULL;
+    uint32_t* numbers = NULL;
+    if (flat->count > 0 && flat->kinds[flat->count - 1] == NODE_SEQUENCE) {
+        flags = (uint8_t*)calloc(flat->count, 1);
+        numbers = (uint32_t*)malloc(flat->count * sizeof(uint32_t));
+        if (!flags || !numbers) {
+            free(flags);
+            free(numbers);
+            return 0;
+        }
+        uint32_t defs = 0;
+        for (uint32_t i = 0; i < flat->count; i++) {
+            if (flat->kinds[i] == NODE_SEQUENCE && flat->left[i] != FLAT_AST_NO_CHILD) {
+                flags[flat->left[i]] |= FLAT_POP;
+            }
+            numbers[i] = flat->kinds[i] == NODE_ASSIGN ? defs++ : AST_NO_DEF;
+        }
+    }
+    
+    // Postorder is already stack machine order: one linear pass
+    int ok = 1;
+    for (uint32_t i = 0; i < flat->count && ok; i++) {
+        switch ((NodeType)flat->kinds[i]) {
+            case NODE_NUMBER: {
+                IROperand constant = ir_constant(ir, flat->values[i]);
+                ok = constant.kind == IR_CONST && ir_emit(ir, IR_PUSH, no_operand, constant, no_operand);
+                break;
+            }
+            case NODE_VARIABLE: {
+                uint32_t left = flat->left[i];
+                IROperand def = numbers && left != FLAT_AST_NO_CHILD ? def_operand(numbers[left])
+                                                                     : no_operand;
+                ok = ir_emit(ir, IR_LOAD, no_operand, ir_operand(IR_VAR, flat->symbols[i]), def);
+                break;
+            }
+            case NODE_BINARY_OP:
+                ok = ir_emit(ir, operator_opcode((OperatorType)flat->ops[i]),
+                             no_operand, no_operand, no_operand);
+                break;
+            case NODE_ASSIGN:
+                ok = ir_emit(ir, IR_STORE, no_operand, ir_operand(IR_VAR, flat->symbols[i]),
+                             ir_operand(IR_DEF, numbers ? numbers[i] : 0));
+                break;
+            case NODE_SEQUENCE:
+                break;
+            case NODE_ERROR:
+                ok = ir_emit(ir, IR_ERROR, no_operand, no_operand, no_operand);
+                break;
+        }
+        if (ok && flags && (flags[i] & FLAT_POP)) {
+            ok = ir_emit(ir, IR_POP, no_operand, no_operand, no_operand);
+        }
+    }
+    free(flags);
+    free(numbers);
+    return ok;
+}
+
+// Flag the nodes of a program whose code is needed, in one backward pass:
+// parents come after their children and readers after the assignments they
+// read, so every node is flagged before it is visited (see mark_live_statements)
+// @param assigned Set for every variable assigned in the program
+static void mark_live_flat(const FlatAST* flat, uint8_t* flags, uint8_t* assigned) {
+    flags[flat->count - 1] |= FLAT_LIVE;
+    for (uint32_t i = flat->count; i-- > 0;) {
+        uint32_t left = flat->left[i];
+        uint32_t right = flat->right[i];
+        switch ((NodeType)flat->kinds[i]) {
+            case NODE_ASSIGN:
+                if (!assigned[flat->symbols[i]]) flags[i] |= FLAT_STORED | FLAT_LIVE;
+                assigned[flat->symbols[i]] = 1;
+                break;
+            case NODE_SEQUENCE:
+                // Only the last statement's value is needed
+                if (right != FLAT_AST_NO_CHILD) flags[right] |= flags[i] & FLAT_LIVE;
+                left = FLAT_AST_NO_CHILD;
+                right = FLAT_AST_NO_CHILD;
+                break;
+            case NODE_BINARY_OP:
+                break;
+            default:
+                right = FLAT_AST_NO_CHILD;
+                break;
+        }
+        if (!(flags[i] & FLAT_LIVE)) continue;
+        if (left != FLAT_AST_NO_CHILD) flags[left] |= FLAT_LIVE;
+        if (right != FLAT_AST_NO_CHILD) flags[right] |= FLAT_LIVE;
+    }
+}
+
+int generate_three_addr_ir_flat(const FlatAST* flat, IRProgram* ir) {
+    ir_clear(ir, IR_FORM_THREE_ADDR);
+    
+    // operands[i] holds the value of node i: a temporary, a variable used
+    // directly, or invalid for an error
+    IROperand* operands = (IROperand*)malloc((flat->count ? flat->count : 1) * sizeof(IROperand));
+    if (!operands) return 0;
+    
+    // A program with assignments skips the dead ones (as generate_three_addr_ir)
+    uint8_t* flags = NULL;
+    uint8_t* assigned = NULL;
+    uint32_t symbol_count = 0;
+    NodeType root = flat->count ? (NodeType)flat->kinds[flat->count - 1] : NODE_ERROR;
+    if (root == NODE_SEQUENCE || root == NODE_ASSIGN) {
+        for (uint32_t i = 0; i < flat->count; i++) {
+            if (flat->kinds[i] == NODE_ASSIGN && flat->symbols[i] >= symbol_count) {
+                symbol_count = flat->symbols[i] + 1;
+            }
+        }
+        flags = (uint8_t*)calloc(flat->count, 1);
+        assigned = (uint8_t*)calloc(symbol_count, 1);
+        if (!flags || !assigned) {
+            free(operands);
+            free(flags);
+            free(assigned);
+            return 0;
+        }
+        mark_live_flat(flat, flags, assigned);
+    }
+    
+    IROperand invalid = ir_operand(IR_INVALID, 0);
+    int ok = 1;
+    for (uint32_t i = 0; i < flat->count && ok; i++) {
+        operands[i] = invalid;
+        if (flags && !(flags[i] & FLAT_LIVE)) continue;
+        
+        uint32_t left = flat->left[i];
+        uint32_t right = flat->right[i];
+        switch ((NodeType)flat->kinds[i]) {
+            case NODE_NUMBER: {
+                IROperand constant = ir_constant(ir, flat->values[i]);
+                operands[i] = new_temp(ir);
+                ok = constant.kind == IR_CONST && ir_emit(ir, IR_COPY, operands[i], constant, no_operand);
+                break;
+            }
+            case NODE_VARIABLE:
+                operands[i] = left == FLAT_AST_NO_CHILD ? ir_operand(IR_VAR, flat->symbols[i])
+                                                        : operands[left];
+                break;
+            case NODE_BINARY_OP: {
+                IROperand left_operand = left == FLAT_AST_NO_CHILD ? invalid : operands[left];
+                IROperand right_operand = right == FLAT_AST_NO_CHILD ? invalid : operands[right];
+                operands[i] = new_temp(ir);
+                ok = ir_emit(ir, operator_opcode((OperatorType)flat->ops[i]), operands[i],
+                             left_operand, right_operand);
+                break;
+            }
+            case NODE_ASSIGN: {
+                IROperand value = left == FLAT_AST_NO_CHILD ? invalid : operands[left];
+                if (value.kind == IR_VAR && value.index < symbol_count && assigned[value.index]) {
+                    operands[i] = new_temp(ir);
+                    ok = ir_emit(ir, IR_COPY, operands[i], value, no_operand);
+                } else {
+                    operands[i] = value;
+                }
+                if (ok && (flags[i] & FLAT_STORED)) {
+                    ok = ir_emit(ir, IR_COPY, ir_operand(IR_VAR, flat->symbols[i]), operands[i],
+                                 no_operand);
+                }
+                break;
+            }
+            case NODE_SEQUENCE:
+                operands[i] = right == FLAT_AST_NO_CHILD ? invalid : operands[right];
+                break;
+            default:
+                break;
+        }
+    }
+    
+    ir->result = ok && flat->count ? operands[flat->count - 1] : invalid;
+    free(operands);
+    free(flags);
+    free(assigned);
+    return ok;
+}
+
+void generate_stack_code_flat_stream(const FlatAST* flat, const SymbolTable* symbols, FILE* output) {
+    IRProgram ir;
+    ir_init(&ir);
+    if (generate_stack_ir_flat(flat, &ir)) {
+        ir_write_stack(&ir, symbols, output);
+    } else {
+        fprintf(output, "ERROR\n");
+    }
+    ir_free(&ir);
+}
+
+void generate_three_addr_code_flat_stream(const FlatAST* flat, const SymbolTable* symbols,
+                                          FILE* output) {
+    IRProgram ir;
+    ir_init(&ir);
+    if (generate_three_addr_ir_flat(flat, &ir)) {
+        ir_write_three_addr(&ir, symbols, output);
+    } else {
+        fprintf(output, "ERROR\n");
+    }
+    ir_free(&ir);
+}
@@ -1,20 +1,131 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
+#include <stdio.h>
 #include "ast.h"
+#include "flat_ast.h"
+#include "ir.h"
+
+typedef struct Compiler Compiler;
+
+// Three-address code generator state, owned by a Compiler
+typedef struct {
+    struct TempMemoEntry* temp_memo;  // Temporaries of already emitted shared nodes
+    size_t temp_memo_capacity;
+    size_t temp_memo_count;
+    unsigned temp_memo_generation;
+    
+    IROperand* operands;              // Operands of finished subtrees while walking a tree
+    size_t operand_count;
+    size_t operand_capacity;
+    
+    struct CodegenStatement* statements;  // Statements of the program, in order
+    size_t statement_count;
+    size_t statement_capacity;
+    IROperand* def_operands;          // Operand holding the value of each definition
+    uint8_t* def_read;                // Whether a needed statement reads each definition
+    uint32_t def_count;
+    uint32_t def_capacity;
+    uint32_t* assigned;               // Set of assigned variables: symbol ID + 1, 0 if empty
+    size_t assigned_capacity;
+    
+    int registers;                    // Register file for --regs, 0 for one tN per node
+    IRProgram ir;                     // Code of the last expression
+} CodegenState;
+
+void codegen_init(CodegenState* cg);
+void codegen_free(CodegenState* cg);
+
+/* Build the stack machine code of an AST as IR (replacing previous contents)
+ * @param node The root node of the AST
+ * @param ir The program to fill
+ * @return 1 on success, 0 on failure (out of memory)
+ */
+int generate_stack_ir(const ASTNode* node, IRProgram* ir);
+
+/* Build three-address code as IR, one temporary per node; shared nodes
+ * (hash consing) are computed once
+ * A program of several statements stores the last assignment of every
+ * variable to it, reads assigned variables from the operand holding their
+ * value, and leaves out dead statements (assignments overwritten before
+ * they are read, expression statements other than the last).
+ * @param compiler The compiler whose code generator state is used
+ * @param node The root node of the AST
+ * @param ir The program to fill
+ * @return 1 on success, 0 on failure (out of memory)
+ */
+int generate_three_addr_ir(Compiler* compiler, const ASTNode* node, IRProgram* ir);
+
+/* Build register-allocated three-address code as IR
+ * Statements are handled as by generate_three_addr_ir. Within each one,
+ * subtrees are evaluated in Sethi-Ullman order (the operand needing more
+ * registers first), constants and variables are immediate operands, and
+ * ir_allocate_registers maps the temporaries onto registers 1..registers.
+ * @param compiler The compiler whose code generator state is used
+ * @param node The root node of the AST
+ * @param registers Number of registers available (at least 1)
+ * @param ir The program to fill
+ * @return 1 on success, 0 on failure (out of memory)
+ */
+int generate_register_ir(Compiler* compiler, const ASTNode* node, int registers, IRProgram* ir);
+
+/* Stack and three-address IR from the flat AST, in one linear pass over
+ * the nodes (same programs as the tree versions)
+ */
+int generate_stack_ir_flat(const FlatAST* flat, IRProgram* ir);
+int generate_three_addr_ir_flat(const FlatAST* flat, IRProgram* ir);
 
 /* Generate stack machine code from AST
+ * @param compiler The compiler whose code generator state is used
  * @param node The root node of the AST
  * @param filename The name of the file to write to (or NULL for stdout)
  * @return 1 on success, 0 on failure
  */
-int generate_stack_code(const ASTNode* node, const char* filename);
+int generate_stack_code(Compiler* compiler, const ASTNode* node, const char* filename);
 
 /* Generate three-address code from AST
+ * When compiler->codegen.registers is non-zero the code is register
+ * allocated (see generate_register_code_stream).
+ * @param compiler The compiler whose code generator state is used
  * @param node The root node of the AST
  * @param filename The name of the file to write to (or NULL for stdout)
  * @return 1 on success, 0 on failure
  */
-int generate_three_addr_code(const ASTNode* node, const char* filename);
+int generate_three_addr_code(Compiler* compiler, const ASTNode* node, const char* filename);
+
+/* Write stack machine code for one expression to an open stream (no header)
+ * @param compiler The compiler whose symbol table names the variables
+ * @param node The root node of the AST
+ * @param output The stream to write to
+ */
+void generate_stack_code_stream(Compiler* compiler, const ASTNode* node, FILE* output);
+
+/* Write three-address code for one expression to an open stream (no header)
+ * Temporaries are numbered from t1 for every call.
+ * @param compiler The compiler whose code generator state is used
+ * @param node The root node of the AST
+ * @param output The stream to write to
+ */
+void generate_three_addr_code_stream(Compiler* compiler, const ASTNode* node, FILE* output);
+
+/* Write register-allocated three-address code for one expression
+ * (generate_register_ir), naming registers r1..rN and memory slots sK
+ * @param compiler The compiler whose code generator state is used
+ * @param node The root node of the AST
+ * @param registers Number of registers available (at least 1)
+ * @param output The stream to write to
+ */
+void generate_register_code_stream(Compiler* compiler, const ASTNode* node, int registers, FILE* output);
+
+/* Stack machine code from the flat AST, in one linear pass over the nodes
+ * (same output as generate_stack_code_stream)
+ */
+void generate_stack_code_flat_stream(const FlatAST* flat, const SymbolTable* symbols, FILE* output);
+
+/* Three-address code from the flat AST, in one linear pass over the nodes
+ * (same output as generate_three_addr_code_stream)
+ */
+void generate_three_addr_code_flat_stream(const FlatAST* flat, const SymbolTable* symbols,
+                                          FILE* output);
 
 #endif // CODEGEN_H
@@ -0,0 +1,29 @@
+#include "compiler.h"
+#include <stdlib.h>
+
+Compiler* compiler_create() {
+    Compiler* compiler = (Compiler*)malloc(sizeof(Compiler));
+    if (!compiler) return NULL;
+    
+    lexer_init(&compiler->lexer);
+    parser_init(&compiler->parser);
+    error_init(compiler);
+    error_set_sink(compiler, NULL);
+    codegen_init(&compiler->codegen);
+    ast_arena_init(&compiler->arena);
+    symbol_table_init(&compiler->symbols);
+    stats_init(&compiler->stats);
+    return compiler;
+}
+
+void compiler_destroy(Compiler* compiler) {
+    if (!compiler) return;
+    
+    release_input(compiler);
+    lexer_free(&compiler->lexer);
+    parser_free(&compiler->parser);
+    codegen_free(&compiler->codegen);
+    ast_arena_free(&compiler->arena);
+    symbol_table_free(&compiler->symbols);
+    free(compiler);
+}
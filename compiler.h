@@ -0,0 +1,34 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "ast.h"
+#include "codegen.h"
+#include "error.h"
+#include "lexer.h"
+#include "parser.h"
+#include "stats.h"
+#include "symbols.h"
+
+/* Compiler context: owns all lexer, parser, error, code generator, AST
+ * node and symbol state. Every compiler is independent, so separate threads can each
+ * compile with their own context without any locking.
+ */
+struct Compiler {
+    LexerState lexer;
+    ParserState parser;
+    ErrorState errors;
+    CodegenState codegen;
+    ASTArena arena;    // Nodes of the expressions being compiled
+    SymbolTable symbols;  // Variable names, kept for the compiler's lifetime
+    CompileStats stats;  // Phase times and counters (--stats), off by default
+};
+
+/* Create a compiler context
+ * @return The new context, or NULL if out of memory
+ */
+Compiler* compiler_create();
+
+/* Release the context together with its input buffer and all AST nodes */
+void compiler_destroy(Compiler* compiler);
+
+#endif // COMPILER_H
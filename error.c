@@ -1,28 +1,21 @@
 #include "error.h"
+#include "compiler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_ERRORS 100
-#define MAX_ERROR_MSG_LEN 256
-
-typedef struct {
-    ErrorType type;
-    int line;
-    int column;
-    char message[MAX_ERROR_MSG_LEN];
-} ErrorRecord;
-
-static ErrorRecord errors[MAX_ERRORS];
-static int error_counter = 0;
-
-void error_init() {
-    error_counter = 0;
+void error_init(Compiler* compiler) {
+    compiler->errors.error_counter = 0;
 }
 
-void error_report(ErrorType type, int line, int column, const char* message) {
+void error_report(Compiler* compiler, ErrorType type, int line, int column, const char* message) {
+    ErrorRecord* errors = compiler->errors.errors;
+    int error_counter = compiler->errors.error_counter;
+    
+    FILE* sink = compiler->errors.sink ? compiler->errors.sink : stderr;
+    
     if (error_counter >= MAX_ERRORS) {
-        fprintf(stderr, "Too many errors, stopping compilation\n");
+        fprintf(sink, "Too many errors, stopping compilation\n");
         return;
     }
     
@@ -43,17 +36,20 @@ void error_report(ErrorType type, int line, int column, const char* message) {
         case ERROR_INTERNAL: type_str = "Internal Error"; break;
     }
     
-    fprintf(stderr, "%s at line %d, column %d: %s\n", 
+    fprintf(sink, "%s at line %d, column %d: %s\n", 
             type_str, line, column, message);
     
-    error_counter++;
+    compiler->errors.error_counter++;
 }
 
-int error_count() {
-    return error_counter;
+int error_count(Compiler* compiler) {
+    return compiler->errors.error_counter;
 }
 
-void error_print_summary() {
+void error_print_summary(Compiler* compiler) {
+    const ErrorRecord* errors = compiler->errors.errors;
+    int error_counter = compiler->errors.error_counter;
+    
     if (error_counter == 0) {
         printf("No errors detected.\n");
         return;
@@ -79,6 +75,10 @@ void error_print_summary() {
     }
 }
 
-void error_reset() {
-    error_counter = 0;
+void error_reset(Compiler* compiler) {
+    compiler->errors.error_counter = 0;
+}
+
+void error_set_sink(Compiler* compiler, FILE* sink) {
+    compiler->errors.sink = sink;
 }
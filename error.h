@@ -1,6 +1,13 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <stdio.h>
+
+#define MAX_ERRORS 100
+#define MAX_ERROR_MSG_LEN 256
+
+typedef struct Compiler Compiler;
+
 // Error types
 typedef enum {
     ERROR_SYNTAX,
@@ -11,19 +18,36 @@ typedef enum {
     ERROR_INTERNAL
 } ErrorType;
 
+typedef struct {
+    ErrorType type;
+    int line;
+    int column;
+    char message[MAX_ERROR_MSG_LEN];
+} ErrorRecord;
+
+// Errors reported so far, owned by a Compiler
+typedef struct {
+    ErrorRecord errors[MAX_ERRORS];
+    int error_counter;
+    FILE* sink;          // Where errors are printed as they are reported (NULL = stderr)
+} ErrorState;
+
 // Initialize the error handling system
-void error_init();
+void error_init(Compiler* compiler);
 
 // Report an error with line and column information
-void error_report(ErrorType type, int line, int column, const char* message);
+void error_report(Compiler* compiler, ErrorType type, int line, int column, const char* message);
 
 // Get the number of errors reported so far
-int error_count();
+int error_count(Compiler* compiler);
 
 // Print a summary of all errors
-void error_print_summary();
+void error_print_summary(Compiler* compiler);
 
 // Reset the error system
-void error_reset();
+void error_reset(Compiler* compiler);
+
+// Print reported errors to this stream instead of stderr (NULL = stderr)
+void error_set_sink(Compiler* compiler, FILE* sink);
 
 #endif // ERROR_H
@@ -0,0 +1,252 @@
+#include "flat_ast.h"
+#include <math.h>
+#include <stdlib.h>
+
+void flat_ast_init(FlatAST* flat) {
+    flat->count = 0;
+    flat->capacity = 0;
+    flat->kinds = NULL;
+    flat->ops = NULL;
+    flat->values = NULL;
+    flat->symbols = NULL;
+    flat->left = NULL;
+    flat->right = NULL;
+    flat->lines = NULL;
+    flat->columns = NULL;
+    flat->scratch = NULL;
+}
+
+void flat_ast_free(FlatAST* flat) {
+    free(flat->kinds);
+    free(flat->ops);
+    free(flat->values);
+    free(flat->symbols);
+    free(flat->left);
+    free(flat->right);
+    free(flat->lines);
+    free(flat->columns);
+    free(flat->scratch);
+    flat_ast_init(flat);
+}
+
+void flat_ast_clear(FlatAST* flat) {
+    flat->count = 0;
+}
+
+// Grow every array together so indices stay valid across all of them
+static int flat_ast_reserve(FlatAST* flat, uint32_t needed) {
+    if (needed <= flat->capacity) return 1;
+    
+    uint32_t capacity = flat->capacity ? flat->capacity : 64;
+    while (capacity < needed) capacity *= 2;
+    
+#define GROW(field) do { \
+        void* grown = realloc(flat->field, capacity * sizeof(*flat->field)); \
+        if (!grown) return 0; \
+        flat->field = grown; \
+    } while (0)
+    
+    GROW(kinds);
+    GROW(ops);
+    GROW(values);
+    GROW(symbols);
+    GROW(left);
+    GROW(right);
+    GROW(lines);
+    GROW(columns);
+    GROW(scratch);
+#undef GROW
+    
+    flat->capacity = capacity;
+    return 1;
+}
+
+// Append one node whose children (if any) are already in place
+static void append_node(FlatAST* flat, const ASTNode* node, uint32_t left, uint32_t right) {
+    uint32_t i = flat->count++;
+    flat->kinds[i] = (uint8_t)node->type;
+    flat->ops[i] = 0;
+    flat->values[i] = 0.0;
+    flat->symbols[i] = 0;
+    flat->left[i] = left;
+    flat->right[i] = right;
+    flat->lines[i] = node->line;
+    flat->columns[i] = node->column;
+    
+    switch (node->type) {
+        case NODE_NUMBER: flat->values[i] = node->data.value; break;
+        case NODE_VARIABLE: flat->symbols[i] = node->data.variable.symbol; break;
+        case NODE_BINARY_OP: flat->ops[i] = (uint8_t)node->data.binary_op.operator; break;
+        case NODE_ASSIGN: flat->symbols[i] = node->data.assign.symbol; break;
+        case NODE_SEQUENCE:
+        case NODE_ERROR: break;
+    }
+}
+
+// Remember the index of an assignment for the variables reading it
+static int add_definition(uint32_t** defs, uint32_t* def_capacity, uint32_t def, uint32_t index) {
+    if (def >= *def_capacity) {
+        uint32_t capacity = *def_capacity ? *def_capacity : 16;
+        while (capacity <= def) capacity *= 2;
+        uint32_t* grown = (uint32_t*)realloc(*defs, capacity * sizeof(uint32_t));
+        if (!grown) return 0;
+        for (uint32_t d = *def_capacity; d < capacity; d++) grown[d] = FLAT_AST_NO_CHILD;
+        *defs = grown;
+        *def_capacity = capacity;
+    }
+    (*defs)[def] = index;
+    return 1;
+}
+
+int flat_ast_from_tree(FlatAST* flat, const ASTNode* node) {
+    flat->count = 0;
+    if (!node) return 1;
+    
+    size_t count = ast_count_nodes(node);
+    if (count == 0 || count > INT32_MAX || !flat_ast_reserve(flat, (uint32_t)count)) return 0;
+    
+    // Postorder walk. A subtree's root is the last node appended when it
+    // is finished, which gives the child indices; `value` holds the left
+    // one. defs maps definition numbers to the index of their assignment.
+    uint32_t* defs = NULL;
+    uint32_t def_capacity = 0;
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    int ok = ast_walk_push(&stack, node, 0) != NULL;
+    while (ok && stack.count > 0) {
+        ASTWalkFrame* frame = &stack.frames[stack.count - 1];
+        const ASTNode* current = frame->node;
+        const ASTNode* first;
+        const ASTNode* second;
+        int children = ast_children(current, &first, &second);
+        if (frame->state < children) {
+            const ASTNode* child;
+            if (frame->state++ == 0) {
+                child = first;
+            } else {
+                frame->value = first ? (int)(flat->count - 1) : -1;
+                child = second;
+            }
+            if (child) ok = ast_walk_push(&stack, child, 0) != NULL;
+            continue;
+        }
+        
+        uint32_t left = FLAT_AST_NO_CHILD;
+        uint32_t right = FLAT_AST_NO_CHILD;
+        if (children == 2) {
+            if (frame->value >= 0) left = (uint32_t)frame->value;
+            if (second) right = flat->count - 1;
+        } else if (children == 1) {
+            if (first) left = flat->count - 1;
+        } else if (current->type == NODE_VARIABLE && current->data.variable.def < def_capacity) {
+            left = defs[current->data.variable.def];
+        }
+        stack.count--;
+        append_node(flat, current, left, right);
+        if (current->type == NODE_ASSIGN) {
+            ok = add_definition(&defs, &def_capacity, current->data.assign.def, flat->count - 1);
+        }
+    }
+    ast_walk_free(&stack);
+    free(defs);
+    
+    if (!ok) flat->count = 0;
+    return ok;
+}
+
+ASTNode* flat_ast_to_tree(const FlatAST* flat, ASTArena* arena, const SymbolTable* symbols) {
+    if (flat->count == 0) return NULL;
+    
+    // Children precede parents, so one forward pass can link every node
+    ASTNode** built = (ASTNode**)malloc(flat->count * sizeof(ASTNode*));
+    if (!built) return NULL;
+    
+    uint32_t defs = 0; // Definitions are numbered in program order
+    for (uint32_t i = 0; i < flat->count; i++) {
+        int line = flat->lines[i];
+        int column = flat->columns[i];
+        uint32_t left = flat->left[i];
+        switch ((NodeType)flat->kinds[i]) {
+            case NODE_NUMBER:
+                built[i] = create_number_node(arena, flat->values[i], line, column);
+                break;
+            case NODE_VARIABLE: {
+                int reads_def = left < i && flat->kinds[left] == NODE_ASSIGN && built[left];
+                uint32_t def = reads_def ? built[left]->data.assign.def : AST_NO_DEF;
+                built[i] = create_variable_node(arena, flat->symbols[i],
+                                                symbols->names[flat->symbols[i]], def, line, column);
+                break;
+            }
+            case NODE_ASSIGN:
+                built[i] = create_assign_node(arena, flat->symbols[i], symbols->names[flat->symbols[i]],
+                                              defs++, left == FLAT_AST_NO_CHILD ? NULL : built[left],
+                                              line, column);
+                break;
+            case NODE_SEQUENCE:
+                built[i] = create_sequence_node(arena,
+                    left == FLAT_AST_NO_CHILD ? NULL : built[left],
+                    flat->right[i] == FLAT_AST_NO_CHILD ? NULL : built[flat->right[i]],
+                    line, column);
+                break;
+            case NODE_BINARY_OP:
+                built[i] = create_binary_node(arena, 
+                    flat->left[i] == FLAT_AST_NO_CHILD ? NULL : built[flat->left[i]],
+                    (OperatorType)flat->ops[i],
+                    flat->right[i] == FLAT_AST_NO_CHILD ? NULL : built[flat->right[i]],
+                    line, column);
+                break;
+            default:
+                built[i] = create_error_node(arena, line, column);
+                break;
+        }
+    }
+    
+    ASTNode* root = built[flat->count - 1];
+    free(built);
+    return root;
+}
+
+double flat_ast_evaluate(FlatAST* flat, const double* vars) {
+    if (flat->count == 0) return NAN;
+    
+    double* result = flat->scratch;
+    for (uint32_t i = 0; i < flat->count; i++) {
+        switch ((NodeType)flat->kinds[i]) {
+            case NODE_NUMBER:
+                result[i] = flat->values[i];
+                break;
+            case NODE_VARIABLE:
+                result[i] = flat->left[i] == FLAT_AST_NO_CHILD ? vars[flat->symbols[i]]
+                                                               : result[flat->left[i]];
+                break;
+            case NODE_ASSIGN:
+                result[i] = flat->left[i] == FLAT_AST_NO_CHILD ? NAN : result[flat->left[i]];
+                break;
+            case NODE_SEQUENCE:
+                // The first statements only matter through the definitions they make
+                result[i] = flat->right[i] == FLAT_AST_NO_CHILD ? NAN : result[flat->right[i]];
+                break;
+            case NODE_BINARY_OP: {
+                if (flat->left[i] == FLAT_AST_NO_CHILD || flat->right[i] == FLAT_AST_NO_CHILD) {
+                    result[i] = NAN;
+                    break;
+                }
+                double a = result[flat->left[i]];
+                double b = result[flat->right[i]];
+                switch ((OperatorType)flat->ops[i]) {
+                    case OP_ADD: result[i] = a + b; break;
+                    case OP_SUBTRACT: result[i] = a - b; break;
+                    case OP_MULTIPLY: result[i] = a * b; break;
+                    case OP_DIVIDE: result[i] = a / b; break;
+                    case OP_POWER: result[i] = pow(a, b); break;
+                    default: result[i] = NAN; break;
+                }
+                break;
+            }
+            default:
+                result[i] = NAN;
+                break;
+        }
+    }
+    return result[flat->count - 1];
+}
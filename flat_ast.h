@@ -0,0 +1,61 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <stdint.h>
+#include "ast.h"
+#include "symbols.h"
+
+#define FLAT_AST_NO_CHILD UINT32_MAX
+
+/* Flat, index-based AST encoding (struct of arrays).
+ * Nodes are stored in postorder, so every child precedes its parent and
+ * the root is the last node. Passes walk the arrays front to back instead
+ * of chasing pointers.
+ * Statements use the child arrays too: an assignment's value is its left
+ * child, a sequence has its first and second statement as left and right
+ * child, and a variable reading a definition has the index of that
+ * assignment as its left "child" (a def-use link pointing backwards).
+ */
+typedef struct {
+    uint32_t count;     // Number of nodes in use
+    uint32_t capacity;  // Allocated length of every array
+    uint8_t* kinds;     // NodeType of each node
+    uint8_t* ops;       // OperatorType (binary nodes only)
+    double* values;     // Constant value (number nodes only)
+    uint32_t* symbols;  // Variable symbol ID (variable and assignment nodes)
+    uint32_t* left;     // Left child index, or the definition a variable reads
+    uint32_t* right;    // Right child index (binary and sequence nodes)
+    int* lines;         // Source positions, kept apart from the hot arrays
+    int* columns;
+    double* scratch;    // Per-node results used by flat_ast_evaluate
+} FlatAST;
+
+void flat_ast_init(FlatAST* flat);
+void flat_ast_free(FlatAST* flat);
+
+/* Drop all nodes but keep the arrays for reuse */
+void flat_ast_clear(FlatAST* flat);
+
+/* Convert a pointer tree to the flat encoding (replacing previous contents)
+ * @param flat The flat AST to fill
+ * @param node The root node of the tree
+ * @return 1 on success, 0 on failure (out of memory)
+ */
+int flat_ast_from_tree(FlatAST* flat, const ASTNode* node);
+
+/* Rebuild a pointer tree from the flat encoding
+ * @param flat The flat AST
+ * @param arena The arena the nodes are allocated from
+ * @param symbols The symbol table the variable IDs refer to
+ * @return The root node, or NULL if empty
+ */
+ASTNode* flat_ast_to_tree(const FlatAST* flat, ASTArena* arena, const SymbolTable* symbols);
+
+/* Evaluate the program with a linear pass over the nodes
+ * @param flat The flat AST
+ * @param vars Values of the input variables, indexed by symbol ID
+ * @return The result (NaN for error nodes or an empty AST)
+ */
+double flat_ast_evaluate(FlatAST* flat, const double* vars);
+
+#endif // FLAT_AST_H
@@ -0,0 +1,332 @@
+#include "ir.h"
+#include <stdlib.h>
+#include <string.h>
+
+void ir_init(IRProgram* ir) {
+    memset(ir, 0, sizeof(*ir));
+    ir->result = ir_operand(IR_INVALID, 0);
+}
+
+void ir_free(IRProgram* ir) {
+    free(ir->code);
+    free(ir->constants);
+    ir_init(ir);
+}
+
+void ir_clear(IRProgram* ir, IRForm form) {
+    ir->form = form;
+    ir->count = 0;
+    ir->constant_count = 0;
+    ir->temp_count = 0;
+    ir->result = ir_operand(IR_INVALID, 0);
+    ir->registers = 0;
+    ir->registers_used = 0;
+    ir->spill_slots = 0;
+}
+
+IROperand ir_operand(IROperandKind kind, uint32_t index) {
+    IROperand operand;
+    operand.kind = (uint8_t)kind;
+    operand.index = index;
+    return operand;
+}
+
+IROperand ir_constant(IRProgram* ir, double value) {
+    if (ir->constant_count == ir->constant_capacity) {
+        uint32_t capacity = ir->constant_capacity ? ir->constant_capacity * 2 : 16;
+        double* constants = (double*)realloc(ir->constants, capacity * sizeof(double));
+        if (!constants) return ir_operand(IR_INVALID, 0);
+        ir->constants = constants;
+        ir->constant_capacity = capacity;
+    }
+    ir->constants[ir->constant_count] = value;
+    return ir_operand(IR_CONST, ir->constant_count++);
+}
+
+int ir_emit(IRProgram* ir, IROpcode opcode, IROperand dst, IROperand left, IROperand right) {
+    if (ir->count == ir->capacity) {
+        uint32_t capacity = ir->capacity ? ir->capacity * 2 : 64;
+        IRInstr* code = (IRInstr*)realloc(ir->code, capacity * sizeof(IRInstr));
+        if (!code) return 0;
+        ir->code = code;
+        ir->capacity = capacity;
+    }
+    IRInstr* instr = &ir->code[ir->count++];
+    instr->opcode = (uint8_t)opcode;
+    instr->dst = dst;
+    instr->left = left;
+    instr->right = right;
+    if (dst.kind == IR_TEMP && dst.index >= ir->temp_count) {
+        ir->temp_count = dst.index + 1;
+    }
+    return 1;
+}
+
+// Live range of one temporary and where it ends up
+typedef struct {
+    uint32_t def;         // Defining instruction
+    uint32_t last_use;    // Last instruction reading it (0 = not read yet)
+    int location;         // > 0: register, < 0: memory slot, 0: unassigned
+} LiveRange;
+
+// Record instruction `use` as a read (the backward pass sees the last read first)
+static void mark_use(LiveRange* ranges, IROperand operand, uint32_t use) {
+    if (operand.kind == IR_TEMP && ranges[operand.index].last_use == 0) {
+        ranges[operand.index].last_use = use;
+    }
+}
+
+// Give back the register of a temporary whose live range ends at instruction i
+static void expire_operand(LiveRange* ranges, IROperand operand, uint32_t i,
+                           int* free_regs, int* free_count, uint32_t* active, int* active_count) {
+    if (operand.kind != IR_TEMP) return;
+    LiveRange* range = &ranges[operand.index];
+    if (range->last_use != i || range->location <= 0) return;
+
+    for (int k = 0; k < *active_count; k++) {
+        if (active[k] == operand.index) {
+            active[k] = active[--(*active_count)];
+            free_regs[(*free_count)++] = range->location;
+            return;
+        }
+    }
+}
+
+// Memory slot free from instruction `start` on. busy_until[s] is the last
+// use of the value most recently spilled to slot s.
+static int take_spill_slot(uint32_t** busy_until, uint32_t* slot_count, uint32_t start, uint32_t end) {
+    for (uint32_t s = 0; s < *slot_count; s++) {
+        if ((*busy_until)[s] <= start) {
+            (*busy_until)[s] = end;
+            return -(int)(s + 1);
+        }
+    }
+    uint32_t* grown = (uint32_t*)realloc(*busy_until, (*slot_count + 1) * sizeof(uint32_t));
+    if (!grown) return 0;
+    *busy_until = grown;
+    grown[(*slot_count)++] = end;
+    return -(int)*slot_count;
+}
+
+static void assign_location(const LiveRange* ranges, IROperand* operand) {
+    if (operand->kind != IR_TEMP) return;
+    int location = ranges[operand->index].location;
+    *operand = location > 0 ? ir_operand(IR_REG, (uint32_t)location)
+                            : ir_operand(IR_SLOT, (uint32_t)-location);
+}
+
+int ir_allocate_registers(IRProgram* ir, int registers) {
+    if (registers < 1) registers = 1;
+    ir->registers = (uint32_t)registers;
+    ir->registers_used = 0;
+    ir->spill_slots = 0;
+    if (ir->temp_count == 0) return 1;
+
+    LiveRange* ranges = (LiveRange*)calloc(ir->temp_count, sizeof(LiveRange));
+    int* free_regs = (int*)malloc(registers * sizeof(int));
+    uint32_t* active = (uint32_t*)malloc(registers * sizeof(uint32_t));
+    uint32_t* busy_until = NULL;
+    uint32_t slot_count = 0;
+    int free_count = 0;
+    int active_count = 0;
+    int ok = ranges && free_regs && active;
+
+    // Liveness: one backward pass over straight-line code; the result
+    // stays live past the end
+    if (ok) {
+        for (uint32_t i = 0; i < ir->count; i++) {
+            if (ir->code[i].dst.kind == IR_TEMP) ranges[ir->code[i].dst.index].def = i;
+        }
+        if (ir->result.kind == IR_TEMP) ranges[ir->result.index].last_use = ir->count;
+        for (uint32_t i = ir->count; i-- > 0;) {
+            mark_use(ranges, ir->code[i].left, i);
+            mark_use(ranges, ir->code[i].right, i);
+        }
+    }
+
+    // Lowest numbered register on top
+    for (int r = registers; r >= 1 && ok; r--) free_regs[free_count++] = r;
+
+    for (uint32_t i = 0; i < ir->count && ok; i++) {
+        IRInstr* instr = &ir->code[i];
+
+        // Operands read here for the last time give their registers to the
+        // result, the left one first (r1 = r1 + r2)
+        expire_operand(ranges, instr->right, i, free_regs, &free_count, active, &active_count);
+        expire_operand(ranges, instr->left, i, free_regs, &free_count, active, &active_count);
+        if (instr->dst.kind != IR_TEMP) continue; // A store to a variable
+        LiveRange* range = &ranges[instr->dst.index];
+
+        if (free_count > 0) {
+            range->location = free_regs[--free_count];
+            active[active_count++] = instr->dst.index;
+            continue;
+        }
+
+        // No register left: the value needed furthest in the future lives in memory
+        int victim = 0;
+        for (int k = 1; k < active_count; k++) {
+            if (ranges[active[k]].last_use > ranges[active[victim]].last_use) victim = k;
+        }
+        LiveRange* spilled = &ranges[active[victim]];
+        if (spilled->last_use > range->last_use) {
+            range->location = spilled->location;
+            spilled->location = take_spill_slot(&busy_until, &slot_count, spilled->def, spilled->last_use);
+            active[victim] = instr->dst.index;
+            ok = spilled->location != 0;
+        } else {
+            range->location = take_spill_slot(&busy_until, &slot_count, i, range->last_use);
+            ok = range->location != 0;
+        }
+    }
+
+    if (ok) {
+        for (uint32_t i = 0; i < ir->count; i++) {
+            assign_location(ranges, &ir->code[i].dst);
+            assign_location(ranges, &ir->code[i].left);
+            assign_location(ranges, &ir->code[i].right);
+            if (ir->code[i].dst.kind == IR_REG && ir->code[i].dst.index > ir->registers_used) {
+                ir->registers_used = ir->code[i].dst.index;
+            }
+        }
+        assign_location(ranges, &ir->result);
+        ir->spill_slots = slot_count;
+    }
+
+    free(ranges);
+    free(free_regs);
+    free(active);
+    free(busy_until);
+    return ok;
+}
+
+// An operand of three-address code (or its result) is in range
+static int operand_valid(const IRProgram* ir, uint32_t symbol_count, IROperand operand) {
+    switch ((IROperandKind)operand.kind) {
+        case IR_NONE:
+        case IR_INVALID: return 1;
+        case IR_CONST: return operand.index < ir->constant_count;
+        case IR_VAR: return operand.index < symbol_count;
+        case IR_TEMP: return operand.index < ir->temp_count;
+        case IR_REG: return operand.index >= 1 && operand.index <= ir->registers;
+        case IR_SLOT: return operand.index >= 1 && operand.index <= ir->spill_slots;
+        case IR_DEF: return 0;
+    }
+    return 0;
+}
+
+int ir_valid(const IRProgram* ir, uint32_t symbol_count) {
+    for (uint32_t i = 0; i < ir->count; i++) {
+        const IRInstr* instr = &ir->code[i];
+        if (ir->form == IR_FORM_STACK) {
+            // Only PUSH, LOAD and STORE have operands
+            switch ((IROpcode)instr->opcode) {
+                case IR_PUSH:
+                    if (instr->left.kind != IR_CONST || instr->left.index >= ir->constant_count) return 0;
+                    break;
+                case IR_LOAD:
+                case IR_STORE:
+                    if (instr->left.kind != IR_VAR || instr->left.index >= symbol_count) return 0;
+                    if (instr->right.kind == IR_DEF ? instr->right.index >= ir->count
+                                                    : instr->opcode == IR_STORE) {
+                        return 0;
+                    }
+                    break;
+                case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_POW:
+                case IR_COPY: case IR_ERROR: case IR_POP:
+                    break;
+                default:
+                    return 0;
+            }
+        } else {
+            if (instr->opcode != IR_COPY && (instr->opcode < IR_ADD || instr->opcode > IR_POW)) return 0;
+            if (!operand_valid(ir, symbol_count, instr->dst) ||
+                !operand_valid(ir, symbol_count, instr->left) ||
+                !operand_valid(ir, symbol_count, instr->right)) {
+                return 0;
+            }
+        }
+    }
+    return ir->form == IR_FORM_STACK || operand_valid(ir, symbol_count, ir->result);
+}
+
+// Character used for an operator in three-address code
+static char operator_char(IROpcode opcode) {
+    switch (opcode) {
+        case IR_ADD: return '+';
+        case IR_SUB: return '-';
+        case IR_MUL: return '*';
+        case IR_DIV: return '/';
+        case IR_POW: return '^';
+        default: return '?';
+    }
+}
+
+static void write_operand(const IRProgram* ir, const SymbolTable* symbols, IROperand operand,
+                          FILE* output) {
+    switch ((IROperandKind)operand.kind) {
+        case IR_CONST: fprintf(output, "%.2f", ir->constants[operand.index]); break;
+        case IR_VAR: fputs(symbols->names[operand.index], output); break;
+        case IR_TEMP: fprintf(output, "t%u", operand.index + 1); break;
+        case IR_REG: fprintf(output, "r%u", operand.index); break;
+        case IR_SLOT: fprintf(output, "s%u", operand.index); break;
+        case IR_NONE:
+        case IR_INVALID:
+        case IR_DEF: fprintf(output, "ERROR"); break;
+    }
+}
+
+void ir_write_stack(const IRProgram* ir, const SymbolTable* symbols, FILE* output) {
+    for (uint32_t i = 0; i < ir->count; i++) {
+        const IRInstr* instr = &ir->code[i];
+        switch ((IROpcode)instr->opcode) {
+            case IR_PUSH:
+                fprintf(output, "PUSH %.2f\n", ir->constants[instr->left.index]);
+                break;
+            case IR_LOAD:
+                fprintf(output, "LOAD %s\n", symbols->names[instr->left.index]);
+                break;
+            case IR_ADD: fprintf(output, "ADD\n"); break;
+            case IR_SUB: fprintf(output, "SUB\n"); break;
+            case IR_MUL: fprintf(output, "MUL\n"); break;
+            case IR_DIV: fprintf(output, "DIV\n"); break;
+            case IR_POW: fprintf(output, "POW\n"); break;
+            case IR_STORE:
+                fprintf(output, "STORE %s\n", symbols->names[instr->left.index]);
+                break;
+            case IR_POP: fprintf(output, "POP\n"); break;
+            case IR_COPY:
+            case IR_ERROR: fprintf(output, "ERROR\n"); break;
+        }
+    }
+}
+
+void ir_write_three_addr(const IRProgram* ir, const SymbolTable* symbols, FILE* output) {
+    for (uint32_t i = 0; i < ir->count; i++) {
+        const IRInstr* instr = &ir->code[i];
+        write_operand(ir, symbols, instr->dst, output);
+        fprintf(output, " = ");
+        write_operand(ir, symbols, instr->left, output);
+        if (instr->opcode != IR_COPY) {
+            fprintf(output, " %c ", operator_char((IROpcode)instr->opcode));
+            write_operand(ir, symbols, instr->right, output);
+        }
+        fputc('\n', output);
+    }
+
+    fprintf(output, "\n# Result is in variable: ");
+    write_operand(ir, symbols, ir->result, output);
+    fputc('\n', output);
+    if (ir->registers) {
+        fprintf(output, "# %u instructions, %u of %u registers, %u spill slots\n",
+                ir->count, ir->registers_used, ir->registers, ir->spill_slots);
+    }
+}
+
+void ir_write(const IRProgram* ir, const SymbolTable* symbols, FILE* output) {
+    if (ir->form == IR_FORM_STACK) {
+        ir_write_stack(ir, symbols, output);
+    } else {
+        ir_write_three_addr(ir, symbols, output);
+    }
+}
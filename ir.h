@@ -0,0 +1,116 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "symbols.h"
+
+/* In-memory form of the generated code. Stack machine code and
+ * three-address code share one instruction set: stack code uses PUSH,
+ * LOAD, STORE, POP, ERROR and the operators without operands;
+ * three-address code uses the operators and COPY with a destination and
+ * operands. A three-address COPY to a variable stores an assignment.
+ */
+typedef enum {
+    IR_PUSH,      // Stack: push constant `left`
+    IR_LOAD,      // Stack: push variable `left`
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_POW,
+    IR_COPY,      // Three-address: dst = left
+    IR_ERROR,     // Stack: invalid expression
+    IR_STORE,     // Stack: assign the top of the stack to variable `left` (kept on the stack)
+    IR_POP        // Stack: drop the value of a statement that is not the last
+} IROpcode;
+
+typedef enum {
+    IR_NONE,      // Unused operand
+    IR_CONST,     // Index into the constant pool
+    IR_VAR,       // Variable (symbol ID)
+    IR_TEMP,      // Temporary tN, numbered from 0
+    IR_REG,       // Register rN after allocation, numbered from 1
+    IR_SLOT,      // Memory slot sN after allocation, numbered from 1
+    IR_INVALID,   // Value of an invalid subexpression (written as ERROR)
+    IR_DEF        // Stack: definition number, as `right` of STORE and of a LOAD reading one
+} IROperandKind;
+
+typedef struct {
+    uint8_t kind;         // IROperandKind
+    uint32_t index;
+} IROperand;
+
+typedef struct {
+    uint8_t opcode;       // IROpcode
+    IROperand dst;
+    IROperand left;
+    IROperand right;
+} IRInstr;
+
+typedef enum {
+    IR_FORM_STACK,
+    IR_FORM_THREE_ADDR
+} IRForm;
+
+typedef struct {
+    IRForm form;
+    IRInstr* code;
+    uint32_t count;
+    uint32_t capacity;
+    double* constants;
+    uint32_t constant_count;
+    uint32_t constant_capacity;
+    uint32_t temp_count;      // Temporaries defined (three-address form)
+    IROperand result;         // Operand holding the value (three-address form)
+    uint32_t registers;       // Register file given to ir_allocate_registers (0 = not allocated)
+    uint32_t registers_used;
+    uint32_t spill_slots;
+} IRProgram;
+
+void ir_init(IRProgram* ir);
+void ir_free(IRProgram* ir);
+
+/* Empty the program for reuse, keeping its buffers */
+void ir_clear(IRProgram* ir, IRForm form);
+
+IROperand ir_operand(IROperandKind kind, uint32_t index);
+
+/* Add a value to the constant pool
+ * @return An IR_CONST operand, or IR_INVALID if out of memory
+ */
+IROperand ir_constant(IRProgram* ir, double value);
+
+/* Append one instruction
+ * @return 1 on success, 0 if out of memory
+ */
+int ir_emit(IRProgram* ir, IROpcode opcode, IROperand dst, IROperand left, IROperand right);
+
+/* Map the temporaries of three-address code onto registers 1..registers
+ * by a linear scan over their live ranges. When more values are live than
+ * there are registers, the one used furthest in the future is kept in a
+ * memory slot instead. Operands that die at an instruction hand their
+ * register to its result.
+ * @return 1 on success, 0 if out of memory
+ */
+int ir_allocate_registers(IRProgram* ir, int registers);
+
+/* Check a program read from a file before it is used: every opcode is
+ * known in its form, and every operand index is in range (constants,
+ * variables below symbol_count, temporaries, registers, spill slots and
+ * stack definition numbers). Linear and allocation-free.
+ * @return 1 if the program can be written and assembled safely
+ */
+int ir_valid(const IRProgram* ir, uint32_t symbol_count);
+
+/* Text serializers; the output matches the historical formats:
+ * "PUSH 2.00" / "ADD" lines for stack code, and "t1 = a + 2.00" lines
+ * followed by "# Result is in variable: t1" for three-address code
+ * (plus an instruction/register/spill summary once registers are allocated).
+ * Variables are written by name from the symbol table their IDs refer to.
+ */
+void ir_write_stack(const IRProgram* ir, const SymbolTable* symbols, FILE* output);
+void ir_write_three_addr(const IRProgram* ir, const SymbolTable* symbols, FILE* output);
+void ir_write(const IRProgram* ir, const SymbolTable* symbols, FILE* output);
+
+#endif // IR_H
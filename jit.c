@@ -0,0 +1,605 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#include "jit.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#include <sys/mman.h>
+
+// General purpose registers (low three bits go in ModRM/SIB, bit 3 in REX)
+enum { RAX = 0, RDX = 2, RBX = 3, RSP = 4, RSI = 6, RDI = 7, R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+// SIB index encoding for "no index"
+#define NO_INDEX RSP
+
+// Operand stack slots 0..JIT_REGS-1 live in xmm0..xmm13; deeper slots are
+// spilled to the frame. xmm14 and xmm15 are scratch.
+#define JIT_REGS 14
+#define XMM_SCRATCH_LEFT 14
+#define XMM_SCRATCH_RIGHT 15
+
+// Frame layout (rsp-relative): caller-saved xmm registers live across a
+// call to pow, two 16-byte temporaries for the packed pow, spills, then
+// the local slots of assignments
+#define FRAME_SAVE 0
+#define FRAME_TEMP (16 * JIT_REGS)
+#define FRAME_SPILL (FRAME_TEMP + 32)
+
+// Local slots a program may have in the frame
+#define JIT_MAX_LOCALS 4096
+
+// SSE2 opcode bytes (after the 0F escape)
+#define SSE_LOAD 0x10     // movsd/movupd xmm, m
+#define SSE_STORE 0x11    // movsd/movupd m, xmm
+#define SSE_MOVAPD 0x28   // movapd xmm, xmm/m128
+#define SSE_ADD 0x58
+#define SSE_MUL 0x59
+#define SSE_SUB 0x5C
+#define SSE_DIV 0x5E
+#define SSE_SQRT 0x51
+#define SSE_AND 0x54      // andpd
+#define SSE_XOR 0x57      // xorpd
+#define SSE_CMP 0xC2      // cmpsd/cmppd xmm, xmm, imm8 (0 = equal)
+
+// Mandatory prefixes selecting the scalar (sd) or packed (pd) form
+#define PREFIX_SD 0xF2
+#define PREFIX_PD 0x66
+
+// Constants of the generated code itself; they follow the program's
+// constant pool, at indices constant_count + JIT_CONST_*
+enum { JIT_CONST_NEG_INF, JIT_CONST_SIGN, JIT_EXTRA_CONSTANTS };
+static const double jit_extra_constants[JIT_EXTRA_CONSTANTS] = { -INFINITY, -0.0 };
+
+typedef struct {
+    uint32_t offset;      // Position of the rip-relative disp32
+    uint32_t constant;    // Constant pool index
+} ConstantFixup;
+
+typedef struct {
+    uint8_t* code;
+    size_t length;
+    size_t capacity;
+    ConstantFixup* fixups;
+    size_t fixup_count;
+    size_t fixup_capacity;
+    int failed;           // Set once an allocation fails; later emits are dropped
+} JitBuffer;
+
+static void emit_byte(JitBuffer* buf, uint8_t byte) {
+    if (buf->failed) return;
+    if (buf->length == buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity * 2 : 256;
+        uint8_t* code = (uint8_t*)realloc(buf->code, capacity);
+        if (!code) {
+            buf->failed = 1;
+            return;
+        }
+        buf->code = code;
+        buf->capacity = capacity;
+    }
+    buf->code[buf->length++] = byte;
+}
+
+static void emit_u32(JitBuffer* buf, uint32_t value) {
+    for (int i = 0; i < 4; i++) emit_byte(buf, (uint8_t)(value >> (8 * i)));
+}
+
+static void emit_u64(JitBuffer* buf, uint64_t value) {
+    for (int i = 0; i < 8; i++) emit_byte(buf, (uint8_t)(value >> (8 * i)));
+}
+
+// REX prefix, omitted when no bit is needed
+static void emit_rex(JitBuffer* buf, int wide, int reg, int index, int base) {
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) |
+                  ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+    if (rex != 0x40) emit_byte(buf, rex);
+}
+
+// [base + index * 8 + disp32], always through a SIB byte
+static void emit_mem(JitBuffer* buf, int reg, int base, int index, int32_t disp) {
+    emit_byte(buf, 0x84 | ((reg & 7) << 3));
+    emit_byte(buf, (index == NO_INDEX ? 0x00 : 0xC0) | ((index & 7) << 3) | (base & 7));
+    emit_u32(buf, (uint32_t)disp);
+}
+
+static void emit_sse_reg(JitBuffer* buf, uint8_t prefix, uint8_t opcode, int dst, int src) {
+    emit_byte(buf, prefix);
+    emit_rex(buf, 0, dst, NO_INDEX, src);
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, opcode);
+    emit_byte(buf, 0xC0 | ((dst & 7) << 3) | (src & 7));
+}
+
+static void emit_sse_mem(JitBuffer* buf, uint8_t prefix, uint8_t opcode, int xmm,
+                         int base, int index, int32_t disp) {
+    emit_byte(buf, prefix);
+    emit_rex(buf, 0, xmm, index, base);
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, opcode);
+    emit_mem(buf, xmm, base, index, disp);
+}
+
+// Load a constant pool entry; the displacement is patched once the pool is placed
+static void emit_sse_constant(JitBuffer* buf, uint8_t prefix, uint8_t opcode, int xmm,
+                              uint32_t constant) {
+    emit_byte(buf, prefix);
+    emit_rex(buf, 0, xmm, NO_INDEX, 0);
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, opcode);
+    emit_byte(buf, 0x05 | ((xmm & 7) << 3));
+    if (buf->failed) return;
+
+    if (buf->fixup_count == buf->fixup_capacity) {
+        size_t capacity = buf->fixup_capacity ? buf->fixup_capacity * 2 : 16;
+        ConstantFixup* fixups = (ConstantFixup*)realloc(buf->fixups, capacity * sizeof(ConstantFixup));
+        if (!fixups) {
+            buf->failed = 1;
+            return;
+        }
+        buf->fixups = fixups;
+        buf->fixup_capacity = capacity;
+    }
+    buf->fixups[buf->fixup_count].offset = (uint32_t)buf->length;
+    buf->fixups[buf->fixup_count].constant = constant;
+    buf->fixup_count++;
+    emit_u32(buf, 0);
+}
+
+static void emit_movapd(JitBuffer* buf, int dst, int src) {
+    if (dst != src) emit_sse_reg(buf, PREFIX_PD, SSE_MOVAPD, dst, src);
+}
+
+static void emit_push(JitBuffer* buf, int reg) {
+    emit_rex(buf, 0, 0, NO_INDEX, reg);
+    emit_byte(buf, 0x50 + (reg & 7));
+}
+
+static void emit_pop(JitBuffer* buf, int reg) {
+    emit_rex(buf, 0, 0, NO_INDEX, reg);
+    emit_byte(buf, 0x58 + (reg & 7));
+}
+
+// mov dst, src (64-bit)
+static void emit_mov_reg(JitBuffer* buf, int dst, int src) {
+    emit_rex(buf, 1, src, NO_INDEX, dst);
+    emit_byte(buf, 0x89);
+    emit_byte(buf, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+// mov dst, [base + disp32] (64-bit)
+static void emit_load_reg(JitBuffer* buf, int dst, int base, int32_t disp) {
+    emit_rex(buf, 1, dst, NO_INDEX, base);
+    emit_byte(buf, 0x8B);
+    emit_mem(buf, dst, base, NO_INDEX, disp);
+}
+
+// add/sub rsp, imm32
+static void emit_adjust_rsp(JitBuffer* buf, int32_t amount) {
+    if (amount == 0) return;
+    emit_byte(buf, 0x48);
+    emit_byte(buf, 0x81);
+    emit_byte(buf, amount > 0 ? 0xC4 : 0xEC);
+    emit_u32(buf, (uint32_t)(amount > 0 ? amount : -amount));
+}
+
+static void emit_call(JitBuffer* buf, const void* target) {
+    emit_byte(buf, 0x48);                   // mov rax, imm64
+    emit_byte(buf, 0xB8 + RAX);
+    emit_u64(buf, (uint64_t)(uintptr_t)target);
+    emit_byte(buf, 0xFF);                   // call rax
+    emit_byte(buf, 0xD0 + RAX);
+}
+
+// Patch a rel32 at `at` to reach `target`
+static void patch_rel32(JitBuffer* buf, size_t at, size_t target) {
+    if (buf->failed) return;
+    int32_t rel = (int32_t)((int64_t)target - (int64_t)(at + 4));
+    memcpy(buf->code + at, &rel, sizeof(rel));
+}
+
+static int32_t spill_offset(uint32_t slot) {
+    return FRAME_SPILL + 16 * (int32_t)(slot - JIT_REGS);
+}
+
+// Frame offset of the local slot of a definition, after the spills
+static int32_t local_offset(const Bytecode* bc, uint32_t slot) {
+    uint32_t spills = bc->max_stack > JIT_REGS ? bc->max_stack - JIT_REGS : 0;
+    return FRAME_SPILL + 16 * (int32_t)(spills + slot);
+}
+
+// Register holding a stack slot; spilled slots are loaded into `scratch`
+static int slot_operand(JitBuffer* buf, uint32_t slot, int scratch) {
+    if (slot < JIT_REGS) return (int)slot;
+    emit_sse_mem(buf, PREFIX_PD, SSE_LOAD, scratch, RSP, NO_INDEX, spill_offset(slot));
+    return scratch;
+}
+
+// Register a value for a slot should be computed in
+static int slot_target(uint32_t slot) {
+    return slot < JIT_REGS ? (int)slot : XMM_SCRATCH_LEFT;
+}
+
+// Move a computed value into its slot
+static void slot_store(JitBuffer* buf, uint32_t slot, int reg) {
+    if (slot < JIT_REGS) {
+        emit_movapd(buf, (int)slot, reg);
+    } else {
+        emit_sse_mem(buf, PREFIX_PD, SSE_STORE, reg, RSP, NO_INDEX, spill_offset(slot));
+    }
+}
+
+// pow has no SSE2 instruction: call libm with the live registers saved.
+// `left` is the slot of the base, which also receives the result.
+static void emit_pow(JitBuffer* buf, uint32_t left, int packed) {
+    uint32_t live = left < JIT_REGS ? left : JIT_REGS;
+    for (uint32_t i = 0; i < live; i++) {
+        emit_sse_mem(buf, PREFIX_PD, SSE_STORE, (int)i, RSP, NO_INDEX, FRAME_SAVE + 16 * (int32_t)i);
+    }
+
+    int base = slot_operand(buf, left, XMM_SCRATCH_LEFT);
+    int exponent = slot_operand(buf, left + 1, XMM_SCRATCH_RIGHT);
+    double (*pow_fn)(double, double) = pow;
+
+    if (!packed) {
+        // exponent is never xmm0, so the base can be moved first
+        emit_movapd(buf, 0, base);
+        emit_movapd(buf, 1, exponent);
+        emit_call(buf, (const void*)pow_fn);
+    } else {
+        // One call per lane through the frame temporaries
+        emit_sse_mem(buf, PREFIX_PD, SSE_STORE, base, RSP, NO_INDEX, FRAME_TEMP);
+        emit_sse_mem(buf, PREFIX_PD, SSE_STORE, exponent, RSP, NO_INDEX, FRAME_TEMP + 16);
+        for (int lane = 0; lane < 2; lane++) {
+            emit_sse_mem(buf, PREFIX_SD, SSE_LOAD, 0, RSP, NO_INDEX, FRAME_TEMP + 8 * lane);
+            emit_sse_mem(buf, PREFIX_SD, SSE_LOAD, 1, RSP, NO_INDEX, FRAME_TEMP + 16 + 8 * lane);
+            emit_call(buf, (const void*)pow_fn);
+            emit_sse_mem(buf, PREFIX_SD, SSE_STORE, 0, RSP, NO_INDEX, FRAME_TEMP + 8 * lane);
+        }
+        emit_sse_mem(buf, PREFIX_PD, SSE_LOAD, 0, RSP, NO_INDEX, FRAME_TEMP);
+    }
+    slot_store(buf, left, 0);
+
+    for (uint32_t i = 0; i < live; i++) {
+        emit_sse_mem(buf, PREFIX_PD, SSE_LOAD, (int)i, RSP, NO_INDEX, FRAME_SAVE + 16 * (int32_t)i);
+    }
+}
+
+// pow(x, 0.5) of the value in `slot` without a call: -inf becomes +inf
+// (flipping its sign bit), then sqrt, and adding +0 turns sqrt(-0) = -0
+// into +0, as pow has them
+static void emit_sqrt(JitBuffer* buf, const Bytecode* bc, uint32_t slot, int packed) {
+    uint8_t prefix = packed ? PREFIX_PD : PREFIX_SD;
+    int value = slot_operand(buf, slot, XMM_SCRATCH_LEFT);
+    int mask = XMM_SCRATCH_RIGHT;
+    
+    emit_sse_constant(buf, prefix, packed ? SSE_MOVAPD : SSE_LOAD, mask,
+                      bc->constant_count + JIT_CONST_NEG_INF);
+    emit_sse_reg(buf, prefix, SSE_CMP, mask, value);
+    emit_byte(buf, 0);
+    emit_sse_constant(buf, PREFIX_PD, SSE_AND, mask, bc->constant_count + JIT_CONST_SIGN);
+    emit_sse_reg(buf, PREFIX_PD, SSE_XOR, value, mask);
+    emit_sse_reg(buf, prefix, SSE_SQRT, value, value);
+    emit_sse_reg(buf, PREFIX_PD, SSE_XOR, mask, mask);
+    emit_sse_reg(buf, prefix, SSE_ADD, value, mask);
+    if (slot >= JIT_REGS) slot_store(buf, slot, value);
+}
+
+// Record the symbol ID of a LOAD
+static int add_load(JitCode* jit, uint32_t symbol) {
+    if (jit->load_count == jit->load_capacity) {
+        uint32_t capacity = jit->load_capacity ? jit->load_capacity * 2 : 16;
+        uint32_t* loads = (uint32_t*)realloc(jit->loads, capacity * sizeof(uint32_t));
+        if (!loads) return 0;
+        jit->loads = loads;
+        jit->load_capacity = capacity;
+    }
+    jit->loads[jit->load_count++] = symbol;
+    if (symbol >= jit->var_count) jit->var_count = symbol + 1;
+    return 1;
+}
+
+// Translate the program body; the result ends up in xmm0 (slot 0).
+// Scalar code reads vars from rbx; packed code reads column pointers from
+// r12 and the row index from r14. Loads are recorded in jit if it is not NULL.
+static int emit_body(JitBuffer* buf, const Bytecode* bc, int packed, JitCode* jit) {
+    uint8_t prefix = packed ? PREFIX_PD : PREFIX_SD;
+    uint32_t depth = 0;
+    uint32_t pc = 0;
+
+    while (pc < bc->length) {
+        BytecodeOp op = (BytecodeOp)bc->code[pc++];
+        switch (op) {
+            case BC_HALT:
+                return depth == 1;
+
+            case BC_PUSH: {
+                uint32_t index;
+                memcpy(&index, bc->code + pc, sizeof(uint32_t));
+                pc += sizeof(uint32_t);
+                int target = slot_target(depth);
+                // Pool entries hold the constant twice, so one aligned load fills both lanes
+                emit_sse_constant(buf, prefix, packed ? SSE_MOVAPD : SSE_LOAD, target, index);
+                slot_store(buf, depth, target);
+                depth++;
+                break;
+            }
+
+            case BC_LOAD: {
+                uint32_t symbol;
+                memcpy(&symbol, bc->code + pc, sizeof(uint32_t));
+                pc += sizeof(uint32_t);
+                // The variable is addressed with a disp32 of 8 * symbol
+                if (symbol > INT32_MAX / 8) return 0;
+                if (jit && !add_load(jit, symbol)) return 0;
+                int target = slot_target(depth);
+                if (packed) {
+                    emit_load_reg(buf, RAX, R12, 8 * (int32_t)symbol);
+                    emit_sse_mem(buf, PREFIX_PD, SSE_LOAD, target, RAX, R14, 0);
+                } else {
+                    emit_sse_mem(buf, PREFIX_SD, SSE_LOAD, target, RBX, NO_INDEX, 8 * (int32_t)symbol);
+                }
+                slot_store(buf, depth, target);
+                depth++;
+                break;
+            }
+
+            case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_POW: {
+                if (depth < 2) return 0;
+                uint32_t left = depth - 2;
+                if (op == BC_POW) {
+                    emit_pow(buf, left, packed);
+                } else {
+                    uint8_t opcode = op == BC_ADD ? SSE_ADD :
+                                     op == BC_SUB ? SSE_SUB :
+                                     op == BC_MUL ? SSE_MUL : SSE_DIV;
+                    int right = slot_operand(buf, left + 1, XMM_SCRATCH_RIGHT);
+                    int target = slot_operand(buf, left, XMM_SCRATCH_LEFT);
+                    emit_sse_reg(buf, prefix, opcode, target, right);
+                    if (left >= JIT_REGS) slot_store(buf, left, target);
+                }
+                depth--;
+                break;
+            }
+
+            case BC_SQRT:
+                if (depth < 1) return 0;
+                emit_sqrt(buf, bc, depth - 1, packed);
+                break;
+
+            case BC_STORE:
+            case BC_LOCAL: {
+                uint32_t slot;
+                memcpy(&slot, bc->code + pc, sizeof(uint32_t));
+                pc += 2 * sizeof(uint32_t);
+                if (slot >= bc->local_count) return 0;
+                // Both lanes are kept, so scalar and packed code share the layout
+                if (op == BC_STORE) {
+                    if (depth < 1) return 0;
+                    int value = slot_operand(buf, depth - 1, XMM_SCRATCH_LEFT);
+                    emit_sse_mem(buf, PREFIX_PD, SSE_STORE, value, RSP, NO_INDEX, local_offset(bc, slot));
+                } else {
+                    int target = slot_target(depth);
+                    emit_sse_mem(buf, PREFIX_PD, SSE_LOAD, target, RSP, NO_INDEX, local_offset(bc, slot));
+                    slot_store(buf, depth, target);
+                    depth++;
+                }
+                break;
+            }
+
+            case BC_POP:
+                if (depth < 1) return 0;
+                depth--;
+                break;
+
+            case BC_ERROR:
+            default:
+                return 0;
+        }
+    }
+    return 0;
+}
+
+// Bytes of stack frame the program needs below the saved registers
+static int32_t frame_size(const Bytecode* bc) {
+    int calls = 0;
+    uint32_t pc = 0;
+    while (pc < bc->length) {
+        switch ((BytecodeOp)bc->code[pc++]) {
+            case BC_PUSH: pc += sizeof(uint32_t); break;
+            case BC_LOAD: pc += sizeof(uint32_t); break;
+            case BC_STORE: case BC_LOCAL: pc += 2 * sizeof(uint32_t); break;
+            case BC_POW: calls = 1; break;
+            default: break;
+        }
+    }
+    if (!calls && bc->max_stack <= JIT_REGS && bc->local_count == 0) return 0;
+    return local_offset(bc, bc->local_count);
+}
+
+// double scalar(const double* vars)
+static int emit_scalar_function(JitBuffer* buf, const Bytecode* bc, int32_t frame, JitCode* jit) {
+    // One push realigns rsp to 16 bytes; frame is a multiple of 16
+    emit_push(buf, RBX);
+    emit_mov_reg(buf, RBX, RDI);
+    emit_adjust_rsp(buf, -frame);
+    if (!emit_body(buf, bc, 0, jit)) return 0;
+    emit_adjust_rsp(buf, frame);
+    emit_pop(buf, RBX);
+    emit_byte(buf, 0xC3);                   // ret
+    return 1;
+}
+
+// void packed(const double* const* columns, double* output, size_t rows)
+// rows must be even; two rows are computed per iteration
+static int emit_packed_function(JitBuffer* buf, const Bytecode* bc, int32_t frame) {
+    // Five pushes keep rsp 16-byte aligned for calls to pow
+    emit_push(buf, RBX);
+    emit_push(buf, R12);
+    emit_push(buf, R13);
+    emit_push(buf, R14);
+    emit_push(buf, R15);
+    emit_mov_reg(buf, R12, RDI);
+    emit_mov_reg(buf, R13, RSI);
+    emit_mov_reg(buf, R15, RDX);
+    emit_adjust_rsp(buf, -frame);
+
+    // xor r14d, r14d
+    emit_rex(buf, 0, R14, NO_INDEX, R14);
+    emit_byte(buf, 0x31);
+    emit_byte(buf, 0xC0 | ((R14 & 7) << 3) | (R14 & 7));
+
+    // loop: cmp r14, r15; jae done
+    size_t loop = buf->length;
+    emit_rex(buf, 1, R15, NO_INDEX, R14);
+    emit_byte(buf, 0x39);
+    emit_byte(buf, 0xC0 | ((R15 & 7) << 3) | (R14 & 7));
+    emit_byte(buf, 0x0F);
+    emit_byte(buf, 0x83);
+    size_t exit_jump = buf->length;
+    emit_u32(buf, 0);
+
+    if (!emit_body(buf, bc, 1, NULL)) return 0;
+
+    // movupd [r13 + r14 * 8], xmm0; add r14, 2; jmp loop
+    emit_sse_mem(buf, PREFIX_PD, SSE_STORE, 0, R13, R14, 0);
+    emit_rex(buf, 1, 0, NO_INDEX, R14);
+    emit_byte(buf, 0x83);
+    emit_byte(buf, 0xC0 | (R14 & 7));
+    emit_byte(buf, 2);
+    emit_byte(buf, 0xE9);
+    size_t back_jump = buf->length;
+    emit_u32(buf, 0);
+    patch_rel32(buf, back_jump, loop);
+    patch_rel32(buf, exit_jump, buf->length);
+
+    emit_adjust_rsp(buf, frame);
+    emit_pop(buf, R15);
+    emit_pop(buf, R14);
+    emit_pop(buf, R13);
+    emit_pop(buf, R12);
+    emit_pop(buf, RBX);
+    emit_byte(buf, 0xC3);                   // ret
+    return 1;
+}
+
+int jit_available(void) {
+    return 1;
+}
+
+int jit_compile(JitCode* jit, const Bytecode* bc) {
+    memset(jit, 0, sizeof(*jit));
+    if (!bc->code || bc->local_count > JIT_MAX_LOCALS) return 0;
+
+    JitBuffer buf;
+    memset(&buf, 0, sizeof(buf));
+    int32_t frame = frame_size(bc);
+
+    size_t scalar_offset = 0;
+    int ok = emit_scalar_function(&buf, bc, frame, jit);
+    while (ok && buf.length % 16 != 0) emit_byte(&buf, 0xCC);  // int3 padding
+    size_t packed_offset = buf.length;
+    ok = ok && emit_packed_function(&buf, bc, frame);
+    while (ok && buf.length % 16 != 0) emit_byte(&buf, 0xCC);
+    if (!ok || buf.failed) {
+        free(buf.code);
+        free(buf.fixups);
+        jit_free(jit);
+        return 0;
+    }
+
+    // The constant pool follows the code, 16 bytes per constant, then the extra constants
+    size_t pool_offset = buf.length;
+    for (size_t i = 0; i < buf.fixup_count; i++) {
+        int32_t disp = (int32_t)(pool_offset + 16 * (size_t)buf.fixups[i].constant -
+                                 (buf.fixups[i].offset + 4));
+        memcpy(buf.code + buf.fixups[i].offset, &disp, sizeof(disp));
+    }
+    size_t size = pool_offset + 16 * ((size_t)bc->constant_count + JIT_EXTRA_CONSTANTS);
+
+    // Write through a writable mapping, then flip it to read + execute
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        free(buf.code);
+        free(buf.fixups);
+        jit_free(jit);
+        return 0;
+    }
+    uint8_t* bytes = (uint8_t*)memory;
+    memcpy(bytes, buf.code, buf.length);
+    for (uint32_t i = 0; i < bc->constant_count; i++) {
+        memcpy(bytes + pool_offset + 16 * i, &bc->constants[i], sizeof(double));
+        memcpy(bytes + pool_offset + 16 * i + 8, &bc->constants[i], sizeof(double));
+    }
+    for (uint32_t i = 0; i < JIT_EXTRA_CONSTANTS; i++) {
+        size_t at = pool_offset + 16 * ((size_t)bc->constant_count + i);
+        memcpy(bytes + at, &jit_extra_constants[i], sizeof(double));
+        memcpy(bytes + at + 8, &jit_extra_constants[i], sizeof(double));
+    }
+    free(buf.code);
+    free(buf.fixups);
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        jit_free(jit);
+        return 0;
+    }
+
+    jit->memory = memory;
+    jit->size = size;
+    jit->scalar = (JitScalarFn)(void*)(bytes + scalar_offset);
+    jit->packed = (JitPackedFn)(void*)(bytes + packed_offset);
+    return 1;
+}
+
+void jit_free(JitCode* jit) {
+    if (jit->memory) {
+        munmap(jit->memory, jit->size);
+    }
+    free(jit->loads);
+    memset(jit, 0, sizeof(*jit));
+}
+
+#else
+
+int jit_available(void) {
+    return 0;
+}
+
+int jit_compile(JitCode* jit, const Bytecode* bc) {
+    (void)bc;
+    memset(jit, 0, sizeof(*jit));
+    return 0;
+}
+
+void jit_free(JitCode* jit) {
+    memset(jit, 0, sizeof(*jit));
+}
+
+#endif
+
+int jit_execute_columns(const JitCode* jit, const double* const* columns,
+                        double* output, size_t rows) {
+    if (!jit->memory) return 0;
+    for (uint32_t i = 0; i < jit->load_count; i++) {
+        if (!columns[jit->loads[i]]) return 0;
+    }
+
+    // An odd last row runs on its own, with the scalar function
+    double* vars = NULL;
+    if ((rows & 1) && jit->var_count > 0) {
+        vars = (double*)calloc(jit->var_count, sizeof(double));
+        if (!vars) return 0;
+    }
+
+    // Pairs of rows in the packed loop
+    jit->packed(columns, output, rows & ~(size_t)1);
+    if (rows & 1) {
+        for (uint32_t i = 0; i < jit->load_count; i++) {
+            vars[jit->loads[i]] = columns[jit->loads[i]][rows - 1];
+        }
+        output[rows - 1] = jit->scalar(vars);
+    }
+    free(vars);
+    return 1;
+}
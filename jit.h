@@ -0,0 +1,48 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vm.h"
+
+/* Native code for one expression: x86-64 SSE2, System V calling convention */
+typedef double (*JitScalarFn)(const double* vars);
+typedef void (*JitPackedFn)(const double* const* columns, double* output, size_t rows);
+
+typedef struct {
+    void* memory;           // Executable mapping holding both functions
+    size_t size;
+    JitScalarFn scalar;     // One row: vars[symbol ID], scalar SSE2 (movsd/addsd/...)
+    JitPackedFn packed;     // Two rows per iteration over columns, packed SSE2 (movupd/addpd/...)
+    uint32_t* loads;        // Symbol ID of every LOAD, in program order
+    uint32_t load_count;
+    uint32_t load_capacity;
+    uint32_t var_count;     // Highest symbol ID loaded + 1
+} JitCode;
+
+/* Report whether this build can generate native code (x86-64 only) */
+int jit_available(void);
+
+/* Translate a bytecode program into machine code.
+ * The code is written into a fresh mmap'd buffer, which is then made
+ * read-only and executable.
+ * @param jit Receives the compiled functions
+ * @param bc The program, from bytecode_compile
+ * @return 1 on success, 0 if the program contains ERROR, the JIT is
+ *         unavailable, a symbol ID is too large for a displacement, the
+ *         local slots would not fit the frame, or memory could not be mapped
+ */
+int jit_compile(JitCode* jit, const Bytecode* bc);
+
+/* Unmap the machine code and free the load list */
+void jit_free(JitCode* jit);
+
+/* Evaluate the compiled program over many rows, like vm_execute_columns
+ * @param columns Input column of each variable indexed by symbol ID (at
+ *                least jit->var_count; NULL if unused)
+ * @return 1 on success, 0 if a column the program loads is NULL or out of memory
+ */
+int jit_execute_columns(const JitCode* jit, const double* const* columns,
+                        double* output, size_t rows);
+
+#endif // JIT_H
@@ -1,125 +1,283 @@
+#define _POSIX_C_SOURCE 200809L // fileno
 #include <stdio.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <string.h>
-#include "tokens.h"
+#include <sys/stat.h>
+#include "lexer.h"
+#include "compiler.h"
+#include "trace.h"
 
-TokenValue yylval;
-int yylineno = 1;
-int yycolumn = 1;
-static FILE* input_file = NULL;
-static char current_char = ' ';
-static int is_eof = 0;
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
-void set_input_file(FILE* file) {
-    input_file = file;
-    yylineno = 1;
-    yycolumn = 1;
-    current_char = ' ';
-    is_eof = 0;
+#define CHUNK_SIZE (64 * 1024)
+
+void lexer_init(LexerState* lx) {
+    memset(lx, 0, sizeof(*lx));
+    lx->current_char = ' ';
+    lx->yylineno = 1;
+    lx->yycolumn = 1;
+}
+
+void lexer_free(LexerState* lx) {
+    free(lx->name);
+    lx->name = NULL;
+    lx->name_capacity = 0;
+}
+
+void release_input(Compiler* compiler) {
+    LexerState* lx = &compiler->lexer;
+#ifndef _WIN32
+    if (lx->mapping) {
+        munmap(lx->mapping, lx->mapping_size);
+    }
+#endif
+    lx->mapping = NULL;
+    lx->mapping_size = 0;
+    free(lx->chunk);
+    lx->chunk = NULL;
+    lx->stream = NULL;
+    lx->cursor = lx->limit = NULL;
+}
+
+static void reset_position(LexerState* lx) {
+    lx->yylineno = 1;
+    lx->yycolumn = 1;
+    lx->current_char = ' ';
+    lx->is_eof = 0;
+}
+
+void set_input_string(Compiler* compiler, const char* text, size_t length) {
+    LexerState* lx = &compiler->lexer;
+    release_input(compiler);
+    lx->cursor = text;
+    lx->limit = text + length;
+    reset_position(lx);
 }
 
-static void read_char() {
-    if (is_eof) return;
+void set_input_file(Compiler* compiler, FILE* file) {
+    LexerState* lx = &compiler->lexer;
+    release_input(compiler);
+    reset_position(lx);
     
-    int c = fgetc(input_file);
-    if (c == EOF) {
-        is_eof = 1;
-        current_char = '\0'; // Use null character to represent EOF
+#ifndef _WIN32
+    // Regular files are mapped whole and scanned in place
+    struct stat st;
+    long offset = ftell(file);
+    if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) &&
+        offset >= 0 && st.st_size > offset) {
+        void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (data != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            lx->mapping = data;
+            lx->mapping_size = (size_t)st.st_size;
+            lx->cursor = (const char*)data + offset;
+            lx->limit = (const char*)data + st.st_size;
+            return;
+        }
+    }
+#endif
+    
+    // Pipes, terminals and anything mmap refuses are read in chunks
+    lx->chunk = (char*)malloc(CHUNK_SIZE);
+    if (!lx->chunk) {
+        fprintf(stderr, "Error: Out of memory for input buffer\n");
         return;
     }
+    lx->stream = file;
+    lx->cursor = lx->limit = lx->chunk;
+}
+
+void set_newline_mode(Compiler* compiler, int enabled) {
+    compiler->lexer.newline_separated = enabled;
+}
+
+// Load the next chunk of a streamed input; returns 0 when no bytes remain
+static int refill(LexerState* lx) {
+    if (!lx->stream) return 0;
+    
+    size_t n = fread(lx->chunk, 1, CHUNK_SIZE, lx->stream);
+    lx->cursor = lx->chunk;
+    lx->limit = lx->chunk + n;
+    return n > 0;
+}
+
+static inline void read_char(LexerState* lx) {
+    if (lx->is_eof) return;
     
-    current_char = (char)c;
-    yycolumn++;
-    if (current_char == '\n') {
-        yylineno++;
-        yycolumn = 1;
+    if (lx->cursor == lx->limit && !refill(lx)) {
+        lx->is_eof = 1;
+        lx->current_char = '\0'; // Use null character to represent EOF
+        return;
+    }
+    
+    lx->current_char = *lx->cursor++;
+    lx->yycolumn++;
+    if (lx->current_char == '\n') {
+        lx->yylineno++;
+        lx->yycolumn = 1;
+    }
+}
+
+// Character classes without the per-call locale lookups of <ctype.h>
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r' || \
+                     (c) == '\v' || (c) == '\f')
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+#define IS_NAME_START(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || (c) == '_')
+#define IS_NAME_CHAR(c) (IS_NAME_START(c) || IS_DIGIT(c))
+
+// Append a character to the name being scanned
+static int append_name_char(LexerState* lx, size_t length) {
+    if (length == lx->name_capacity) {
+        size_t capacity = lx->name_capacity ? lx->name_capacity * 2 : 64;
+        char* name = (char*)realloc(lx->name, capacity);
+        if (!name) return 0;
+        lx->name = name;
+        lx->name_capacity = capacity;
     }
+    lx->name[length] = lx->current_char;
+    return 1;
 }
 
-int yylex() {
-    // Skip whitespace
-    while (isspace(current_char)) {
-        read_char();
+static int scan_token(Compiler* compiler) {
+    LexerState* lx = &compiler->lexer;
+    
+    // Skip whitespace (newlines are significant in batch mode)
+    while (IS_SPACE(lx->current_char) && !(lx->newline_separated && lx->current_char == '\n')) {
+        read_char(lx);
     }
     
     // Check for EOF
-    if (is_eof || current_char == '\0') {
-        printf("DEBUG: Lexer returning TOKEN_EOF\n");
+    if (lx->is_eof || lx->current_char == '\0') {
+        TRACE(TRACE_TOKENS, "Lexer returning TOKEN_EOF");
         return TOKEN_EOF;
     }
     
-    printf("DEBUG: Lexer processing char: '%c'\n", current_char);
+    TRACE(TRACE_ALL, "Lexer processing char: '%c'", lx->current_char);
     
     // Check for digits (numbers)
-    if (isdigit(current_char)) {
+    if (IS_DIGIT(lx->current_char)) {
         int has_decimal = 0;
-        char num_buffer[256] = {0};
+        char num_buffer[256];
         int i = 0;
         
         // Read all digits (and possibly a decimal point)
-        while (isdigit(current_char) || (current_char == '.' && !has_decimal)) {
-            if (current_char == '.') {
+        while (IS_DIGIT(lx->current_char) || (lx->current_char == '.' && !has_decimal)) {
+            if (lx->current_char == '.') {
                 has_decimal = 1;
             }
-            num_buffer[i++] = current_char;
-            read_char();
+            if (i < (int)sizeof(num_buffer) - 1) {
+                num_buffer[i++] = lx->current_char;
+            }
+            read_char(lx);
         }
         num_buffer[i] = '\0';
         
         if (has_decimal) {
-            yylval.fval = atof(num_buffer);
-            printf("DEBUG: Lexer returning TOKEN_FLOAT: %f\n", yylval.fval);
+            lx->yylval.fval = atof(num_buffer);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_FLOAT: %f", lx->yylval.fval);
             return TOKEN_FLOAT;
         } else {
-            yylval.ival = atoi(num_buffer);
-            printf("DEBUG: Lexer returning TOKEN_INT: %d\n", yylval.ival);
+            lx->yylval.ival = atoi(num_buffer);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_INT: %d", lx->yylval.ival);
             return TOKEN_INT;
         }
     }
     
-    // Check for variables (single lowercase letters)
-    if (islower(current_char)) {
-        yylval.cval = current_char; // Store the variable name
-        char var_name = current_char;
-        read_char();
+    // Check for variables: names of any length, interned to their ID
+    if (IS_NAME_START(lx->current_char)) {
+        const char* start = lx->cursor - 1; // Where current_char was read
+        const char* end = lx->cursor;
+        while (end < lx->limit && IS_NAME_CHAR(*end)) end++;
+        
+        uint32_t symbol;
+        if (end < lx->limit || !lx->stream) {
+            // The whole name is in the buffer: intern it in place
+            lx->yycolumn += (int)(end - lx->cursor);
+            lx->cursor = end;
+            read_char(lx);
+            symbol = symbol_intern(&compiler->symbols, start, (size_t)(end - start));
+        } else {
+            // The name may continue in the next chunk
+            size_t length = 0;
+            int ok = 1;
+            while (IS_NAME_CHAR(lx->current_char)) {
+                ok = ok && append_name_char(lx, length++);
+                read_char(lx);
+            }
+            symbol = ok ? symbol_intern(&compiler->symbols, lx->name, length) : SYMBOL_NONE;
+        }
+        if (symbol == SYMBOL_NONE) {
+            fprintf(stderr, "Error: Out of memory for variable names\n");
+            return TOKEN_UNKNOWN;
+        }
+        lx->yylval.symbol = symbol;
+        TRACE(TRACE_TOKENS, "Lexer returning TOKEN_VARIABLE: %s", compiler->symbols.names[symbol]);
         return TOKEN_VARIABLE;
     }
     
     // Check for operators and parentheses
-    switch (current_char) {
+    switch (lx->current_char) {
+        case '\n':
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_NEWLINE");
+            return TOKEN_NEWLINE;
         case '+':
-            read_char();
-            printf("DEBUG: Lexer returning TOKEN_PLUS\n");
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_PLUS");
             return TOKEN_PLUS;
         case '-':
-            read_char();
-            printf("DEBUG: Lexer returning TOKEN_MINUS\n");
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_MINUS");
             return TOKEN_MINUS;
         case '*':
-            read_char();
-            printf("DEBUG: Lexer returning TOKEN_MUL\n");
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_MUL");
             return TOKEN_MUL;
         case '/':
-            read_char();
-            printf("DEBUG: Lexer returning TOKEN_DIV\n");
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_DIV");
             return TOKEN_DIV;
         case '^':
-            read_char();
-            printf("DEBUG: Lexer returning TOKEN_POW\n");
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_POW");
             return TOKEN_POW;
         case '(':
-            read_char();
-            printf("DEBUG: Lexer returning TOKEN_LPAREN\n");
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_LPAREN");
             return TOKEN_LPAREN;
         case ')':
-            read_char();
-            printf("DEBUG: Lexer returning TOKEN_RPAREN\n");
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_RPAREN");
             return TOKEN_RPAREN;
+        case '=':
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_ASSIGN");
+            return TOKEN_ASSIGN;
+        case ';':
+            read_char(lx);
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_SEMICOLON");
+            return TOKEN_SEMICOLON;
         default:
             // Unknown character
-            printf("DEBUG: Lexer returning TOKEN_UNKNOWN for char '%c'\n", current_char);
-            read_char();
+            TRACE(TRACE_TOKENS, "Lexer returning TOKEN_UNKNOWN for char '%c'", lx->current_char);
+            read_char(lx);
             return TOKEN_UNKNOWN;
     }
 }
+
+int yylex(Compiler* compiler) {
+    CompileStats* stats = &compiler->stats;
+    if (!stats->enabled) {
+        return scan_token(compiler);
+    }
+    
+    uint64_t start = stats_clock_ns();
+    int token = scan_token(compiler);
+    stats_end(stats, STATS_LEX, start);
+    if (token != TOKEN_EOF) stats->tokens++;
+    return token;
+}
@@ -0,0 +1,53 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdio.h>
+#include "tokens.h"
+
+typedef struct Compiler Compiler;
+
+// Scanner state, owned by a Compiler
+typedef struct {
+    // The scanner walks a contiguous byte range [cursor, limit). The range
+    // is either a caller-owned string, a read-only mapping of a regular
+    // file, or the current chunk of a stream that is refilled on demand.
+    const char* cursor;
+    const char* limit;
+    FILE* stream;           // Non-NULL only when reading in chunks
+    char* chunk;            // Chunk buffer for streamed input
+    void* mapping;          // mmap'd file contents, if any
+    size_t mapping_size;
+    
+    char current_char;
+    int is_eof;
+    int newline_separated;  // Emit TOKEN_NEWLINE instead of skipping '\n'
+    
+    char* name;             // Variable name being scanned, kept across inputs
+    size_t name_capacity;
+    
+    TokenValue yylval;      // Value of the last token
+    int yylineno;           // Position of the scanner
+    int yycolumn;
+} LexerState;
+
+void lexer_init(LexerState* lexer);
+
+// Free the scanner's own buffers (not the input; see release_input)
+void lexer_free(LexerState* lexer);
+
+// Scan the next token; its value is left in compiler->lexer.yylval
+int yylex(Compiler* compiler);
+
+// Scan a regular file in place (mmap) or any other stream in chunks
+void set_input_file(Compiler* compiler, FILE* file);
+
+// Scan a caller-owned string in place
+void set_input_string(Compiler* compiler, const char* text, size_t length);
+
+// Emit TOKEN_NEWLINE for '\n' instead of treating it as whitespace
+void set_newline_mode(Compiler* compiler, int enabled);
+
+// Release whatever backs the current input buffer
+void release_input(Compiler* compiler);
+
+#endif // LEXER_H
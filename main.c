@@ -1,19 +1,49 @@
+#define _POSIX_C_SOURCE 200809L // fileno
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
 #include "tokens.h"
 #include "parser.h"
+#include "compiler.h"
 #include "ast.h"
 #include "codegen.h"
+#include "vm.h"
+#include "jit.h"
+#include "optimizer.h"
 #include "error.h"
+#include "trace.h"
+#include "batch.h"
+#include "cache.h"
+#include "server.h"
+#include "stats.h"
 
-// These are now defined in lexer.c
-extern TokenValue yylval;
-extern int yylineno;
-extern int yycolumn;
+// How --eval runs an expression
+enum { EVAL_NONE, EVAL_VM, EVAL_JIT };
 
-extern int yylex();
-extern void set_input_file(FILE* file);
+// Variable bindings used by --eval, set with --set name=value
+static SymbolBindings bindings;
+
+// Parse a byte count with an optional k, m or g suffix
+// @return The size, or 0 if it is not a valid size
+static uint64_t parse_size(const char* text) {
+    char* end;
+    double value = strtod(text, &end);
+    switch (*end) {
+        case 'k': case 'K': value *= 1024.0; end++; break;
+        case 'm': case 'M': value *= 1024.0 * 1024.0; end++; break;
+        case 'g': case 'G': value *= 1024.0 * 1024.0 * 1024.0; end++; break;
+        default: break;
+    }
+    return (*end == '\0' && value >= 1) ? (uint64_t)value : 0;
+}
 
 // Print usage information
 void print_usage(const char* program_name) {
@@ -24,45 +54,162 @@ void print_usage(const char* program_name) {
     printf("  --ast        Visualize the AST (default)\n");
     printf("  --tokens     Show token stream\n");
     printf("  --verbose    Show all intermediate steps\n");
-    printf("  --help       Display this help message\n\n");
+    printf("  --batch      Compile every line of the input as its own expression\n");
+    printf("  --regs N     Register-allocate three-address code onto N registers\n");
+    printf("  --cse        Share identical subexpressions (hash consing) and compute them once\n");
+    printf("  -O           Fold constants and simplify before code generation\n");
+    printf("  --eval       Evaluate the expression with the bytecode VM\n");
+    printf("  --set x=V    Bind variable x (any name) to value V for --eval (default 0)\n");
+    printf("  --jit        Like --eval, but run JIT-compiled x86-64 code instead of the VM\n");
+    printf("  --flat       Generate code from the flat (postorder array) AST in batch mode\n");
+    printf("  --jobs N     Batch-compile the input files on N threads (implies --batch)\n");
+    printf("  --binary     In batch mode, also write the compiled expressions to <base>.pqb\n");
+    printf("  --load       Read the outputs back from .pqb files instead of compiling source\n");
+    printf("  --serve PATH Compile requests from clients on a Unix domain socket (see server.h)\n");
+    printf("  --stream     Compile stdin line by line to --serve responses on stdout\n");
+    printf("  --cache DIR  In batch mode, reuse stack/3addr code compiled by earlier runs\n");
+    printf("               (kept in DIR/" CACHE_FILE_NAME "; hit/miss counts with --verbose)\n");
+    printf("  --cache-size N[k|m|g]  Size limit of the cache (default 64m)\n");
+    printf("  --stats[=json]  Report time per compiler phase and work counters on stderr\n");
+    printf("  --trace[=N]  Trace lexer/parser events to stderr (1=tokens, 2=rules, 3=all;\n");
+    printf("               requires a build with -DPARSEIQ_TRACE)\n");
+    printf("  --help       Display this help message\n");
+    printf("  --           End of options, for an expression starting with '-'\n\n");
     printf("Examples:\n");
     printf("  %s \"2 + 3 * 4\"\n", program_name);
     printf("  %s --stack \"2 + 3 * 4\"\n", program_name);
     printf("  %s --3addr input.txt\n", program_name);
+    printf("  %s --batch --stack --3addr expressions.txt\n", program_name);
+    printf("  %s --jobs 8 --stack a.txt b.txt c.txt\n", program_name);
+    printf("  %s --batch --binary expressions.txt && %s --load --eval expressions.pqb\n",
+           program_name, program_name);
+    printf("  %s --eval --set x=2 \"x ^ 2 + 1\"\n", program_name);
+    printf("  %s --eval --set rate=0.05 --set years=10 \"(1 + rate) ^ years\"\n", program_name);
+    printf("  %s --eval --set a=2 \"x = a * 3; y = x + 1; x * y\"\n", program_name);
+    printf("  %s --eval -- \"-2 ^ 2\"\n", program_name);
+    printf("  producer | %s --stream --stack > responses.bin\n", program_name);
 }
 
-// Process an expression from a string
-void process_expression(const char* expr, int show_tokens, int show_ast, 
-                       int gen_stack, int gen_3addr, int verbose) {
-    // Create a temporary file with the expression
-    FILE* temp = tmpfile();
-    if (!temp) {
-        fprintf(stderr, "Error: Could not create temporary file\n");
+// Compile the AST to bytecode and print its value under the current bindings
+static void print_evaluation(Compiler* compiler, const ASTNode* root, int mode) {
+    Bytecode bc;
+    VM vm;
+    SymbolValues values;
+    double result;
+    
+    bytecode_init(&bc);
+    symbol_values_init(&values);
+    if (!bytecode_compile(&bc, root) ||
+        !symbol_values_resolve(&values, &compiler->symbols, &bindings)) {
+        fprintf(stderr, "Error: Out of memory compiling bytecode\n");
+        bytecode_free(&bc);
+        symbol_values_free(&values);
         return;
     }
     
-    fprintf(temp, "%s", expr);
-    rewind(temp);
+    if (mode == EVAL_JIT) {
+        JitCode jit;
+        if (jit_compile(&jit, &bc)) {
+            printf("\nResult: %g\n", jit.scalar(values.values));
+            jit_free(&jit);
+            bytecode_free(&bc);
+            symbol_values_free(&values);
+            return;
+        }
+        if (!jit_available()) {
+            fprintf(stderr, "Warning: no JIT for this platform, using the VM\n");
+        }
+    }
     
+    if (!vm_init(&vm, bc.max_stack)) {
+        fprintf(stderr, "Error: Out of memory compiling bytecode\n");
+        bytecode_free(&bc);
+        symbol_values_free(&values);
+        return;
+    }
+    
+    if (vm_execute(&vm, &bc, values.values, &result)) {
+        printf("\nResult: %g\n", result);
+    } else {
+        printf("\nError: Expression could not be evaluated\n");
+    }
+    
+    vm_free(&vm);
+    bytecode_free(&bc);
+    symbol_values_free(&values);
+}
+
+// Run the optimizer on a parsed expression and report what it removed
+static ASTNode* optimize_and_report(Compiler* compiler, ASTNode* root) {
+    uint64_t start = stats_begin(&compiler->stats);
+    OptimizeStats stats;
+    root = optimize_ast(&compiler->arena, root, &stats);
+    stats_end(&compiler->stats, STATS_OPTIMIZE, start);
+    if (stats.nodes_after <= stats.nodes_before) {
+        printf("\nOptimization: removed %zu of %zu nodes", stats.nodes_before - stats.nodes_after,
+               stats.nodes_before);
+    } else {
+        // Strength reduction can trade one pow for several multiplications
+        printf("\nOptimization: %zu nodes became %zu", stats.nodes_before, stats.nodes_after);
+    }
+    printf(" (%d folded, %d simplified, %d reduced)\n", stats.folded, stats.simplified, stats.reduced);
+    return root;
+}
+
+// Write the AST to a file, timing it and counting its size for --stats
+static int write_ast_output(Compiler* compiler, const ASTNode* root, const char* filename) {
+    CompileStats* stats = &compiler->stats;
+    uint64_t start = stats_begin(stats);
+    int ok = write_ast_to_file(root, filename);
+    if (ok && stats->enabled) {
+        struct stat info;
+        if (stat(filename, &info) == 0) stats->bytes_written += (uint64_t)info.st_size;
+    }
+    stats_end(stats, STATS_AST_OUTPUT, start);
+    return ok;
+}
+
+// Process an expression from a string
+void process_expression(Compiler* compiler, const char* expr, int show_tokens, int show_ast, 
+                       int gen_stack, int gen_3addr, int verbose, int evaluate,
+                       int optimize) {
     // Initialize error handling
-    error_init();
+    error_init(compiler);
     
-    // Set up the lexer and parser
-    set_token_stream(temp);
-    parser_reset();
+    // Set up the lexer and parser to scan the string in place
+    set_token_string(compiler, expr);
+    parser_reset(compiler);
     
     // Parse the expression
-    ASTNode* root = parse_expression();
+    ASTNode* root = parse_program(compiler);
+    
+    // Tokens left over after the program are a syntax error, not ignored
+    int line = compiler->parser.line;
+    int column = compiler->parser.column;
+    if (!parser_end_statement(compiler)) {
+        error_report(compiler, ERROR_SYNTAX, line, column, "Unexpected token after expression");
+        root = NULL;
+    }
     
     // Check for errors
-    if (error_count() > 0) {
-        error_print_summary();
+    if (error_count(compiler) > 0) {
+        error_print_summary(compiler);
         if (!root) {
-            fclose(temp);
+            release_token_stream(compiler);
             return;
         }
     }
     
+    // Report subexpressions shared by hash consing
+    if (root && compiler->arena.hash_consing) {
+        printf("\nHash consing: %zu nodes shared\n", compiler->arena.intern_hits);
+    }
+    
+    // Optimize before any output if requested
+    if (root && optimize) {
+        root = optimize_and_report(compiler, root);
+    }
+    
     // Process the AST
     if (root) {
         // Show tokens if requested
@@ -80,21 +227,21 @@ void process_expression(const char* expr, int show_tokens, int show_ast,
             print_ast(root, 0);
             
             // Write AST to file
-            write_ast_to_file(root, "ast_output.txt");
+            write_ast_output(compiler, root, "ast_output.txt");
             printf("\nAST structure written to ast_output.txt\n");
         }
         
         // Generate stack machine code if requested
         if (gen_stack || verbose) {
             char stack_filename[256] = "stack_output.txt";
-            if (generate_stack_code(root, stack_filename)) {
+            if (generate_stack_code(compiler, root, stack_filename)) {
                 printf("\nStack machine code written to %s\n", stack_filename);
                 
                 // Also print to console if verbose
                 if (verbose) {
                     printf("\nStack Machine Code:\n");
                     printf("==================\n");
-                    generate_stack_code(root, NULL); // NULL means stdout
+                    generate_stack_code(compiler, root, NULL); // NULL means stdout
                 }
             }
         }
@@ -102,30 +249,36 @@ void process_expression(const char* expr, int show_tokens, int show_ast,
         // Generate three-address code if requested
         if (gen_3addr || verbose) {
             char addr_filename[256] = "3addr_output.txt";
-            if (generate_three_addr_code(root, addr_filename)) {
+            if (generate_three_addr_code(compiler, root, addr_filename)) {
                 printf("\nThree-address code written to %s\n", addr_filename);
                 
                 // Also print to console if verbose
                 if (verbose) {
                     printf("\nThree-Address Code:\n");
                     printf("=================\n");
-                    generate_three_addr_code(root, NULL); // NULL means stdout
+                    generate_three_addr_code(compiler, root, NULL); // NULL means stdout
                 }
             }
         }
         
-        // Clean up
-        free_ast(root);
+        // Evaluate with the bytecode VM or the JIT if requested
+        if (evaluate) {
+            print_evaluation(compiler, root, evaluate);
+        }
+        
+        // Clean up: release every node of the expression at once
+        ast_arena_reset(&compiler->arena);
     } else {
         printf("\nError: Failed to parse expression\n");
     }
     
-    fclose(temp);
+    release_token_stream(compiler);
 }
 
 // Process an expression from a file
-void process_file(const char* filename, int show_tokens, int show_ast, 
-                 int gen_stack, int gen_3addr, int verbose) {
+void process_file(Compiler* compiler, const char* filename, int show_tokens, int show_ast, 
+                 int gen_stack, int gen_3addr, int verbose, int evaluate,
+                 int optimize) {
     FILE* input = fopen(filename, "r");
     if (!input) {
         fprintf(stderr, "Error: Could not open file: %s\n", filename);
@@ -133,24 +286,43 @@ void process_file(const char* filename, int show_tokens, int show_ast,
     }
     
     // Initialize error handling
-    error_init();
+    error_init(compiler);
     
     // Set up the lexer and parser
-    set_token_stream(input);
-    parser_reset();
+    set_token_stream(compiler, input);
+    parser_reset(compiler);
     
     // Parse the expression
-    ASTNode* root = parse_expression();
+    ASTNode* root = parse_program(compiler);
+    
+    // Tokens left over after the program are a syntax error, not ignored
+    int line = compiler->parser.line;
+    int column = compiler->parser.column;
+    if (!parser_end_statement(compiler)) {
+        error_report(compiler, ERROR_SYNTAX, line, column, "Unexpected token after expression");
+        root = NULL;
+    }
     
     // Check for errors
-    if (error_count() > 0) {
-        error_print_summary();
+    if (error_count(compiler) > 0) {
+        error_print_summary(compiler);
         if (!root) {
+            release_token_stream(compiler);
             fclose(input);
             return;
         }
     }
     
+    // Report subexpressions shared by hash consing
+    if (root && compiler->arena.hash_consing) {
+        printf("\nHash consing: %zu nodes shared\n", compiler->arena.intern_hits);
+    }
+    
+    // Optimize before any output if requested
+    if (root && optimize) {
+        root = optimize_and_report(compiler, root);
+    }
+    
     // Process the AST
     if (root) {
         // Generate base filename without extension
@@ -180,7 +352,7 @@ void process_file(const char* filename, int show_tokens, int show_ast,
             // Write AST to file
             char ast_filename[256];
             snprintf(ast_filename, sizeof(ast_filename), "%s_ast.txt", base_filename);
-            if (write_ast_to_file(root, ast_filename)) {
+            if (write_ast_output(compiler, root, ast_filename)) {
                 printf("\nAST structure written to %s\n", ast_filename);
             }
         }
@@ -189,14 +361,14 @@ void process_file(const char* filename, int show_tokens, int show_ast,
         if (gen_stack || verbose) {
             char stack_filename[256];
             snprintf(stack_filename, sizeof(stack_filename), "%s_stack.txt", base_filename);
-            if (generate_stack_code(root, stack_filename)) {
+            if (generate_stack_code(compiler, root, stack_filename)) {
                 printf("\nStack machine code written to %s\n", stack_filename);
                 
                 // Also print to console if verbose
                 if (verbose) {
                     printf("\nStack Machine Code:\n");
                     printf("==================\n");
-                    generate_stack_code(root, NULL); // NULL means stdout
+                    generate_stack_code(compiler, root, NULL); // NULL means stdout
                 }
             }
         }
@@ -205,24 +377,30 @@ void process_file(const char* filename, int show_tokens, int show_ast,
         if (gen_3addr || verbose) {
             char addr_filename[256];
             snprintf(addr_filename, sizeof(addr_filename), "%s_3addr.txt", base_filename);
-            if (generate_three_addr_code(root, addr_filename)) {
+            if (generate_three_addr_code(compiler, root, addr_filename)) {
                 printf("\nThree-address code written to %s\n", addr_filename);
                 
                 // Also print to console if verbose
                 if (verbose) {
                     printf("\nThree-Address Code:\n");
                     printf("=================\n");
-                    generate_three_addr_code(root, NULL); // NULL means stdout
+                    generate_three_addr_code(compiler, root, NULL); // NULL means stdout
                 }
             }
         }
         
-        // Clean up
-        free_ast(root);
+        // Evaluate with the bytecode VM or the JIT if requested
+        if (evaluate) {
+            print_evaluation(compiler, root, evaluate);
+        }
+        
+        // Clean up: release every node of the expression at once
+        ast_arena_reset(&compiler->arena);
     } else {
         printf("\nError: Failed to parse expression\n");
     }
     
+    release_token_stream(compiler);
     fclose(input);
 }
 
@@ -233,6 +411,21 @@ int main(int argc, char** argv) {
     int gen_stack = 0;
     int gen_3addr = 0;
     int verbose = 0;
+    int batch = 0;
+    int use_flat = 0;
+    int evaluate = EVAL_NONE;
+    int optimize = 0;
+    int hash_consing = 0;
+    int jobs = 0;
+    int registers = 0;
+    int write_binary = 0;
+    int load = 0;
+    const char* cache_directory = NULL;
+    const char* socket_path = NULL;
+    int stream = 0;
+    uint64_t cache_limit = CACHE_DEFAULT_LIMIT;
+    int show_stats = 0;
+    int stats_json = 0;
     
     // Check for help option
     for (int i = 1; i < argc; i++) {
@@ -245,7 +438,11 @@ int main(int argc, char** argv) {
     // Parse command-line options
     int arg_index = 1;
     while (arg_index < argc && argv[arg_index][0] == '-') {
-        if (strcmp(argv[arg_index], "--stack") == 0) {
+        if (strcmp(argv[arg_index], "--") == 0) {
+            // End of options: the expression may start with a '-'
+            arg_index++;
+            break;
+        } else if (strcmp(argv[arg_index], "--stack") == 0) {
             gen_stack = 1;
             show_ast = 0; // Turn off default AST display
         } else if (strcmp(argv[arg_index], "--3addr") == 0) {
@@ -262,6 +459,85 @@ int main(int argc, char** argv) {
             show_tokens = 1;
             gen_stack = 1;
             gen_3addr = 1;
+        } else if (strcmp(argv[arg_index], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[arg_index], "--regs") == 0) {
+            registers = arg_index + 1 < argc ? atoi(argv[++arg_index]) : 0;
+            if (registers < 1) {
+                fprintf(stderr, "Invalid value for --regs (expected a register count)\n\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[arg_index], "--cse") == 0) {
+            hash_consing = 1;
+        } else if (strcmp(argv[arg_index], "-O") == 0) {
+            optimize = 1;
+        } else if (strcmp(argv[arg_index], "--eval") == 0) {
+            if (!evaluate) evaluate = EVAL_VM;
+        } else if (strcmp(argv[arg_index], "--jit") == 0) {
+            evaluate = EVAL_JIT;
+        } else if (strcmp(argv[arg_index], "--set") == 0) {
+            const char* binding = arg_index + 1 < argc ? argv[++arg_index] : "";
+            const char* equals = strchr(binding, '=');
+            size_t length = equals ? (size_t)(equals - binding) : 0;
+            if (!symbol_is_name(binding, length)) {
+                fprintf(stderr, "Invalid binding for --set: %s (expected name=value)\n\n", binding);
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (!symbol_bindings_set(&bindings, binding, length, atof(equals + 1))) {
+                fprintf(stderr, "Error: Out of memory\n");
+                return 1;
+            }
+        } else if (strcmp(argv[arg_index], "--jobs") == 0) {
+            jobs = arg_index + 1 < argc ? atoi(argv[++arg_index]) : 0;
+            if (jobs < 1) {
+                fprintf(stderr, "Invalid value for --jobs (expected a thread count)\n\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            batch = 1;
+        } else if (strcmp(argv[arg_index], "--binary") == 0) {
+            write_binary = 1;
+            batch = 1;
+        } else if (strcmp(argv[arg_index], "--load") == 0) {
+            load = 1;
+        } else if (strcmp(argv[arg_index], "--cache") == 0) {
+            cache_directory = arg_index + 1 < argc ? argv[++arg_index] : "";
+            if (!cache_directory[0]) {
+                fprintf(stderr, "Missing directory for --cache\n\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[arg_index], "--serve") == 0) {
+            socket_path = arg_index + 1 < argc ? argv[++arg_index] : "";
+            if (!socket_path[0]) {
+                fprintf(stderr, "Missing socket path for --serve\n\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[arg_index], "--stream") == 0) {
+            stream = 1;
+        } else if (strcmp(argv[arg_index], "--cache-size") == 0) {
+            cache_limit = arg_index + 1 < argc ? parse_size(argv[++arg_index]) : 0;
+            if (cache_limit == 0) {
+                fprintf(stderr, "Invalid value for --cache-size (expected a size like 512k or 64m)\n\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[arg_index], "--stats") == 0) {
+            show_stats = 1;
+        } else if (strcmp(argv[arg_index], "--stats=json") == 0) {
+            show_stats = 1;
+            stats_json = 1;
+        } else if (strcmp(argv[arg_index], "--flat") == 0) {
+            use_flat = 1;
+        } else if (strncmp(argv[arg_index], "--trace", 7) == 0 &&
+                   (argv[arg_index][7] == '\0' || argv[arg_index][7] == '=')) {
+            int level = argv[arg_index][7] == '=' ? atoi(argv[arg_index] + 8) : TRACE_RULES;
+            if (!trace_init(level, stderr)) {
+                fprintf(stderr, "Warning: tracing is not compiled in; rebuild with -DPARSEIQ_TRACE\n");
+            }
         } else {
             fprintf(stderr, "Unknown option: %s\n\n", argv[arg_index]);
             print_usage(argv[0]);
@@ -270,33 +546,142 @@ int main(int argc, char** argv) {
         arg_index++;
     }
     
+    BatchOptions options = {show_ast, gen_stack, gen_3addr, use_flat, evaluate != EVAL_NONE, optimize,
+                            hash_consing, registers, write_binary, &bindings, NULL, NULL};
+    CompileStats stats;
+    stats_init(&stats);
+    stats.enabled = 1;
+    if (show_stats) {
+        options.stats = &stats;
+    }
+    
+    if (socket_path) {
+        if (show_stats) {
+            fprintf(stderr, "Warning: --stats does not apply to --serve\n");
+        }
+        ServeOptions serve_options = {optimize, hash_consing, registers, 0, 0};
+        return serve(socket_path, &serve_options);
+    }
+    
+    if (stream) {
+        // The sections are the ones requested on the command line, the AST by default
+        uint16_t outputs = (show_ast ? SERVE_AST : 0) | (gen_stack ? SERVE_STACK : 0) |
+                           (gen_3addr ? SERVE_3ADDR : 0);
+        ServeOptions serve_options = {optimize, hash_consing, registers, show_stats, stats_json};
+        return serve_stream(fileno(stdin), fileno(stdout), outputs, &serve_options);
+    }
+    
+    if (load) {
+        // Every remaining argument is a binary file
+        if (arg_index >= argc) {
+            fprintf(stderr, "Error: --load needs at least one .pqb file\n");
+            return 1;
+        }
+        int status = 0;
+        for (; arg_index < argc; arg_index++) {
+            if (!process_binary(argv[arg_index], &options)) status = 1;
+        }
+        if (show_stats) stats_print(&stats, stderr, stats_json);
+        return status;
+    }
+    
+    if (batch) {
+        // Every remaining argument is an input file
+        if (jobs > 0 && arg_index >= argc) {
+            fprintf(stderr, "Error: --jobs needs at least one input file\n");
+            return 1;
+        }
+        
+        if (cache_directory) {
+            options.cache = cache_open(cache_directory, cache_limit);
+            if (!options.cache) return 1;
+        }
+        
+        int status = 0;
+        if (jobs > 0) {
+            status = process_batch_parallel((const char* const*)(argv + arg_index), argc - arg_index,
+                                            jobs, &options) ? 0 : 1;
+        } else {
+            Compiler* compiler = compiler_create();
+            if (compiler) {
+                ast_arena_set_hash_consing(&compiler->arena, hash_consing);
+                compiler->codegen.registers = registers;
+                compiler->stats.enabled = show_stats;
+                
+                // Batch mode reads each file in turn, or stdin without prompting
+                if (arg_index >= argc) {
+                    process_batch(compiler, NULL, &options);
+                }
+                for (; arg_index < argc; arg_index++) {
+                    process_batch(compiler, argv[arg_index], &options);
+                }
+                stats_add_arena(&compiler->stats, &compiler->arena);
+                stats_merge(&stats, &compiler->stats);
+                compiler_destroy(compiler);
+            } else {
+                fprintf(stderr, "Error: Out of memory\n");
+                status = 1;
+            }
+        }
+        
+        if (options.cache) {
+            if (!cache_save(options.cache)) status = 1;
+            if (verbose) cache_print_stats(options.cache, stdout);
+            cache_close(options.cache);
+        }
+        if (show_stats) stats_print(&stats, stderr, stats_json);
+        return status;
+    }
+    
+    if (cache_directory) {
+        fprintf(stderr, "Warning: --cache only applies to batch mode\n");
+    }
+    
+    // One compiler context holds all lexer, parser and code generator state
+    Compiler* compiler = compiler_create();
+    if (!compiler) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    ast_arena_set_hash_consing(&compiler->arena, hash_consing);
+    compiler->codegen.registers = registers;
+    compiler->stats.enabled = show_stats;
+    
     // Check if we have an input
     if (arg_index >= argc) {
-        // No input provided, read from stdin
-        printf("Enter an expression: ");
-        fflush(stdout);
+        // No input provided, read from stdin (prompting only a terminal)
+        if (isatty(fileno(stdin))) {
+            printf("Enter an expression: ");
+            fflush(stdout);
+        }
         
         // Read the expression from stdin
         char expr[1024];
         if (fgets(expr, sizeof(expr), stdin) == NULL) {
             fprintf(stderr, "Error reading input\n");
+            compiler_destroy(compiler);
             return 1;
         }
         
         // Process the expression
-        process_expression(expr, show_tokens, show_ast, gen_stack, gen_3addr, verbose);
+        process_expression(compiler, expr, show_tokens, show_ast, gen_stack, gen_3addr, verbose, evaluate, optimize);
     } else {
         // Check if the argument is a file or an expression
         FILE* test_file = fopen(argv[arg_index], "r");
         if (test_file) {
             // It's a file
             fclose(test_file);
-            process_file(argv[arg_index], show_tokens, show_ast, gen_stack, gen_3addr, verbose);
+            process_file(compiler, argv[arg_index], show_tokens, show_ast, gen_stack, gen_3addr, verbose, evaluate, optimize);
         } else {
             // It's an expression
-            process_expression(argv[arg_index], show_tokens, show_ast, gen_stack, gen_3addr, verbose);
+            process_expression(compiler, argv[arg_index], show_tokens, show_ast, gen_stack, gen_3addr, verbose, evaluate, optimize);
         }
     }
     
+    if (show_stats) {
+        stats_add_arena(&compiler->stats, &compiler->arena);
+        stats_print(&compiler->stats, stderr, stats_json);
+    }
+    compiler_destroy(compiler);
     return 0;
 }
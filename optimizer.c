@@ -0,0 +1,228 @@
+#include "optimizer.h"
+#include <math.h>
+
+// Largest |n| for which x^n becomes multiplications instead of a call to pow
+#define POWER_MULTIPLY_LIMIT 8
+
+static int is_constant(const ASTNode* node, double value) {
+    return node && node->type == NODE_NUMBER && node->data.value == value;
+}
+
+// A number node replacing `node`; input nodes are never modified
+static ASTNode* make_constant(ASTArena* arena, const ASTNode* node, double value) {
+    return create_number_node(arena, value, node->line, node->column);
+}
+
+// x^n (n >= 1) as multiplications by repeated squaring. Each square is one
+// node used twice, so three-address code computes it once; stack code
+// walks the tree and takes n - 1 multiplications.
+static ASTNode* multiply_power(ASTArena* arena, const ASTNode* node, ASTNode* base, unsigned n) {
+    ASTNode* result = NULL;
+    ASTNode* square = base;
+    for (;;) {
+        if (n & 1) {
+            result = result ? create_binary_node(arena, result, OP_MULTIPLY, square,
+                                                 node->line, node->column)
+                            : square;
+            if (!result) return NULL;
+        }
+        n >>= 1;
+        if (n == 0) return result;
+        square = create_binary_node(arena, square, OP_MULTIPLY, square, node->line, node->column);
+        if (!square) return NULL;
+    }
+}
+
+// Replace base^exponent by multiplications (and a reciprocal for a
+// negative exponent) when the exponent is a small integer; NULL if not
+static ASTNode* reduce_power(ASTArena* arena, const ASTNode* node, ASTNode* base, double exponent) {
+    double n = fabs(exponent);
+    if (n < 1.0 || n > POWER_MULTIPLY_LIMIT || n != floor(n)) return NULL;
+    
+    // The base is used more than once, which only costs nothing for a
+    // leaf: every walk of the tree (stack code, bytecode, comparisons)
+    // follows each use, so an expanded inner base would be evaluated n
+    // times, and nested powers would grow exponentially even when the
+    // squares are shared
+    if (base->type != NODE_VARIABLE && base->type != NODE_NUMBER) return NULL;
+    
+    ASTNode* product = multiply_power(arena, node, base, (unsigned)n);
+    if (product && exponent < 0) {
+        ASTNode* one = make_constant(arena, node, 1.0);
+        product = one ? create_binary_node(arena, one, OP_DIVIDE, product, node->line, node->column)
+                      : NULL;
+    }
+    return product;
+}
+
+// 1/divisor if it is exact, which makes x / divisor and x * (1/divisor)
+// equal for every x: the divisor is a power of two with a normal reciprocal
+static int exact_reciprocal(double divisor, double* reciprocal) {
+    int exponent;
+    if (fabs(frexp(divisor, &exponent)) != 0.5) return 0;
+    *reciprocal = 1.0 / divisor;
+    return isnormal(*reciprocal);
+}
+
+// Fold or simplify a binary node whose children have been optimized to left and right
+static ASTNode* simplify_node(ASTArena* arena, ASTNode* node, ASTNode* left, ASTNode* right,
+                              OptimizeStats* stats) {
+    OperatorType op = node->data.binary_op.operator;
+    if (left != node->data.binary_op.left || right != node->data.binary_op.right) {
+        node = create_binary_node(arena, left, op, right, node->line, node->column);
+    }
+    if (!left || !right) return node;
+    
+    // Constant folding
+    if (left->type == NODE_NUMBER && right->type == NODE_NUMBER) {
+        double a = left->data.value;
+        double b = right->data.value;
+        switch (op) {
+            case OP_ADD: stats->folded++; return make_constant(arena, node, a + b);
+            case OP_SUBTRACT: stats->folded++; return make_constant(arena, node, a - b);
+            case OP_MULTIPLY: stats->folded++; return make_constant(arena, node, a * b);
+            case OP_DIVIDE:
+                if (b == 0.0) return node; // Leave it for run time
+                stats->folded++;
+                return make_constant(arena, node, a / b);
+            case OP_POWER: stats->folded++; return make_constant(arena, node, pow(a, b));
+        }
+    }
+    
+    // Algebraic identities
+    switch (op) {
+        case OP_ADD:
+            if (is_constant(right, 0.0)) { stats->simplified++; return left; }
+            if (is_constant(left, 0.0)) { stats->simplified++; return right; }
+            break;
+        case OP_SUBTRACT:
+            if (is_constant(right, 0.0)) { stats->simplified++; return left; }
+            if (ast_equal(left, right)) { stats->simplified++; return make_constant(arena, node, 0.0); }
+            break;
+        case OP_MULTIPLY:
+            if (is_constant(right, 1.0)) { stats->simplified++; return left; }
+            if (is_constant(left, 1.0)) { stats->simplified++; return right; }
+            if ((is_constant(right, 0.0) && !ast_has_errors(left)) ||
+                (is_constant(left, 0.0) && !ast_has_errors(right))) {
+                stats->simplified++;
+                return make_constant(arena, node, 0.0);
+            }
+            break;
+        case OP_DIVIDE:
+            if (is_constant(right, 1.0)) { stats->simplified++; return left; }
+            break;
+        case OP_POWER:
+            if (is_constant(right, 1.0)) { stats->simplified++; return left; }
+            if (is_constant(right, 0.0) && !ast_has_errors(left)) {
+                stats->simplified++;
+                return make_constant(arena, node, 1.0);
+            }
+            break;
+    }
+    
+    // Strength reduction: cheaper operations for the same value
+    if (right->type == NODE_NUMBER) {
+        if (op == OP_POWER) {
+            ASTNode* product = reduce_power(arena, node, left, right->data.value);
+            if (product) { stats->reduced++; return product; }
+        } else if (op == OP_DIVIDE) {
+            double reciprocal;
+            if (exact_reciprocal(right->data.value, &reciprocal)) {
+                ASTNode* factor = make_constant(arena, right, reciprocal);
+                ASTNode* product = factor ? create_binary_node(arena, left, OP_MULTIPLY, factor,
+                                                               node->line, node->column)
+                                          : NULL;
+                if (product) { stats->reduced++; return product; }
+            }
+        }
+    }
+    
+    return node;
+}
+
+// Rebuild a node whose children have been optimized to first and second:
+// operators are simplified, statements only rebuilt if a child changed
+static ASTNode* rebuild_node(ASTArena* arena, ASTNode* node, ASTNode* first, ASTNode* second,
+                             OptimizeStats* stats) {
+    switch (node->type) {
+        case NODE_BINARY_OP:
+            return simplify_node(arena, node, first, second, stats);
+        case NODE_ASSIGN:
+            if (first == node->data.assign.value) return node;
+            return create_assign_node(arena, node->data.assign.symbol, node->data.assign.name,
+                                      node->data.assign.def, first, node->line, node->column);
+        case NODE_SEQUENCE:
+            if (first == node->data.sequence.first && second == node->data.sequence.second) return node;
+            return create_sequence_node(arena, first, second, node->line, node->column);
+        default:
+            return node;
+    }
+}
+
+static int has_children(const ASTNode* node) {
+    const ASTNode* first;
+    const ASTNode* second;
+    return node && ast_children(node, &first, &second) > 0;
+}
+
+// Optimize every inner node of a tree, children before their parent.
+// Frames keep the (mutable) nodes of the tree as const pointers; `other`
+// holds the optimized first child while the second one is worked on.
+static ASTNode* optimize_node(ASTArena* arena, ASTNode* root, OptimizeStats* stats) {
+    if (!has_children(root)) return root;
+    
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    if (!ast_walk_push(&stack, root, 0)) return root;
+    
+    ASTNode* result = NULL;  // Optimized form of the subtree finished last
+    while (stack.count > 0) {
+        ASTWalkFrame* frame = &stack.frames[stack.count - 1];
+        ASTNode* node = (ASTNode*)frame->node;
+        const ASTNode* first;
+        const ASTNode* second;
+        int children = ast_children(node, &first, &second);
+        
+        if (frame->state == 0) {
+            frame->state = 1;
+            if (has_children(first)) {
+                if (!ast_walk_push(&stack, first, 0)) break;
+                continue;
+            }
+            result = (ASTNode*)first;
+        }
+        if (frame->state == 1) {
+            frame->state = 2;
+            frame->other = result;
+            result = NULL;
+            if (children == 2) {
+                if (has_children(second)) {
+                    if (!ast_walk_push(&stack, second, 0)) break;
+                    continue;
+                }
+                result = (ASTNode*)second;
+            }
+        }
+        
+        result = rebuild_node(arena, node, (ASTNode*)frame->other, result, stats);
+        stack.count--;
+    }
+    
+    // Out of memory part way: the input tree is unchanged, so use it as is
+    if (stack.count > 0) result = root;
+    ast_walk_free(&stack);
+    return result;
+}
+
+ASTNode* optimize_ast(ASTArena* arena, ASTNode* node, OptimizeStats* stats) {
+    OptimizeStats local;
+    if (!stats) stats = &local;
+    
+    stats->folded = 0;
+    stats->simplified = 0;
+    stats->reduced = 0;
+    stats->nodes_before = ast_count_unique_nodes(node);
+    node = optimize_node(arena, node, stats);
+    stats->nodes_after = ast_count_unique_nodes(node);
+    return node;
+}
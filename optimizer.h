@@ -0,0 +1,33 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast.h"
+
+// Counters filled in by optimize_ast
+typedef struct {
+    size_t nodes_before;  // Distinct nodes of the input tree (shared ones count once)
+    size_t nodes_after;   // Distinct nodes of the optimized tree
+    int folded;           // Constant subtrees replaced by their value
+    int simplified;       // Algebraic identities applied
+    int reduced;          // Powers and divisions replaced by cheaper operations
+} OptimizeStats;
+
+/* Fold constant subtrees and apply algebraic identities
+ * (x+0, 0+x, x-0, x*1, 1*x, x*0, 0*x, x/1, x^1, x^0, x-x).
+ * The identities assume finite operands. Input nodes are never modified:
+ * changed subtrees are rebuilt from the given arena.
+ * Division by a constant zero is never folded.
+ *
+ * Strength reduction then replaces x^n for integers 1 <= |n| <= 8 by
+ * multiplications (1 / x^n for negative n; the result may differ from pow
+ * in the last bit) and x / c by x * (1/c) when c is a power of two, which
+ * is exact. Only powers of a variable (or number) are reduced: an inner
+ * base would be evaluated once per use by every tree walk.
+ * @param arena The arena new nodes are allocated from
+ * @param node The root node of the AST
+ * @param stats Receives the counters (may be NULL)
+ * @return The root of the optimized tree
+ */
+ASTNode* optimize_ast(ASTArena* arena, ASTNode* node, OptimizeStats* stats);
+
+#endif // OPTIMIZER_H
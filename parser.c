@@ -1,141 +1,449 @@
 #include "parser.h"
+#include "lexer.h"
+#include "compiler.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
-
-static TokenType current_token;
-static TokenValue current_value;
+#include <string.h>
 
 // Forward declaration of static function
-static TokenType next_token();
+static TokenType next_token(Compiler* compiler);
 
-void set_token_stream(FILE* input) {
-    // Call the lexer's set_input_file function
-    extern void set_input_file(FILE* file);
-    set_input_file(input);
+void set_token_stream(Compiler* compiler, FILE* input) {
+    uint64_t start = stats_begin(&compiler->stats);
+    set_input_file(compiler, input);
+    stats_end(&compiler->stats, STATS_INPUT, start);
 }
 
-void parser_reset() {
-    current_token = TOKEN_UNKNOWN;
-    next_token(); // Get the first token to start parsing
+void set_token_string(Compiler* compiler, const char* text) {
+    set_input_string(compiler, text, strlen(text));
 }
 
-// Get the next token from our lexer
-static TokenType next_token() {
-    extern int yylex();
-    current_token = yylex();
-    current_value = yylval;
-    return current_token;
+void set_token_buffer(Compiler* compiler, const char* text, size_t length) {
+    set_input_string(compiler, text, length);
 }
 
-// Forward declarations
-static ASTNode* parse_term();
-static ASTNode* parse_factor();
+void release_token_stream(Compiler* compiler) {
+    release_input(compiler);
+}
 
-ASTNode* parse_expression() {
-    printf("DEBUG: Entering parse_expression, current_token = %d\n", current_token);
-    ASTNode* left = parse_term();
-    printf("DEBUG: In parse_expression after parse_term, current_token = %d\n", current_token);
+void set_newline_separated(Compiler* compiler, int enabled) {
+    set_newline_mode(compiler, enabled);
+}
+
+void parser_init(ParserState* parser) {
+    memset(parser, 0, sizeof(*parser));
+    parser->current_token = TOKEN_UNKNOWN;
+}
+
+void parser_free(ParserState* parser) {
+    free(parser->tokens);
+    free(parser->operands);
+    free(parser->operators);
+    free(parser->definitions);
+    free(parser->def_symbols);
+    parser_init(parser);
+}
+
+void parser_reset(Compiler* compiler) {
+    compiler->parser.current_token = TOKEN_UNKNOWN;
+    compiler->parser.token_count = 0;
+    compiler->parser.token_index = 0;
+    next_token(compiler); // Get the first token to start parsing
+}
+
+// Get the next token: a read-ahead one if any, else from our lexer
+static TokenType next_token(Compiler* compiler) {
+    ParserState* ps = &compiler->parser;
+    if (ps->token_index < ps->token_count) {
+        const Token* token = &ps->tokens[ps->token_index++];
+        ps->current_token = token->type;
+        ps->current_value = token->value;
+        ps->line = token->line;
+        ps->column = token->column;
+        return ps->current_token;
+    }
+    ps->current_token = yylex(compiler);
+    ps->current_value = compiler->lexer.yylval;
+    ps->line = compiler->lexer.yylineno;
+    ps->column = compiler->lexer.yycolumn;
+    return ps->current_token;
+}
+
+int parser_begin_statement(Compiler* compiler) {
+    // Skip blank lines between statements
+    while (compiler->parser.current_token == TOKEN_NEWLINE) {
+        next_token(compiler);
+    }
+    return compiler->parser.current_token != TOKEN_EOF;
+}
+
+int parser_end_statement(Compiler* compiler) {
+    TokenType token = compiler->parser.current_token;
+    int clean = (token == TOKEN_NEWLINE || token == TOKEN_EOF);
     
-    if (left == NULL) {
-        printf("DEBUG: parse_term returned NULL\n");
-        return NULL;
+    // Discard whatever is left of the statement so the next one starts fresh
+    while (token != TOKEN_NEWLINE && token != TOKEN_EOF) {
+        token = next_token(compiler);
     }
+    return clean;
+}
+
+// Make room for one more read-ahead token
+static int reserve_token(ParserState* ps) {
+    if (ps->token_count < ps->token_capacity) return 1;
+    uint32_t capacity = ps->token_capacity ? ps->token_capacity * 2 : 64;
+    Token* tokens = (Token*)realloc(ps->tokens, capacity * sizeof(Token));
+    if (!tokens) return 0;
+    ps->tokens = tokens;
+    ps->token_capacity = capacity;
+    return 1;
+}
+
+// Append the current token to the read-ahead buffer (room is reserved)
+static void push_current_token(ParserState* ps) {
+    Token* token = &ps->tokens[ps->token_count++];
+    token->type = ps->current_token;
+    token->value = ps->current_value;
+    token->line = ps->line;
+    token->column = ps->column;
+    ps->token_index = ps->token_count; // Already consumed while reading ahead
+}
+
+int parser_read_statement(Compiler* compiler, const Token** tokens, uint32_t* count) {
+    ParserState* ps = &compiler->parser;
+    ps->token_count = 0;
+    ps->token_index = 0;
     
-    while (current_token == TOKEN_PLUS || current_token == TOKEN_MINUS) {
-        OperatorType op = (current_token == TOKEN_PLUS) ? OP_ADD : OP_SUBTRACT;
-        printf("DEBUG: In parse_expression loop, found %s\n", (current_token == TOKEN_PLUS) ? "+" : "-");
-        next_token();
-        ASTNode* right = parse_term();
-        
-        if (right == NULL) {
-            printf("DEBUG: Right side of expression is NULL\n");
-            free_ast(left);
-            return NULL;
+    // Buffer the current token, then scan on to the end of the statement.
+    // Room is reserved before scanning so no scanned token is ever dropped.
+    int ok = reserve_token(ps);
+    if (ok) push_current_token(ps);
+    TokenType token = ps->current_token;
+    while (ok && token != TOKEN_NEWLINE && token != TOKEN_EOF) {
+        ok = reserve_token(ps);
+        if (ok) {
+            token = next_token(compiler);
+            push_current_token(ps);
         }
-        
-        left = create_binary_node(left, op, right, left->line, left->column);
-        printf("DEBUG: Created binary node for %s\n", (op == OP_ADD) ? "+" : "-");
     }
     
-    printf("DEBUG: Exiting parse_expression, returning node of type %d\n", left ? left->type : -1);
-    return left;
+    // Back to the first token; next_token replays the others
+    if (ps->token_count > 0) {
+        const Token* first = &ps->tokens[0];
+        ps->current_token = first->type;
+        ps->current_value = first->value;
+        ps->line = first->line;
+        ps->column = first->column;
+        ps->token_index = 1;
+    }
+    
+    *tokens = ps->tokens;
+    *count = ok ? ps->token_count - 1 : 0;
+    return ok;
+}
+
+// Operator stack entries: the token of a binary operator, or of a prefix
+// operator with PREFIX set, or OPEN_GROUP for a '(' that is not closed yet
+#define PREFIX 0x80
+#define OPEN_GROUP 0xFF
+
+// Make room for more operands; the stacks are kept in the parser state
+// for the next expression, so this is rare
+static ASTNode** grow_operands(ParserState* ps) {
+    uint32_t capacity = ps->operand_capacity ? ps->operand_capacity * 2 : 64;
+    ASTNode** operands = (ASTNode**)realloc(ps->operands, capacity * sizeof(ASTNode*));
+    if (!operands) return NULL;
+    ps->operands = operands;
+    ps->operand_capacity = capacity;
+    return operands;
+}
+
+static uint8_t* grow_operators(ParserState* ps) {
+    uint32_t capacity = ps->operator_capacity ? ps->operator_capacity * 2 : 64;
+    uint8_t* operators = (uint8_t*)realloc(ps->operators, capacity);
+    if (!operators) return NULL;
+    ps->operators = operators;
+    ps->operator_capacity = capacity;
+    return operators;
+}
+
+// An operator of the grammar; precedence 0 means the token is not one
+typedef struct {
+    uint8_t precedence;
+    uint8_t right;            // Groups to the right: a ^ b ^ c is a ^ (b ^ c)
+    OperatorType op;
+} OperatorInfo;
+
+// Operators by token. A new operator is one entry here (and a token).
+static const OperatorInfo binary_operators[TOKEN_EOF + 1] = {
+    [TOKEN_PLUS]  = { 1, 0, OP_ADD },
+    [TOKEN_MINUS] = { 1, 0, OP_SUBTRACT },
+    [TOKEN_MUL]   = { 2, 0, OP_MULTIPLY },
+    [TOKEN_DIV]   = { 2, 0, OP_DIVIDE },
+    [TOKEN_POW]   = { 4, 1, OP_POWER },
+};
+
+// Prefix operators bind tighter than * and / but not than ^: -a ^ 2 is -(a ^ 2)
+static const OperatorInfo prefix_operators[TOKEN_EOF + 1] = {
+    [TOKEN_PLUS]  = { 3, 0, OP_ADD },
+    [TOKEN_MINUS] = { 3, 0, OP_SUBTRACT },
+};
+
+static const OperatorInfo* stack_operator(uint8_t entry) {
+    return (entry & PREFIX) ? &prefix_operators[entry & ~PREFIX] : &binary_operators[entry];
+}
+
+// Apply a prefix operator. There is no unary node: -x becomes -1 * x
+// (exact negation, unlike 0 - x, which gives +0 for x = 0), a negated
+// number becomes a negative number and +x is x.
+static ASTNode* apply_prefix(ASTArena* arena, OperatorType op, ASTNode* operand) {
+    if (op == OP_ADD) return operand;
+    if (operand->type == NODE_NUMBER) {
+        return create_number_node(arena, -operand->data.value, operand->line, operand->column);
+    }
+    ASTNode* minus_one = create_number_node(arena, -1.0, operand->line, operand->column);
+    if (!minus_one) return NULL;
+    return create_binary_node(arena, minus_one, OP_MULTIPLY, operand, operand->line, operand->column);
 }
 
-static ASTNode* parse_term() {
-    printf("DEBUG: Entering parse_term, current_token = %d\n", current_token);
-    ASTNode* left = parse_factor();
+// A number or a variable; any other token gives an error node and is not consumed
+static ASTNode* parse_operand(Compiler* compiler) {
+    const ParserState* ps = &compiler->parser;
+    ASTNode* node;
     
-    if (left == NULL) {
-        printf("DEBUG: parse_factor returned NULL in parse_term\n");
-        return NULL;
+    switch (ps->current_token) {
+        case TOKEN_INT:
+            TRACE(TRACE_RULES, "Found INTEGER: %d", ps->current_value.ival);
+            node = create_number_node(&compiler->arena, ps->current_value.ival, ps->line, ps->column);
+            break;
+        case TOKEN_FLOAT:
+            TRACE(TRACE_RULES, "Found FLOAT: %f", ps->current_value.fval);
+            node = create_number_node(&compiler->arena, ps->current_value.fval, ps->line, ps->column);
+            break;
+        case TOKEN_VARIABLE: {
+            uint32_t symbol = ps->current_value.symbol;
+            TRACE(TRACE_RULES, "Found VARIABLE: %s", compiler->symbols.names[symbol]);
+            uint32_t def = symbol < ps->definition_capacity ? ps->definitions[symbol] : AST_NO_DEF;
+            node = create_variable_node(&compiler->arena, symbol, compiler->symbols.names[symbol],
+                                        def, ps->line, ps->column);
+            break;
+        }
+        default:
+            TRACE(TRACE_RULES, "Unexpected token in operand position: %d", ps->current_token);
+            return create_error_node(&compiler->arena, ps->line, ps->column);
     }
     
-    printf("DEBUG: In parse_term after parse_factor, current_token = %d\n", current_token);
+    next_token(compiler);
+    return node;
+}
+
+// Precedence climbing over explicit operand and operator stacks, so neither
+// long chains nor deep parentheses use the C stack. Each token is looked
+// at once; the tables above give the precedence and grouping of the
+// operators, highest binding first:
+//   ^        right
+//   - +      prefix
+//   * /      left
+//   + -      left
+// The stacks are used through locals, as next_token may change the
+// parser state as far as the compiler knows.
+static ASTNode* parse_operators(Compiler* compiler) {
+    ParserState* ps = &compiler->parser;
+    ASTArena* arena = &compiler->arena;
+    ASTNode** operands = ps->operands;
+    uint8_t* operators = ps->operators;
+    uint32_t operand_count = 0;
+    uint32_t operator_count = 0;
+    TRACE(TRACE_RULES, "Entering parse_expression, current_token = %d", ps->current_token);
     
-    while (current_token == TOKEN_MUL || current_token == TOKEN_DIV) {
-        OperatorType op = (current_token == TOKEN_MUL) ? OP_MULTIPLY : OP_DIVIDE;
-        printf("DEBUG: In parse_term loop, found %s\n", (current_token == TOKEN_MUL) ? "*" : "/");
-        next_token();
-        ASTNode* right = parse_factor();
-        
-        if (right == NULL) {
-            printf("DEBUG: Right side of term is NULL\n");
-            free_ast(left);
-            return NULL;
+// Replace the operator on top of the stack and its operands by its node
+#define REDUCE() do { \
+        uint8_t entry_ = operators[--operator_count]; \
+        OperatorType op_ = stack_operator(entry_)->op; \
+        ASTNode* right_ = operands[--operand_count]; \
+        ASTNode* node_; \
+        if (entry_ & PREFIX) { \
+            node_ = apply_prefix(arena, op_, right_); \
+            operand_count++; \
+        } else { \
+            ASTNode* left_ = operands[operand_count - 1]; \
+            node_ = create_binary_node(arena, left_, op_, right_, left_->line, left_->column); \
+        } \
+        if (!node_) return NULL; \
+        operands[operand_count - 1] = node_; \
+        TRACE(TRACE_RULES, "Created node for operator %d", op_); \
+    } while (0)
+    
+    for (;;) {
+        // An operand, after any number of opening parentheses and prefix operators
+        for (;;) {
+            uint8_t entry;
+            if (ps->current_token == TOKEN_LPAREN) {
+                TRACE(TRACE_RULES, "Found LPAREN");
+                entry = OPEN_GROUP;
+            } else if (prefix_operators[ps->current_token].precedence) {
+                TRACE(TRACE_RULES, "Found prefix operator %d", ps->current_token);
+                entry = (uint8_t)(ps->current_token | PREFIX);
+            } else {
+                break;
+            }
+            if (operator_count == ps->operator_capacity && !(operators = grow_operators(ps))) return NULL;
+            operators[operator_count++] = entry;
+            next_token(compiler);
         }
+        ASTNode* operand = parse_operand(compiler);
+        if (!operand) return NULL;
+        if (operand_count == ps->operand_capacity && !(operands = grow_operands(ps))) return NULL;
+        operands[operand_count++] = operand;
         
-        left = create_binary_node(left, op, right, left->line, left->column);
-        printf("DEBUG: Created binary node for %s\n", (op == OP_MULTIPLY) ? "*" : "/");
+        // Then either an operator, which needs another operand, or the end
+        // of the innermost group (or of the expression)
+        for (;;) {
+            const OperatorInfo* info = &binary_operators[ps->current_token];
+            if (info->precedence) {
+                // Operators bound tighter go first; equal ones too unless
+                // the new one groups to the right
+                int bound = info->precedence + info->right;
+                while (operator_count > 0 && operators[operator_count - 1] != OPEN_GROUP &&
+                       stack_operator(operators[operator_count - 1])->precedence >= bound) {
+                    REDUCE();
+                }
+                if (operator_count == ps->operator_capacity && !(operators = grow_operators(ps))) return NULL;
+                operators[operator_count++] = (uint8_t)ps->current_token;
+                next_token(compiler);
+                break;
+            }
+            
+            while (operator_count > 0 && operators[operator_count - 1] != OPEN_GROUP) {
+                REDUCE();
+            }
+            if (operator_count == 0) {
+                TRACE(TRACE_RULES, "Exiting parse_expression, returning node of type %d",
+                      operands[0]->type);
+                return operands[0];
+            }
+            
+            operator_count--;
+            if (ps->current_token == TOKEN_RPAREN) {
+                TRACE(TRACE_RULES, "Found matching RPAREN");
+                next_token(compiler);
+            } else {
+                // Error: expected ')'; the group becomes an error node
+                TRACE(TRACE_RULES, "Missing RPAREN, found token = %d", ps->current_token);
+                ASTNode* error = create_error_node(arena, ps->line, ps->column);
+                if (!error) return NULL;
+                operands[operand_count - 1] = error;
+            }
+        }
+    }
+#undef REDUCE
+}
+
+// Forget the definitions of the last program
+static void clear_definitions(ParserState* ps) {
+    for (uint32_t d = 0; d < ps->def_count; d++) {
+        ps->definitions[ps->def_symbols[d]] = AST_NO_DEF;
+    }
+    ps->def_count = 0;
+}
+
+// Number a new definition of symbol, which later reads refer to;
+// AST_NO_DEF if out of memory
+static uint32_t add_definition(ParserState* ps, const SymbolTable* symbols, uint32_t symbol) {
+    if (symbol >= ps->definition_capacity) {
+        uint32_t capacity = symbols->capacity;
+        uint32_t* definitions = (uint32_t*)realloc(ps->definitions, capacity * sizeof(uint32_t));
+        if (!definitions) return AST_NO_DEF;
+        for (uint32_t i = ps->definition_capacity; i < capacity; i++) definitions[i] = AST_NO_DEF;
+        ps->definitions = definitions;
+        ps->definition_capacity = capacity;
     }
+    if (ps->def_count == ps->def_capacity) {
+        uint32_t capacity = ps->def_capacity ? ps->def_capacity * 2 : 16;
+        uint32_t* def_symbols = (uint32_t*)realloc(ps->def_symbols, capacity * sizeof(uint32_t));
+        if (!def_symbols) return AST_NO_DEF;
+        ps->def_symbols = def_symbols;
+        ps->def_capacity = capacity;
+    }
+    uint32_t def = ps->def_count++;
+    ps->def_symbols[def] = symbol;
+    ps->definitions[symbol] = def;
+    return def;
+}
+
+// An expression, or an assignment: a variable followed by '=' is only
+// known to be a target once the '=' is seen, so the statement is parsed
+// as an expression first
+static ASTNode* parse_statement(Compiler* compiler) {
+    ParserState* ps = &compiler->parser;
+    int starts_with_variable = ps->current_token == TOKEN_VARIABLE;
+    ASTNode* node = parse_operators(compiler);
+    if (!node || ps->current_token != TOKEN_ASSIGN) return node;
+    
+    if (!starts_with_variable || node->type != NODE_VARIABLE) {
+        TRACE(TRACE_RULES, "Assignment to something other than a variable");
+        return create_error_node(&compiler->arena, ps->line, ps->column);
+    }
+    next_token(compiler);
     
-    printf("DEBUG: Exiting parse_term, returning node of type %d\n", left ? left->type : -1);
-    return left;
+    // The value still reads the previous definition: x = x + 1
+    ASTNode* value = parse_operators(compiler);
+    if (!value) return NULL;
+    uint32_t symbol = node->data.variable.symbol;
+    uint32_t def = add_definition(ps, &compiler->symbols, symbol);
+    if (def == AST_NO_DEF) return NULL;
+    TRACE(TRACE_RULES, "Created assignment %u to %s", def, node->data.variable.name);
+    return create_assign_node(&compiler->arena, symbol, node->data.variable.name, def, value,
+                              node->line, node->column);
 }
 
-static ASTNode* parse_factor() {
-    printf("DEBUG: Entering parse_factor, current_token = %d\n", current_token);
+// Statements separated by ';' (a trailing one is allowed), chained into
+// sequence nodes leaning left
+static ASTNode* parse_statements(Compiler* compiler) {
+    ParserState* ps = &compiler->parser;
+    clear_definitions(ps);
     
-    if (current_token == TOKEN_INT) {
-        printf("DEBUG: Found INTEGER: %d\n", current_value.ival);
-        ASTNode* node = create_number_node(current_value.ival, yylineno, yycolumn);
-        next_token();
-        printf("DEBUG: Exiting parse_factor with INTEGER node, next token = %d\n", current_token);
-        return node;
-    } else if (current_token == TOKEN_FLOAT) {
-        printf("DEBUG: Found FLOAT: %f\n", current_value.fval);
-        ASTNode* node = create_number_node(current_value.fval, yylineno, yycolumn);
-        next_token();
-        printf("DEBUG: Exiting parse_factor with FLOAT node, next token = %d\n", current_token);
-        return node;
-    } else if (current_token == TOKEN_VARIABLE) {
-        printf("DEBUG: Found VARIABLE: %c\n", current_value.cval);
-        ASTNode* node = create_variable_node(current_value.cval, yylineno, yycolumn);
-        next_token();
-        printf("DEBUG: Exiting parse_factor with VARIABLE node, next token = %d\n", current_token);
-        return node;
-    } else if (current_token == TOKEN_LPAREN) {
-        printf("DEBUG: Found LPAREN\n");
-        next_token();
-        ASTNode* node = parse_expression();
-        if (node == NULL) {
-            printf("DEBUG: Expression inside parentheses is NULL\n");
-            return NULL;
-        }
+    ASTNode* program = NULL;
+    for (;;) {
+        ASTNode* statement = parse_statement(compiler);
+        if (!statement) return NULL;
+        program = program ? create_sequence_node(&compiler->arena, program, statement,
+                                                 program->line, program->column)
+                          : statement;
+        if (!program || ps->current_token != TOKEN_SEMICOLON) return program;
         
-        if (current_token == TOKEN_RPAREN) {
-            printf("DEBUG: Found matching RPAREN\n");
-            next_token();
-        } else {
-            printf("DEBUG: Missing RPAREN, found token = %d\n", current_token);
-            // Error: expected ')'
-            free_ast(node);
-            return create_error_node(yylineno, yycolumn);
-        }
-        printf("DEBUG: Exiting parse_factor with parenthesized expression, next token = %d\n", current_token);
-        return node;
-    } else {
-        printf("DEBUG: Unexpected token in parse_factor: %d\n", current_token);
-        // Error: unexpected token
-        return create_error_node(yylineno, yycolumn);
+        next_token(compiler);
+        if (ps->current_token == TOKEN_NEWLINE || ps->current_token == TOKEN_EOF) return program;
     }
 }
+
+// Run a parse function, timing it for --stats
+static ASTNode* timed_parse(Compiler* compiler, ASTNode* (*parse)(Compiler*)) {
+    CompileStats* stats = &compiler->stats;
+    if (!stats->enabled) {
+        return parse(compiler);
+    }
+    
+    // Time spent in the lexer is its own phase
+    uint64_t lex_before = stats->phase_ns[STATS_LEX];
+    uint64_t start = stats_clock_ns();
+    ASTNode* root = parse(compiler);
+    stats_end(stats, STATS_PARSE, start);
+    stats->phase_ns[STATS_PARSE] -= stats->phase_ns[STATS_LEX] - lex_before;
+    return root;
+}
+
+// One expression, in which every variable is an input
+static ASTNode* parse_lone_expression(Compiler* compiler) {
+    clear_definitions(&compiler->parser);
+    return parse_operators(compiler);
+}
+
+ASTNode* parse_expression(Compiler* compiler) {
+    return timed_parse(compiler, parse_lone_expression);
+}
+
+ASTNode* parse_program(Compiler* compiler) {
+    return timed_parse(compiler, parse_statements);
+}
@@ -1,11 +1,89 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stdint.h>
+#include <stdio.h>
 #include "ast.h"
 #include "tokens.h"
 
-ASTNode* parse_expression();
-void set_token_stream(FILE* input);
-void parser_reset();
+typedef struct Compiler Compiler;
+
+// Parser state, owned by a Compiler
+typedef struct {
+    TokenType current_token;
+    TokenValue current_value;
+    int line;                 // Scanner position of the current token
+    int column;
+    
+    // Tokens read ahead by parser_read_statement, replayed before scanning on
+    Token* tokens;
+    uint32_t token_count;
+    uint32_t token_capacity;
+    uint32_t token_index;
+    
+    // Explicit stacks of parse_expression, kept for the next expression
+    ASTNode** operands;
+    uint32_t operand_capacity;
+    uint8_t* operators;       // OperatorType values and '(' markers
+    uint32_t operator_capacity;
+    
+    // Definitions of the program being parsed: the latest one of every
+    // assigned variable by symbol ID (AST_NO_DEF if none), and the symbol
+    // of every definition, which clears them again for the next program
+    uint32_t* definitions;
+    uint32_t definition_capacity;
+    uint32_t* def_symbols;
+    uint32_t def_count;
+    uint32_t def_capacity;
+} ParserState;
+
+void parser_init(ParserState* parser);
+void parser_free(ParserState* parser);
+
+/* Parse one expression; nodes are allocated from the compiler's arena */
+ASTNode* parse_expression(Compiler* compiler);
+
+/* Parse one program: statements separated by ';' (see ast.h), up to the
+ * end of the input, a newline in newline-separated mode, or the first
+ * token that does not continue it. A lone expression is a program of one
+ * statement and parses to the same tree as parse_expression.
+ * An assignment to anything but a variable is an error node.
+ */
+ASTNode* parse_program(Compiler* compiler);
+void set_token_stream(Compiler* compiler, FILE* input);
+
+/* Scan a string in place; it must stay alive until parsing is done */
+void set_token_string(Compiler* compiler, const char* text);
+
+/* Scan `length` bytes in place; they need not be NUL-terminated */
+void set_token_buffer(Compiler* compiler, const char* text, size_t length);
+
+/* Release the input buffer (file mapping or stream chunk) of the lexer */
+void release_token_stream(Compiler* compiler);
+void parser_reset(Compiler* compiler);
+
+/* Treat '\n' as a statement separator instead of whitespace (batch mode) */
+void set_newline_separated(Compiler* compiler, int enabled);
+
+/* Skip blank lines before the next statement
+ * @return 1 if a statement follows, 0 at end of input
+ */
+int parser_begin_statement(Compiler* compiler);
+
+/* Discard any tokens left on the current statement
+ * @return 1 if the statement ended cleanly, 0 if trailing tokens were skipped
+ */
+int parser_end_statement(Compiler* compiler);
+
+/* Scan the rest of the current statement ahead, up to and including the
+ * NEWLINE or EOF ending it. Parsing then replays these tokens, so the
+ * statement can be inspected (e.g. hashed) before it is parsed.
+ * Call it at the start of a statement (after parser_begin_statement).
+ * @param tokens Set to the statement's tokens, starting with the current one
+ * @param count Set to the number of tokens, without the terminator
+ * @return 1 on success, 0 if out of memory (the tokens read so far are
+ *         still replayed)
+ */
+int parser_read_statement(Compiler* compiler, const Token** tokens, uint32_t* count);
 
 #endif // PARSER_H
@@ -0,0 +1,627 @@
+#define _POSIX_C_SOURCE 200809L // fileno
+#include "serialize.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define BINARY_BYTE_ORDER 0x0102
+
+// The on-disk records are the in-memory structs, so their layout is part
+// of the format: changing any of these requires a new BINARY_VERSION
+_Static_assert(sizeof(BinaryHeader) == 32, "BinaryHeader layout");
+_Static_assert(sizeof(BinaryNode) == 32, "BinaryNode layout");
+_Static_assert(sizeof(BinaryEntry) == 112, "BinaryEntry layout");
+_Static_assert(sizeof(IROperand) == 8, "IROperand layout");
+_Static_assert(sizeof(IRInstr) == 28, "IRInstr layout");
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+void binary_writer_init(BinaryWriter* writer) {
+    writer->data = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+    writer->entries = NULL;
+    writer->entry_count = 0;
+    writer->entry_capacity = 0;
+    flat_ast_init(&writer->flat);
+    bytecode_init(&writer->bc);
+    symbol_table_init(&writer->names);
+}
+
+void binary_writer_free(BinaryWriter* writer) {
+    free(writer->data);
+    free(writer->entries);
+    flat_ast_free(&writer->flat);
+    bytecode_free(&writer->bc);
+    symbol_table_free(&writer->names);
+    binary_writer_init(writer);
+}
+
+// Reserve a zeroed, 8-byte aligned section and return its offset in data
+static int reserve_section(BinaryWriter* writer, size_t bytes, uint64_t* offset) {
+    size_t start = align8(writer->length);
+    size_t end = start + bytes;
+    if (end > writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity : 64 * 1024;
+        while (capacity < end) capacity *= 2;
+        uint8_t* data = (uint8_t*)realloc(writer->data, capacity);
+        if (!data) return 0;
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    memset(writer->data + writer->length, 0, end - writer->length);
+    writer->length = end;
+    *offset = start;
+    return 1;
+}
+
+static int append_section(BinaryWriter* writer, const void* bytes, size_t size, uint64_t* offset) {
+    if (!reserve_section(writer, size, offset)) return 0;
+    if (size) memcpy(writer->data + *offset, bytes, size);
+    return 1;
+}
+
+// ID in the expression's names of a variable of the compiler's symbol table
+static uint32_t local_symbol(const BinaryWriter* writer, const SymbolTable* symbols, uint32_t symbol) {
+    const char* name = symbols->names[symbol];
+    return symbol_find(&writer->names, name, strlen(name));
+}
+
+// Copy an operand field by field so padding bytes stay zero
+static void store_operand(const BinaryWriter* writer, const SymbolTable* symbols,
+                          IROperand* dst, IROperand src) {
+    dst->kind = src.kind;
+    dst->index = src.kind == IR_VAR ? local_symbol(writer, symbols, src.index) : src.index;
+}
+
+// Renumber the variables of bytecode copied into the file to the expression's names
+static void store_loads(const BinaryWriter* writer, const SymbolTable* symbols,
+                        uint8_t* code, uint32_t length) {
+    uint32_t pc = 0;
+    while (pc < length) {
+        uint8_t op = code[pc++];
+        uint8_t* operand = NULL;
+        if (op == BC_LOAD) {
+            operand = code + pc;
+        } else if (op == BC_STORE || op == BC_LOCAL) {
+            operand = code + pc + sizeof(uint32_t); // After the slot number
+            pc += sizeof(uint32_t);
+        }
+        if (operand) {
+            uint32_t symbol;
+            memcpy(&symbol, operand, sizeof(uint32_t));
+            symbol = local_symbol(writer, symbols, symbol);
+            memcpy(operand, &symbol, sizeof(uint32_t));
+        }
+        if (op == BC_PUSH || op == BC_LOAD || op == BC_STORE || op == BC_LOCAL) {
+            pc += sizeof(uint32_t);
+        }
+    }
+}
+
+// Names section: offsets of the names, then the NUL-terminated names
+static int store_names(BinaryWriter* writer, BinaryEntry* entry) {
+    const SymbolTable* names = &writer->names;
+    size_t size = (size_t)names->count * sizeof(uint32_t);
+    for (uint32_t i = 0; i < names->count; i++) {
+        size += strlen(names->names[i]) + 1;
+    }
+    if (size > UINT32_MAX || !reserve_section(writer, size, &entry->names_offset)) return 0;
+
+    uint8_t* section = writer->data + entry->names_offset;
+    uint32_t offset = names->count * (uint32_t)sizeof(uint32_t);
+    for (uint32_t i = 0; i < names->count; i++) {
+        size_t length = strlen(names->names[i]) + 1;
+        memcpy(section + i * sizeof(uint32_t), &offset, sizeof(uint32_t));
+        memcpy(section + offset, names->names[i], length);
+        offset += (uint32_t)length;
+    }
+    entry->name_count = names->count;
+    entry->names_size = (uint32_t)size;
+    return 1;
+}
+
+int binary_writer_add(BinaryWriter* writer, Compiler* compiler, const ASTNode* root) {
+    if (writer->entry_count == writer->entry_capacity) {
+        uint32_t capacity = writer->entry_capacity ? writer->entry_capacity * 2 : 256;
+        BinaryEntry* entries = (BinaryEntry*)realloc(writer->entries, capacity * sizeof(BinaryEntry));
+        if (!entries) return 0;
+        writer->entries = entries;
+        writer->entry_capacity = capacity;
+    }
+
+    // Compile every form first so a failure leaves the writer unchanged
+    IRProgram* ir = &compiler->codegen.ir;
+    int registers = compiler->codegen.registers;
+    if (!flat_ast_from_tree(&writer->flat, root) ||
+        !bytecode_compile(&writer->bc, root) ||
+        !(registers > 0 ? generate_register_ir(compiler, root, registers, ir)
+                        : generate_three_addr_ir(compiler, root, ir))) {
+        return 0;
+    }
+
+    BinaryEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    size_t saved_length = writer->length;
+
+    // AST nodes in postorder; variables are numbered as they first appear
+    const SymbolTable* symbols = &compiler->symbols;
+    const FlatAST* flat = &writer->flat;
+    symbol_table_clear(&writer->names);
+    entry.node_count = flat->count;
+    if (!reserve_section(writer, flat->count * sizeof(BinaryNode), &entry.nodes_offset)) goto fail;
+    BinaryNode* nodes = (BinaryNode*)(writer->data + entry.nodes_offset);
+    for (uint32_t i = 0; i < flat->count; i++) {
+        nodes[i].value = flat->values[i];
+        nodes[i].left = flat->left[i];
+        nodes[i].right = flat->right[i];
+        nodes[i].line = flat->lines[i];
+        nodes[i].column = flat->columns[i];
+        nodes[i].kind = flat->kinds[i];
+        nodes[i].op = flat->ops[i];
+        if (flat->kinds[i] == NODE_VARIABLE || flat->kinds[i] == NODE_ASSIGN) {
+            const char* name = symbols->names[flat->symbols[i]];
+            nodes[i].symbol = symbol_intern(&writer->names, name, strlen(name));
+            if (nodes[i].symbol == SYMBOL_NONE) goto fail;
+        }
+    }
+
+    // Stack code as bytecode, ready for vm_execute
+    const Bytecode* bc = &writer->bc;
+    entry.code_length = bc->length;
+    entry.constant_count = bc->constant_count;
+    entry.max_stack = bc->max_stack;
+    entry.local_count = bc->local_count;
+    if (!append_section(writer, bc->code, bc->length, &entry.code_offset) ||
+        !append_section(writer, bc->constants, bc->constant_count * sizeof(double),
+                        &entry.constants_offset)) {
+        goto fail;
+    }
+    store_loads(writer, symbols, writer->data + entry.code_offset, bc->length);
+
+    // Three-address code as IR instructions
+    entry.ir_count = ir->count;
+    entry.ir_constant_count = ir->constant_count;
+    entry.ir_temp_count = ir->temp_count;
+    entry.ir_registers = ir->registers;
+    entry.ir_registers_used = ir->registers_used;
+    entry.ir_spill_slots = ir->spill_slots;
+    store_operand(writer, symbols, &entry.ir_result, ir->result);
+    if (!reserve_section(writer, ir->count * sizeof(IRInstr), &entry.ir_offset)) goto fail;
+    IRInstr* code = (IRInstr*)(writer->data + entry.ir_offset);
+    for (uint32_t i = 0; i < ir->count; i++) {
+        code[i].opcode = ir->code[i].opcode;
+        store_operand(writer, symbols, &code[i].dst, ir->code[i].dst);
+        store_operand(writer, symbols, &code[i].left, ir->code[i].left);
+        store_operand(writer, symbols, &code[i].right, ir->code[i].right);
+    }
+    if (!append_section(writer, ir->constants, ir->constant_count * sizeof(double),
+                        &entry.ir_constants_offset) ||
+        !store_names(writer, &entry)) {
+        goto fail;
+    }
+
+    writer->entries[writer->entry_count++] = entry;
+    return 1;
+
+fail:
+    writer->length = saved_length;
+    return 0;
+}
+
+int binary_writer_append(BinaryWriter* dst, BinaryWriter* src) {
+    if (src->entry_count == 0) return 1;
+
+    if (dst->entry_count + src->entry_count > dst->entry_capacity) {
+        uint32_t capacity = dst->entry_capacity ? dst->entry_capacity : 256;
+        while (capacity < dst->entry_count + src->entry_count) capacity *= 2;
+        BinaryEntry* entries = (BinaryEntry*)realloc(dst->entries, capacity * sizeof(BinaryEntry));
+        if (!entries) return 0;
+        dst->entries = entries;
+        dst->entry_capacity = capacity;
+    }
+
+    uint64_t base;
+    if (!append_section(dst, src->data, src->length, &base)) return 0;
+
+    // Sections moved by `base` bytes; src offsets are already 8-byte aligned
+    for (uint32_t i = 0; i < src->entry_count; i++) {
+        BinaryEntry entry = src->entries[i];
+        entry.nodes_offset += base;
+        entry.code_offset += base;
+        entry.constants_offset += base;
+        entry.ir_offset += base;
+        entry.ir_constants_offset += base;
+        entry.names_offset += base;
+        dst->entries[dst->entry_count++] = entry;
+    }
+
+    src->length = 0;
+    src->entry_count = 0;
+    return 1;
+}
+
+int binary_writer_save(const BinaryWriter* writer, const char* filename) {
+    FILE* output = fopen(filename, "wb");
+    if (!output) {
+        fprintf(stderr, "Error: Could not open file %s for writing\n", filename);
+        return 0;
+    }
+
+    size_t data_start = sizeof(BinaryHeader);
+    size_t entries_offset = data_start + align8(writer->length);
+    size_t entries_size = (size_t)writer->entry_count * sizeof(BinaryEntry);
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, 4);
+    header.version = BINARY_VERSION;
+    header.byte_order = BINARY_BYTE_ORDER;
+    header.entry_count = writer->entry_count;
+    header.entries_offset = entries_offset;
+    header.file_size = entries_offset + entries_size;
+
+    static const uint8_t padding[8] = {0};
+    int ok = fwrite(&header, sizeof(header), 1, output) == 1;
+    if (ok && writer->length) {
+        ok = fwrite(writer->data, 1, writer->length, output) == writer->length;
+    }
+    size_t pad = align8(writer->length) - writer->length;
+    if (ok && pad) ok = fwrite(padding, 1, pad, output) == pad;
+
+    // Section offsets become file offsets
+    for (uint32_t i = 0; i < writer->entry_count && ok; i++) {
+        BinaryEntry entry = writer->entries[i];
+        entry.nodes_offset += data_start;
+        entry.code_offset += data_start;
+        entry.constants_offset += data_start;
+        entry.ir_offset += data_start;
+        entry.ir_constants_offset += data_start;
+        entry.names_offset += data_start;
+        ok = fwrite(&entry, sizeof(entry), 1, output) == 1;
+    }
+
+    if (fclose(output) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write %s\n", filename);
+    }
+    return ok;
+}
+
+// A section of `bytes` bytes at offset lies inside the file and is aligned
+static int section_valid(const BinaryFile* file, uint64_t offset, uint64_t bytes) {
+    return offset % 8 == 0 && offset <= file->size && bytes <= file->size - offset;
+}
+
+// Every name offset points inside the names section, which ends with a NUL
+static int names_valid(const BinaryFile* file, const BinaryEntry* entry) {
+    if (!section_valid(file, entry->names_offset, entry->names_size)) return 0;
+    if (entry->name_count == 0) return 1;
+
+    const uint8_t* section = file->base + entry->names_offset;
+    uint64_t table_size = (uint64_t)entry->name_count * sizeof(uint32_t);
+    if (table_size >= entry->names_size || section[entry->names_size - 1] != '\0') return 0;
+    for (uint32_t i = 0; i < entry->name_count; i++) {
+        uint32_t offset;
+        memcpy(&offset, section + i * sizeof(uint32_t), sizeof(uint32_t));
+        if (offset < table_size || offset >= entry->names_size) return 0;
+    }
+    return 1;
+}
+
+static int binary_file_check(BinaryFile* file, const char* filename) {
+    if (file->size < sizeof(BinaryHeader)) {
+        fprintf(stderr, "Error: %s is not a ParseIQ binary file\n", filename);
+        return 0;
+    }
+
+    const BinaryHeader* header = (const BinaryHeader*)file->base;
+    if (memcmp(header->magic, BINARY_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: %s is not a ParseIQ binary file\n", filename);
+        return 0;
+    }
+    if (header->byte_order != BINARY_BYTE_ORDER) {
+        fprintf(stderr, "Error: %s was written with a different byte order\n", filename);
+        return 0;
+    }
+    if (header->version != BINARY_VERSION) {
+        fprintf(stderr, "Error: %s has format version %u, expected %u\n",
+                filename, header->version, BINARY_VERSION);
+        return 0;
+    }
+    if (header->file_size != file->size ||
+        !section_valid(file, header->entries_offset,
+                       (uint64_t)header->entry_count * sizeof(BinaryEntry))) {
+        fprintf(stderr, "Error: %s is truncated or corrupt\n", filename);
+        return 0;
+    }
+
+    file->entries = (const BinaryEntry*)(file->base + header->entries_offset);
+    file->entry_count = header->entry_count;
+
+    // One bounds check per section; the sections themselves are used as is
+    for (uint32_t i = 0; i < file->entry_count; i++) {
+        const BinaryEntry* entry = &file->entries[i];
+        if (!section_valid(file, entry->nodes_offset, (uint64_t)entry->node_count * sizeof(BinaryNode)) ||
+            !section_valid(file, entry->code_offset, entry->code_length) ||
+            !section_valid(file, entry->constants_offset, (uint64_t)entry->constant_count * sizeof(double)) ||
+            !section_valid(file, entry->ir_offset, (uint64_t)entry->ir_count * sizeof(IRInstr)) ||
+            !section_valid(file, entry->ir_constants_offset,
+                           (uint64_t)entry->ir_constant_count * sizeof(double)) ||
+            !names_valid(file, entry)) {
+            fprintf(stderr, "Error: %s is truncated or corrupt (expression %u)\n", filename, i + 1);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int binary_file_open(BinaryFile* file, const char* filename) {
+    memset(file, 0, sizeof(*file));
+
+    FILE* input = fopen(filename, "rb");
+    if (!input) {
+        fprintf(stderr, "Error: Could not open file: %s\n", filename);
+        return 0;
+    }
+
+#ifndef _WIN32
+    // One read-only mapping of the whole file
+    struct stat st;
+    if (fstat(fileno(input), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(input), 0);
+        if (data != MAP_FAILED) {
+            file->base = (const uint8_t*)data;
+            file->size = (size_t)st.st_size;
+            file->mapped = 1;
+        }
+    }
+#endif
+
+    // Without mmap, read the file into one buffer
+    if (!file->mapped) {
+        size_t capacity = 64 * 1024;
+        uint8_t* buffer = (uint8_t*)malloc(capacity);
+        while (buffer) {
+            file->size += fread(buffer + file->size, 1, capacity - file->size, input);
+            if (file->size < capacity) break;
+            capacity *= 2;
+            uint8_t* grown = (uint8_t*)realloc(buffer, capacity);
+            if (!grown) free(buffer);
+            buffer = grown;
+        }
+        file->base = buffer;
+        if (!buffer) {
+            fprintf(stderr, "Error: Out of memory reading %s\n", filename);
+            fclose(input);
+            return 0;
+        }
+    }
+    fclose(input);
+
+    if (!binary_file_check(file, filename)) {
+        binary_file_close(file);
+        return 0;
+    }
+    return 1;
+}
+
+void binary_file_close(BinaryFile* file) {
+#ifndef _WIN32
+    if (file->mapped) {
+        munmap((void*)file->base, file->size);
+    } else
+#endif
+    {
+        free((void*)file->base);
+    }
+    memset(file, 0, sizeof(*file));
+}
+
+int binary_file_entry_valid(const BinaryFile* file, uint32_t entry) {
+    uint32_t count;
+    const BinaryNode* nodes = binary_file_nodes(file, entry, &count);
+    for (uint32_t i = 0; i < count; i++) {
+        if (nodes[i].kind > NODE_SEQUENCE ||
+            (nodes[i].kind == NODE_BINARY_OP && nodes[i].op > OP_POWER)) {
+            return 0;
+        }
+    }
+
+    Bytecode bc;
+    IRProgram ir;
+    binary_file_bytecode(file, entry, &bc);
+    binary_file_three_addr(file, entry, &ir);
+    return bytecode_valid(&bc) && ir_valid(&ir, file->entries[entry].name_count);
+}
+
+const BinaryNode* binary_file_nodes(const BinaryFile* file, uint32_t entry, uint32_t* count) {
+    const BinaryEntry* e = &file->entries[entry];
+    *count = e->node_count;
+    return (const BinaryNode*)(file->base + e->nodes_offset);
+}
+
+// Name of variable `symbol` of an entry, in its names section (checked
+// by names_valid when the file was opened)
+static const char* entry_name(const BinaryFile* file, const BinaryEntry* e, uint32_t symbol) {
+    const uint8_t* section = file->base + e->names_offset;
+    uint32_t offset;
+    memcpy(&offset, section + symbol * sizeof(uint32_t), sizeof(uint32_t));
+    return (const char*)section + offset;
+}
+
+int binary_file_symbols(const BinaryFile* file, uint32_t entry, SymbolTable* view) {
+    const BinaryEntry* e = &file->entries[entry];
+    if (e->name_count > view->capacity) {
+        const char** names = (const char**)realloc((void*)view->names, e->name_count * sizeof(char*));
+        if (!names) return 0;
+        view->names = names;
+        view->capacity = e->name_count;
+    }
+    for (uint32_t i = 0; i < e->name_count; i++) {
+        view->names[i] = entry_name(file, e, i);
+    }
+    view->count = e->name_count;
+    return 1;
+}
+
+void binary_file_bytecode(const BinaryFile* file, uint32_t entry, Bytecode* view) {
+    const BinaryEntry* e = &file->entries[entry];
+    view->code = (uint8_t*)(file->base + e->code_offset);
+    view->length = e->code_length;
+    view->capacity = 0;
+    view->constants = (double*)(file->base + e->constants_offset);
+    view->constant_count = e->constant_count;
+    view->constant_capacity = 0;
+    view->max_stack = e->max_stack;
+    view->var_count = e->name_count;
+    view->local_count = e->local_count;
+}
+
+void binary_file_three_addr(const BinaryFile* file, uint32_t entry, IRProgram* view) {
+    const BinaryEntry* e = &file->entries[entry];
+    ir_init(view);
+    view->form = IR_FORM_THREE_ADDR;
+    view->code = (IRInstr*)(file->base + e->ir_offset);
+    view->count = e->ir_count;
+    view->constants = (double*)(file->base + e->ir_constants_offset);
+    view->constant_count = e->ir_constant_count;
+    view->temp_count = e->ir_temp_count;
+    view->result = e->ir_result;
+    view->registers = e->ir_registers;
+    view->registers_used = e->ir_registers_used;
+    view->spill_slots = e->ir_spill_slots;
+}
+
+// Child `index` of node i, or FLAT_AST_NO_CHILD if it is missing. Only a
+// sequence holds statements: elsewhere they count as missing, as they
+// cannot be part of an expression.
+static uint32_t entry_child(const BinaryNode* nodes, const BinaryEntry* e, uint32_t i,
+                            uint32_t index, int statements) {
+    if (index >= i) return FLAT_AST_NO_CHILD;
+    const BinaryNode* child = &nodes[index];
+    int statement = child->kind == NODE_SEQUENCE ||
+                    (child->kind == NODE_ASSIGN && child->symbol < e->name_count);
+    return statement && !statements ? FLAT_AST_NO_CHILD : index;
+}
+
+// Write the line of one node and find its children, as write_ast_to_stream
+// does for the tree. A variable or assignment without a name is an error.
+// @return The number of children of its type
+static int write_entry_node(const BinaryFile* file, const BinaryEntry* e, const BinaryNode* nodes,
+                            uint32_t i, FILE* output, uint32_t* first, uint32_t* second) {
+    const BinaryNode* node = &nodes[i];
+    switch ((NodeType)node->kind) {
+        case NODE_NUMBER:
+            fprintf(output, "Number(%.2f)\n", node->value);
+            return 0;
+        case NODE_VARIABLE:
+            if (node->symbol >= e->name_count) break;
+            fprintf(output, "Variable(%s)\n", entry_name(file, e, node->symbol));
+            return 0;
+        case NODE_BINARY_OP:
+            fprintf(output, "BinaryOp(%c)\n", "+-*/^"[node->op]);
+            *first = entry_child(nodes, e, i, node->left, 0);
+            *second = entry_child(nodes, e, i, node->right, 0);
+            return 2;
+        case NODE_ASSIGN:
+            if (node->symbol >= e->name_count) break;
+            fprintf(output, "Assign(%s)\n", entry_name(file, e, node->symbol));
+            *first = entry_child(nodes, e, i, node->left, 0);
+            return 1;
+        case NODE_SEQUENCE:
+            fprintf(output, "Sequence\n");
+            *first = entry_child(nodes, e, i, node->left, 1);
+            *second = entry_child(nodes, e, i, node->right, 1);
+            return 2;
+        default:
+            break;
+    }
+    fprintf(output, "ErrorNode\n");
+    return 0;
+}
+
+// A node index to write at an indentation
+typedef struct {
+    uint32_t index;           // FLAT_AST_NO_CHILD: a missing right child
+    int indent;
+} EntryWalkFrame;
+
+static void write_entry_indent(FILE* output, int indent) {
+    for (int i = 0; i < indent; ++i) fprintf(output, "  ");
+}
+
+int binary_file_write_ast(const BinaryFile* file, uint32_t entry, FILE* output) {
+    const BinaryEntry* e = &file->entries[entry];
+    uint32_t count;
+    const BinaryNode* nodes = binary_file_nodes(file, entry, &count);
+    if (count == 0) {
+        fprintf(output, "NULL Node\n");
+        return 1;
+    }
+
+    // Preorder from the root, the last node; the right child is pushed
+    // first so the left one comes out first
+    EntryWalkFrame inline_frames[64];
+    EntryWalkFrame* frames = inline_frames;
+    size_t capacity = sizeof(inline_frames) / sizeof(inline_frames[0]);
+    size_t depth = 0;
+    frames[depth++] = (EntryWalkFrame){ count - 1, 0 };
+
+    int ok = 1;
+    while (depth > 0) {
+        EntryWalkFrame frame = frames[--depth];
+        write_entry_indent(output, frame.indent);
+        if (frame.index == FLAT_AST_NO_CHILD) {
+            fprintf(output, "Right: NULL\n");
+            continue;
+        }
+
+        uint32_t first = FLAT_AST_NO_CHILD;
+        uint32_t second = FLAT_AST_NO_CHILD;
+        int children = write_entry_node(file, e, nodes, frame.index, output, &first, &second);
+        if (children == 0) continue;
+        if (depth + 2 > capacity) {
+            size_t grown_capacity = capacity * 2;
+            EntryWalkFrame* grown = (EntryWalkFrame*)malloc(grown_capacity * sizeof(EntryWalkFrame));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            memcpy(grown, frames, depth * sizeof(EntryWalkFrame));
+            if (frames != inline_frames) free(frames);
+            frames = grown;
+            capacity = grown_capacity;
+        }
+
+        if (children == 1) {
+            if (first != FLAT_AST_NO_CHILD) {
+                frames[depth++] = (EntryWalkFrame){ first, frame.indent + 1 };
+            } else {
+                write_entry_indent(output, frame.indent + 1);
+                fprintf(output, "Value: NULL\n");
+            }
+            continue;
+        }
+        frames[depth++] = (EntryWalkFrame){ second, frame.indent + 1 };
+        if (first != FLAT_AST_NO_CHILD) {
+            frames[depth++] = (EntryWalkFrame){ first, frame.indent + 1 };
+        } else {
+            write_entry_indent(output, frame.indent + 1);
+            fprintf(output, "Left: NULL\n");
+        }
+    }
+    if (frames != inline_frames) free(frames);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Out of memory writing the AST\n");
+    }
+    return ok;
+}
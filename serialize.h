@@ -0,0 +1,177 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "compiler.h"
+#include "ir.h"
+#include "vm.h"
+
+/* Binary file of compiled expressions (.pqb)
+ *
+ * Layout, in the producer's byte order (checked through byte_order) with
+ * every section 8-byte aligned:
+ *   BinaryHeader
+ *   per expression: AST nodes, bytecode, bytecode constants,
+ *                   three-address instructions, their constants,
+ *                   variable names
+ *   BinaryEntry[entry_count]   (at entries_offset)
+ *
+ * Offsets are from the start of the file and children are node indices,
+ * so the file is position independent: it is mapped once and read in
+ * place. A loaded entry is viewed as a Bytecode or IRProgram whose arrays
+ * point into the mapping; nothing is copied or allocated per node.
+ *
+ * Variables are numbered per expression, in order of first appearance,
+ * and named by the expression's names section: uint32_t offsets (from
+ * the start of the section) of name_count NUL-terminated names, followed
+ * by the names. binary_file_symbols views them as a symbol table with
+ * exactly these IDs.
+ */
+
+#define BINARY_MAGIC "PQIQ"
+#define BINARY_VERSION 4       // 2: bytecode may hold BC_SQRT; 3: named variables;
+                               // 4: statements and assignments
+
+typedef struct {
+    char magic[4];            // BINARY_MAGIC
+    uint16_t version;         // BINARY_VERSION
+    uint16_t byte_order;      // 0x0102 as written by the producer
+    uint32_t entry_count;
+    uint32_t reserved;
+    uint64_t entries_offset;
+    uint64_t file_size;
+} BinaryHeader;
+
+/* One AST node; nodes are in postorder, so the root is the last one.
+ * Children are encoded as in FlatAST: an assignment's value is its left
+ * child, a sequence's statements are its children, and a variable reading
+ * an assignment links to it through left.
+ */
+typedef struct {
+    double value;             // NODE_NUMBER
+    uint32_t left;            // Children (FLAT_AST_NO_CHILD if missing)
+    uint32_t right;
+    int32_t line;
+    int32_t column;
+    uint8_t kind;             // NodeType
+    uint8_t op;               // OperatorType
+    uint8_t reserved[2];
+    uint32_t symbol;          // NODE_VARIABLE, NODE_ASSIGN: ID in the entry's names
+} BinaryNode;
+
+/* Directory entry of one expression */
+typedef struct {
+    uint64_t nodes_offset;          // BinaryNode[node_count]
+    uint64_t code_offset;           // Bytecode, code_length bytes
+    uint64_t constants_offset;      // double[constant_count] used by the bytecode
+    uint64_t ir_offset;             // IRInstr[ir_count], three-address code
+    uint64_t ir_constants_offset;   // double[ir_constant_count]
+    uint64_t names_offset;          // Variable names, names_size bytes
+    uint32_t node_count;
+    uint32_t code_length;
+    uint32_t constant_count;
+    uint32_t max_stack;
+    uint32_t local_count;           // Local slots of the bytecode's assignments
+    uint32_t ir_count;
+    uint32_t ir_constant_count;
+    uint32_t ir_temp_count;
+    uint32_t ir_registers;          // Register file of allocated code (0 = tN temporaries)
+    uint32_t ir_registers_used;
+    uint32_t ir_spill_slots;
+    uint32_t name_count;
+    uint32_t names_size;
+    uint32_t reserved;
+    IROperand ir_result;
+} BinaryEntry;
+
+/* Accumulates compiled expressions in memory until saved */
+typedef struct {
+    uint8_t* data;            // Sections, as they follow the header
+    size_t length;
+    size_t capacity;
+    BinaryEntry* entries;     // Offsets relative to data until saved
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+
+    // Scratch reused for every expression
+    FlatAST flat;
+    Bytecode bc;
+    SymbolTable names;        // Variables of the expression being added
+} BinaryWriter;
+
+void binary_writer_init(BinaryWriter* writer);
+void binary_writer_free(BinaryWriter* writer);
+
+/* Compile one expression and append its AST, bytecode and three-address
+ * code (register allocated if compiler->codegen.registers is set)
+ * @return 1 on success, 0 if out of memory
+ */
+int binary_writer_add(BinaryWriter* writer, Compiler* compiler, const ASTNode* root);
+
+/* Move every expression of src to the end of dst, leaving src empty
+ * (used to merge the per-chunk writers of a parallel batch in order)
+ * @return 1 on success, 0 if out of memory
+ */
+int binary_writer_append(BinaryWriter* dst, BinaryWriter* src);
+
+/* Write the header, sections and entry table
+ * @return 1 on success, 0 if the file could not be written
+ */
+int binary_writer_save(const BinaryWriter* writer, const char* filename);
+
+/* A binary file mapped into memory */
+typedef struct {
+    const uint8_t* base;
+    size_t size;
+    const BinaryEntry* entries;
+    uint32_t entry_count;
+    int mapped;               // base is an mmap'd region rather than malloc'd
+} BinaryFile;
+
+/* Map a binary file and check its header and section bounds
+ * (the contents of each entry are checked by binary_file_entry_valid)
+ * @return 1 on success, 0 (with a message on stderr) otherwise
+ */
+int binary_file_open(BinaryFile* file, const char* filename);
+void binary_file_close(BinaryFile* file);
+
+/* Check the contents of an entry before its first use: node kinds and
+ * operators, and its bytecode and three-address code (bytecode_valid,
+ * ir_valid against the entry's names). Linear and allocation-free; a
+ * damaged entry must not be viewed or rebuilt.
+ * @return 1 if the entry can be used
+ */
+int binary_file_entry_valid(const BinaryFile* file, uint32_t entry);
+
+/* The AST nodes of an entry, in place */
+const BinaryNode* binary_file_nodes(const BinaryFile* file, uint32_t entry, uint32_t* count);
+
+/* View an entry's variable names as a symbol table: names[] points into
+ * the file and count is name_count, so its IDs are the ones the entry's
+ * nodes and code use. Nothing is copied or hashed, so the view is only
+ * for reading names by ID (the writers, symbol_values_resolve), never for
+ * symbol_find or symbol_intern. Reuse it for every entry; free it with
+ * symbol_table_free.
+ * @param view Initialized with symbol_table_init; its names array grows as needed
+ * @return 1 on success, 0 if out of memory
+ */
+int binary_file_symbols(const BinaryFile* file, uint32_t entry, SymbolTable* view);
+
+/* View an entry's bytecode in place; the view must not be freed or grown.
+ * Its variables are IDs of the entry's names (var_count is name_count). */
+void binary_file_bytecode(const BinaryFile* file, uint32_t entry, Bytecode* view);
+
+/* View an entry's three-address code in place; the view must not be freed
+ * or grown. Its variables are IDs of the entry's names. */
+void binary_file_three_addr(const BinaryFile* file, uint32_t entry, IRProgram* view);
+
+/* Write an entry's AST as write_ast_to_stream writes the tree, straight
+ * from its nodes in place: no tree is rebuilt, and names are read from
+ * the names section
+ * @return 1 on success, 0 if out of memory
+ */
+int binary_file_write_ast(const BinaryFile* file, uint32_t entry, FILE* output);
+
+#endif // SERIALIZE_H
@@ -0,0 +1,583 @@
+#ifdef __linux__
+#define _GNU_SOURCE // accept4
+#endif
+#include "server.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+
+int serve(const char* socket_path, const ServeOptions* options) {
+    (void)socket_path;
+    (void)options;
+    fprintf(stderr, "Error: --serve needs Linux (epoll and Unix domain sockets)\n");
+    return 1;
+}
+
+int serve_stream(int input, int output, uint16_t outputs, const ServeOptions* options) {
+    (void)input;
+    (void)output;
+    (void)outputs;
+    (void)options;
+    fprintf(stderr, "Error: --stream needs POSIX (memory streams and poll)\n");
+    return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "codegen.h"
+#include "compiler.h"
+#include "optimizer.h"
+
+#define READ_SIZE (64 * 1024)
+#define OUTPUT_BACKLOG (4u * 1024 * 1024)  // Stop reading requests while this much is unsent
+#define STREAM_WRITE_SIZE (1u << 20)            // Output collected for one write by --stream
+#define SERVER_SYMBOL_LIMIT 65536               // Variable names kept between requests
+
+enum { SECTION_AST, SECTION_STACK, SECTION_3ADDR, SECTION_ERRORS, SECTION_COUNT };
+
+typedef struct {
+    uint8_t* data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+// Compiles requests into response frames; shared by the server and --stream
+typedef struct {
+    const ServeOptions* options;
+    Compiler* compiler;
+    IRProgram ir;
+
+    // Per-request text, reused: written from 0 and read back up to ftell
+    FILE* sections[SECTION_COUNT];
+    char* section_data[SECTION_COUNT];
+    size_t section_size[SECTION_COUNT];
+
+    long requests;
+} Responder;
+
+static int buffer_reserve(Buffer* buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) return 1;
+    size_t capacity = buffer->capacity ? buffer->capacity : READ_SIZE;
+    while (capacity < buffer->length + extra) capacity *= 2;
+    uint8_t* data = (uint8_t*)realloc(buffer->data, capacity);
+    if (!data) return 0;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static int buffer_append(Buffer* buffer, const void* bytes, size_t length) {
+    if (!buffer_reserve(buffer, length)) return 0;
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+    return 1;
+}
+
+// Create the compiler and section streams
+// @return 1 on success, 0 if out of memory
+static int responder_init(Responder* responder, const ServeOptions* options) {
+    memset(responder, 0, sizeof(*responder));
+    responder->options = options;
+    ir_init(&responder->ir);
+
+    int ok = (responder->compiler = compiler_create()) != NULL;
+    for (int k = 0; k < SECTION_COUNT && ok; k++) {
+        responder->sections[k] = open_memstream(&responder->section_data[k],
+                                                &responder->section_size[k]);
+        ok = responder->sections[k] != NULL;
+    }
+    if (ok) {
+        ast_arena_set_hash_consing(&responder->compiler->arena, options->hash_consing);
+        responder->compiler->codegen.registers = options->registers;
+        responder->compiler->stats.enabled = options->stats;
+    }
+    return ok;
+}
+
+static void responder_free(Responder* responder) {
+    for (int k = 0; k < SECTION_COUNT; k++) {
+        if (responder->sections[k]) fclose(responder->sections[k]);
+        free(responder->section_data[k]);
+    }
+    ir_free(&responder->ir);
+    if (responder->compiler) compiler_destroy(responder->compiler);
+}
+
+// Compile one request and append its response frame to `out`
+static int answer_request(Responder* responder, Buffer* out, uint32_t id, uint16_t outputs,
+                          const char* text, size_t length) {
+    Compiler* compiler = responder->compiler;
+    outputs &= SERVE_AST | SERVE_STACK | SERVE_3ADDR;
+    for (int k = 0; k < SECTION_COUNT; k++) {
+        rewind(responder->sections[k]);
+    }
+
+    error_init(compiler);
+    error_set_sink(compiler, responder->sections[SECTION_ERRORS]);
+    set_token_buffer(compiler, text, length);
+    parser_reset(compiler);
+
+    int line = compiler->parser.line;
+    int column = compiler->parser.column;
+    ASTNode* root = parse_program(compiler);
+    int clean = parser_end_statement(compiler);
+    int failed = !root || !clean || ast_has_errors(root);
+    if (failed) {
+        error_report(compiler, ERROR_SYNTAX, line, column, "Invalid expression");
+    }
+
+    if (root && responder->options->optimize) {
+        uint64_t start = stats_begin(&compiler->stats);
+        OptimizeStats stats;
+        root = optimize_ast(&compiler->arena, root, &stats);
+        stats_end(&compiler->stats, STATS_OPTIMIZE, start);
+    }
+    if (root) {
+        if (outputs & SERVE_AST) {
+            uint64_t start = stats_begin(&compiler->stats);
+            write_ast_to_stream(root, responder->sections[SECTION_AST]);
+            stats_end(&compiler->stats, STATS_AST_OUTPUT, start);
+        }
+        if (outputs & SERVE_STACK) {
+            uint64_t start = stats_begin(&compiler->stats);
+            if (generate_stack_ir(root, &responder->ir)) {
+                ir_write_stack(&responder->ir, &compiler->symbols, responder->sections[SECTION_STACK]);
+                compiler->stats.instructions += responder->ir.count;
+            } else {
+                fprintf(responder->sections[SECTION_STACK], "ERROR\n");
+            }
+            stats_end(&compiler->stats, STATS_STACK, start);
+        }
+        if (outputs & SERVE_3ADDR) {
+            uint64_t start = stats_begin(&compiler->stats);
+            generate_three_addr_code_stream(compiler, root, responder->sections[SECTION_3ADDR]);
+            stats_end(&compiler->stats, STATS_THREE_ADDR, start);
+        }
+    }
+    ast_arena_reset(&compiler->arena);
+    release_token_stream(compiler);
+
+    // Names are kept across requests, as clients tend to reuse a few,
+    // but not without bound
+    if (compiler->symbols.count > SERVER_SYMBOL_LIMIT) {
+        symbol_table_free(&compiler->symbols);
+    }
+
+    // Requested sections are always present, empty if nothing was parsed
+    if (failed) outputs |= SERVE_ERRORS;
+    uint32_t lengths[SECTION_COUNT] = {0};
+    ServeResponseHeader response = {0, id, failed ? SERVE_INVALID : SERVE_OK, outputs};
+    for (int k = 0; k < SECTION_COUNT; k++) {
+        if (!(outputs & (1u << k))) continue;
+        lengths[k] = (uint32_t)ftell(responder->sections[k]);
+        fflush(responder->sections[k]);
+        response.length += sizeof(uint32_t) + lengths[k];
+    }
+
+    if (!buffer_reserve(out, sizeof(response) + response.length)) return 0;
+    buffer_append(out, &response, sizeof(response));
+    for (int k = 0; k < SECTION_COUNT; k++) {
+        if (!(outputs & (1u << k))) continue;
+        buffer_append(out, &lengths[k], sizeof(uint32_t));
+        buffer_append(out, responder->section_data[k], lengths[k]);
+    }
+    compiler->stats.bytes_written += sizeof(response) + response.length;
+    responder->requests++;
+    return 1;
+}
+
+// Write all of a buffer to a descriptor and empty it
+// @return 0 on a write error
+static int write_all(int fd, Buffer* buffer) {
+    size_t done = 0;
+    while (done < buffer->length) {
+        ssize_t n = write(fd, buffer->data + done, buffer->length - done);
+        if (n > 0) {
+            done += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return 0;
+        }
+    }
+    buffer->length = 0;
+    return 1;
+}
+
+// Whether reading from fd right now would block
+static int input_idle(int fd) {
+    struct pollfd poll_fd = {fd, POLLIN, 0};
+    return poll(&poll_fd, 1, 0) == 0;
+}
+
+int serve_stream(int input, int output, uint16_t outputs, const ServeOptions* options) {
+    Responder responder;
+    Buffer in = {NULL, 0, 0};
+    Buffer out = {NULL, 0, 0};
+    int ok = responder_init(&responder, options);
+    if (!ok) fprintf(stderr, "Error: Out of memory\n");
+
+    // Lines are compiled in place in the input buffer, which only grows to
+    // hold the longest one; output is collected for large writes
+    uint32_t line = 0;
+    size_t start = 0;            // Start of the first unprocessed line
+    size_t scanned = 0;          // Bytes from start known to hold no newline
+    int at_end = 0;
+    while (ok && !(at_end && start == in.length)) {
+        uint8_t* newline = in.length > start + scanned
+                               ? (uint8_t*)memchr(in.data + start + scanned, '\n',
+                                                  in.length - start - scanned)
+                               : NULL;
+        if (!newline && !at_end) {
+            // Keep only the partial line and wait for more input, but write
+            // what is done before blocking
+            if (start > 0) {
+                memmove(in.data, in.data + start, in.length - start);
+                in.length -= start;
+                start = 0;
+            }
+            scanned = in.length;
+            if (out.length > 0 && input_idle(input) && !write_all(output, &out)) break;
+            if (!buffer_reserve(&in, READ_SIZE)) {
+                fprintf(stderr, "Error: Out of memory for a line of %zu bytes\n", in.length);
+                ok = 0;
+                break;
+            }
+            ssize_t n = read(input, in.data + in.length, in.capacity - in.length);
+            if (n > 0) {
+                in.length += (size_t)n;
+            } else if (n == 0) {
+                at_end = 1;
+            } else if (errno != EINTR) {
+                perror("read");
+                ok = 0;
+            }
+            continue;
+        }
+
+        // A line ends at its newline, the last one at the end of the input
+        const char* text = (const char*)in.data + start;
+        size_t length = newline ? (size_t)(newline - in.data) - start : in.length - start;
+        start += newline ? length + 1 : length;
+        scanned = 0;
+        line++;
+        size_t blank = 0;
+        while (blank < length && (text[blank] == ' ' || text[blank] == '\t' || text[blank] == '\r')) {
+            blank++;
+        }
+        if (blank < length && !answer_request(&responder, &out, line, outputs, text, length)) {
+            fprintf(stderr, "Error: Out of memory compiling line %u\n", line);
+            ok = 0;
+        }
+
+        if (ok && out.length >= STREAM_WRITE_SIZE && !write_all(output, &out)) break;
+    }
+    if (ok && !write_all(output, &out)) ok = 0;
+    if (out.length > 0) {
+        perror("write");
+        ok = 0;
+    }
+
+    if (responder.compiler && responder.compiler->stats.enabled) {
+        stats_add_arena(&responder.compiler->stats, &responder.compiler->arena);
+        stats_print(&responder.compiler->stats, stderr, options->stats_json);
+    }
+    free(in.data);
+    free(out.data);
+    responder_free(&responder);
+    return ok ? 0 : 1;
+}
+
+#ifndef __linux__
+
+int serve(const char* socket_path, const ServeOptions* options) {
+    (void)socket_path;
+    (void)options;
+    fprintf(stderr, "Error: --serve needs Linux (epoll and Unix domain sockets)\n");
+    return 1;
+}
+
+#else
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_EVENTS 64
+
+typedef struct Connection {
+    int fd;
+    Buffer in;
+    size_t in_pos;            // Start of the first unprocessed request
+    Buffer out;
+    size_t out_pos;           // Start of the first unsent byte
+    uint32_t events;          // Events registered with epoll
+    int closing;              // The client will send nothing more
+    struct Connection* prev;
+    struct Connection* next;
+} Connection;
+
+typedef struct {
+    Responder responder;
+    int epoll_fd;
+    Connection* connections;
+    long connection_count;
+} Server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+// Answer every complete request in the input buffer (unless too much output is pending)
+// @return 0 if the connection must be closed
+static int answer_requests(Server* server, Connection* conn) {
+    while (conn->out.length - conn->out_pos < OUTPUT_BACKLOG) {
+        size_t available = conn->in.length - conn->in_pos;
+        if (available < sizeof(ServeRequestHeader)) break;
+
+        ServeRequestHeader request;
+        memcpy(&request, conn->in.data + conn->in_pos, sizeof(request));
+        if (request.length > SERVE_MAX_EXPRESSION) {
+            fprintf(stderr, "Error: request of %u bytes is too long, closing the connection\n",
+                    request.length);
+            return 0;
+        }
+        if (available < sizeof(request) + request.length) break;
+
+        const char* text = (const char*)conn->in.data + conn->in_pos + sizeof(request);
+        if (!answer_request(&server->responder, &conn->out, request.id, request.outputs, text,
+                            request.length)) {
+            fprintf(stderr, "Error: Out of memory answering a request\n");
+            return 0;
+        }
+        conn->in_pos += sizeof(request) + request.length;
+    }
+
+    // Keep only the partial request
+    if (conn->in_pos > 0) {
+        memmove(conn->in.data, conn->in.data + conn->in_pos, conn->in.length - conn->in_pos);
+        conn->in.length -= conn->in_pos;
+        conn->in_pos = 0;
+    }
+    return 1;
+}
+
+// @return 0 if the connection failed
+static int read_requests(Connection* conn) {
+    for (;;) {
+        if (!buffer_reserve(&conn->in, READ_SIZE)) return 0;
+        ssize_t n = read(conn->fd, conn->in.data + conn->in.length, conn->in.capacity - conn->in.length);
+        if (n > 0) {
+            conn->in.length += (size_t)n;
+            if (conn->in.length - conn->in_pos >= OUTPUT_BACKLOG) return 1; // Answer some first
+        } else if (n == 0) {
+            conn->closing = 1;
+            return 1;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
+// @return 0 if the connection failed
+static int write_responses(Connection* conn) {
+    while (conn->out_pos < conn->out.length) {
+        ssize_t n = send(conn->fd, conn->out.data + conn->out_pos, conn->out.length - conn->out_pos,
+                         MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->out_pos += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    conn->out.length = 0;
+    conn->out_pos = 0;
+    return 1;
+}
+
+static void close_connection(Server* server, Connection* conn) {
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->prev) conn->prev->next = conn->next;
+    else server->connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn);
+}
+
+// A whole request is waiting in the input buffer
+static int has_request(const Connection* conn) {
+    ServeRequestHeader request;
+    size_t available = conn->in.length - conn->in_pos;
+    if (available < sizeof(request)) return 0;
+    memcpy(&request, conn->in.data + conn->in_pos, sizeof(request));
+    return available - sizeof(request) >= request.length;
+}
+
+static void handle_connection(Server* server, Connection* conn, uint32_t events) {
+    int ok = 1;
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ok = read_requests(conn);
+
+    // Requests held back by the output backlog go out once it drains
+    do {
+        if (ok) ok = answer_requests(server, conn);
+        if (ok) ok = write_responses(conn);
+    } while (ok && conn->out.length == 0 && has_request(conn));
+
+    int pending = conn->out_pos < conn->out.length;
+    if (!ok || (conn->closing && !pending)) {
+        close_connection(server, conn);
+        return;
+    }
+
+    // Read while there is room for more output; wait for writability while output is pending
+    uint32_t wanted = 0;
+    if (!conn->closing && conn->out.length - conn->out_pos < OUTPUT_BACKLOG) wanted |= EPOLLIN;
+    if (pending) wanted |= EPOLLOUT;
+    if (wanted != conn->events) {
+        struct epoll_event event;
+        event.events = wanted;
+        event.data.ptr = conn;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = wanted;
+    }
+}
+
+static void accept_connections(Server* server, int listener) {
+    for (;;) {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+
+        Connection* conn = (Connection*)calloc(1, sizeof(Connection));
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (!conn || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            fprintf(stderr, "Error: Could not accept a connection\n");
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        conn->next = server->connections;
+        if (conn->next) conn->next->prev = conn;
+        server->connections = conn;
+        server->connection_count++;
+    }
+}
+
+static int open_listener(const char* socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(socket_path);
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error: Could not listen on %s: %s\n", socket_path, strerror(errno));
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+int serve(const char* socket_path, const ServeOptions* options) {
+    Server server;
+    memset(&server, 0, sizeof(server));
+    server.epoll_fd = -1;
+
+    int ok = responder_init(&server.responder, options);
+    if (!ok) fprintf(stderr, "Error: Out of memory\n");
+
+    int listener = ok ? open_listener(socket_path) : -1;
+    if (listener >= 0) {
+        server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL; // The listener
+        if (server.epoll_fd < 0 || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, listener, &event) != 0) {
+            perror("epoll");
+            ok = 0;
+        }
+    } else {
+        ok = 0;
+    }
+
+    if (ok) {
+        // No SA_RESTART: a signal interrupts epoll_wait so the loop can stop
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = request_stop;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+
+        printf("Serving on %s\n", socket_path);
+        fflush(stdout);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (ok && !stop_requested) {
+        int count = epoll_wait(server.epoll_fd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                accept_connections(&server, listener);
+            } else {
+                handle_connection(&server, (Connection*)events[i].data.ptr, events[i].events);
+            }
+        }
+    }
+
+    if (ok) {
+        long requests = server.responder.requests;
+        printf("\nServed %ld request%s on %ld connection%s\n", requests,
+               requests == 1 ? "" : "s", server.connection_count,
+               server.connection_count == 1 ? "" : "s");
+    }
+    while (server.connections) close_connection(&server, server.connections);
+    if (listener >= 0) {
+        close(listener);
+        unlink(socket_path);
+    }
+    if (server.epoll_fd >= 0) close(server.epoll_fd);
+    responder_free(&server.responder);
+    return ok ? 0 : 1;
+}
+
+#endif // __linux__
+
+#endif // _WIN32
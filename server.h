@@ -0,0 +1,81 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+/* Compile server (--serve)
+ *
+ * One process listens on a Unix domain socket and compiles expressions
+ * for any number of clients, so a request costs a round trip instead of
+ * a process start. Every connection carries a stream of frames in the
+ * host's byte order; a client may send many requests before reading any
+ * response (pipelining), and responses come back in request order.
+ *
+ * Request:  ServeRequestHeader, then `length` bytes of expression text
+ * Response: ServeResponseHeader, then for every bit set in `outputs`
+ *           (lowest bit first) a uint32_t byte count and that much text
+ *
+ * The texts are the ones the batch outputs hold for one expression:
+ * the AST structure, stack code and three-address code, plus the error
+ * messages (SERVE_ERRORS) when the expression is invalid. A request
+ * longer than SERVE_MAX_EXPRESSION closes the connection.
+ *
+ * --stream writes the same responses to stdout for expressions read
+ * from stdin, one per line, without a socket (see serve_stream).
+ */
+
+#define SERVE_AST    0x1u
+#define SERVE_STACK  0x2u
+#define SERVE_3ADDR  0x4u
+#define SERVE_ERRORS 0x8u     // Responses only
+
+#define SERVE_MAX_EXPRESSION (1u << 20)
+
+// Response status
+#define SERVE_OK      0
+#define SERVE_INVALID 1       // The expression has errors; outputs may be partial
+
+typedef struct {
+    uint32_t length;          // Bytes of expression text that follow
+    uint32_t id;              // Echoed in the response
+    uint16_t outputs;         // SERVE_AST | SERVE_STACK | SERVE_3ADDR
+    uint16_t reserved;
+} ServeRequestHeader;
+
+typedef struct {
+    uint32_t length;          // Bytes of sections that follow
+    uint32_t id;              // From the request
+    uint16_t status;          // SERVE_OK or SERVE_INVALID
+    uint16_t outputs;         // Sections present
+} ServeResponseHeader;
+
+// Code generation options applied to every request
+typedef struct {
+    int optimize;
+    int hash_consing;
+    int registers;
+    int stats;                // Report compiler statistics on stderr (--stream only)
+    int stats_json;
+} ServeOptions;
+
+/* Serve requests on a Unix domain socket until SIGINT or SIGTERM
+ * An existing socket file at the path is replaced.
+ * @return 0 after a clean shutdown, 1 if the server could not start
+ */
+int serve(const char* socket_path, const ServeOptions* options);
+
+/* Compile every non-blank line of an input as it arrives and write one
+ * response (as above, with the 1-based line number as the id) per line
+ *
+ * Lines are compiled in place in the read buffer, so memory stays bounded
+ * by the longest line however long the input is. Responses are collected
+ * and written in large blocks, and whenever the input has nothing more to
+ * read, so a client feeding a pipe line by line is not kept waiting.
+ * @param input File descriptor read until end of file
+ * @param output File descriptor the responses are written to
+ * @param outputs Sections of every response (SERVE_AST | SERVE_STACK | SERVE_3ADDR)
+ * @return 0 on success, 1 on a read, write or memory error
+ */
+int serve_stream(int input, int output, uint16_t outputs, const ServeOptions* options);
+
+#endif // SERVER_H
@@ -0,0 +1,79 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "stats.h"
+#include <string.h>
+#include <time.h>
+
+// Names of the phases in reports, in StatsPhase order
+static const char* const phase_names[STATS_PHASE_COUNT] = {
+    "input", "lex", "parse", "optimize", "ast_output", "stack", "three_addr"
+};
+
+void stats_init(CompileStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+uint64_t stats_clock_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void stats_add_arena(CompileStats* stats, const ASTArena* arena) {
+    stats->nodes += arena->nodes_allocated;
+    stats->allocations += arena->blocks_allocated;
+    stats->allocated_bytes += arena->bytes_allocated;
+}
+
+void stats_merge(CompileStats* total, const CompileStats* stats) {
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        total->phase_ns[i] += stats->phase_ns[i];
+        total->phase_calls[i] += stats->phase_calls[i];
+    }
+    total->tokens += stats->tokens;
+    total->nodes += stats->nodes;
+    total->allocations += stats->allocations;
+    total->allocated_bytes += stats->allocated_bytes;
+    total->bytes_written += stats->bytes_written;
+    total->instructions += stats->instructions;
+}
+
+void stats_print(const CompileStats* stats, FILE* output, int json) {
+    uint64_t total_ns = 0;
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        total_ns += stats->phase_ns[i];
+    }
+
+    if (json) {
+        fprintf(output, "{\"phases\": {");
+        for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+            fprintf(output, "%s\"%s\": {\"calls\": %llu, \"ns\": %llu}", i ? ", " : "",
+                    phase_names[i], (unsigned long long)stats->phase_calls[i],
+                    (unsigned long long)stats->phase_ns[i]);
+        }
+        fprintf(output, "}, \"total_ns\": %llu, \"tokens\": %llu, \"nodes\": %llu, "
+                "\"allocations\": %llu, \"allocated_bytes\": %llu, \"bytes_written\": %llu, "
+                "\"instructions\": %llu}\n",
+                (unsigned long long)total_ns, (unsigned long long)stats->tokens,
+                (unsigned long long)stats->nodes, (unsigned long long)stats->allocations,
+                (unsigned long long)stats->allocated_bytes,
+                (unsigned long long)stats->bytes_written,
+                (unsigned long long)stats->instructions);
+        return;
+    }
+
+    fprintf(output, "\nCompilation Statistics:\n");
+    fprintf(output, "======================\n");
+    fprintf(output, "  %-12s %10s %12s %7s\n", "phase", "calls", "time (ms)", "share");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        double share = total_ns ? 100.0 * stats->phase_ns[i] / total_ns : 0.0;
+        fprintf(output, "  %-12s %10llu %12.3f %6.1f%%\n", phase_names[i],
+                (unsigned long long)stats->phase_calls[i], stats->phase_ns[i] / 1e6, share);
+    }
+    fprintf(output, "  %-12s %10s %12.3f\n", "total", "", total_ns / 1e6);
+    fprintf(output, "  Tokens:       %llu\n", (unsigned long long)stats->tokens);
+    fprintf(output, "  AST nodes:    %llu\n", (unsigned long long)stats->nodes);
+    fprintf(output, "  Allocations:  %llu (%llu bytes)\n", (unsigned long long)stats->allocations,
+            (unsigned long long)stats->allocated_bytes);
+    fprintf(output, "  Written:      %llu bytes\n", (unsigned long long)stats->bytes_written);
+    fprintf(output, "  Instructions: %llu\n", (unsigned long long)stats->instructions);
+}
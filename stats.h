@@ -0,0 +1,73 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ast.h"
+
+/* Compilation statistics (--stats)
+ *
+ * Wall time per compiler phase, measured with a monotonic clock, and
+ * counters of the work done. Every compiler owns one CompileStats; while
+ * it is disabled the instrumented functions only test the enabled flag,
+ * so a normal run pays one predictable branch per token and per phase.
+ */
+
+typedef enum {
+    STATS_INPUT,       // set_token_stream: opening/mapping the input
+    STATS_LEX,         // yylex
+    STATS_PARSE,       // parse_program, not counting the lexer calls it makes
+    STATS_OPTIMIZE,    // optimize_ast
+    STATS_AST_OUTPUT,  // write_ast_to_file / the batch AST output
+    STATS_STACK,       // Stack code generation and output
+    STATS_THREE_ADDR,  // Three-address code generation and output
+    STATS_PHASE_COUNT
+} StatsPhase;
+
+typedef struct {
+    int enabled;
+    uint64_t phase_ns[STATS_PHASE_COUNT];
+    uint64_t phase_calls[STATS_PHASE_COUNT];
+
+    uint64_t tokens;           // Tokens returned by the lexer
+    uint64_t nodes;            // AST nodes allocated (shared nodes are not)
+    uint64_t allocations;      // Arena blocks taken from the system
+    uint64_t allocated_bytes;
+    uint64_t bytes_written;    // To text output files (not the console)
+    uint64_t instructions;     // Stack and three-address instructions written
+} CompileStats;
+
+void stats_init(CompileStats* stats);
+
+// Current time of the monotonic clock in nanoseconds
+uint64_t stats_clock_ns(void);
+
+// Start timing a phase; the result is passed to stats_end
+static inline uint64_t stats_begin(const CompileStats* stats) {
+    return stats->enabled ? stats_clock_ns() : 0;
+}
+
+// Add the time since stats_begin to a phase
+static inline void stats_end(CompileStats* stats, StatsPhase phase, uint64_t start) {
+    if (stats->enabled) {
+        stats->phase_ns[phase] += stats_clock_ns() - start;
+        stats->phase_calls[phase]++;
+    }
+}
+
+/* Add the node and block counts of an arena (cumulative since it was
+ * initialized) to the counters
+ */
+void stats_add_arena(CompileStats* stats, const ASTArena* arena);
+
+/* Add the counters and phase times of one compiler to another
+ * (times of compilers that ran in parallel add up to CPU time)
+ */
+void stats_merge(CompileStats* total, const CompileStats* stats);
+
+/* Print the report
+ * @param json Print one JSON object instead of a table
+ */
+void stats_print(const CompileStats* stats, FILE* output, int json);
+
+#endif // STATS_H
@@ -0,0 +1,209 @@
+#include "symbols.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMBOL_BLOCK_SIZE 4096
+
+struct SymbolBlock {
+    SymbolBlock* next;
+    size_t size;
+    char data[];
+};
+
+void symbol_table_init(SymbolTable* symbols) {
+    memset(symbols, 0, sizeof(*symbols));
+}
+
+void symbol_table_free(SymbolTable* symbols) {
+    SymbolBlock* block = symbols->blocks;
+    while (block) {
+        SymbolBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(symbols->names);
+    free(symbols->hashes);
+    free(symbols->slots);
+    symbol_table_init(symbols);
+}
+
+void symbol_table_clear(SymbolTable* symbols) {
+    // Keep the newest block for the next names
+    if (symbols->blocks) {
+        SymbolBlock* block = symbols->blocks->next;
+        while (block) {
+            SymbolBlock* next = block->next;
+            free(block);
+            block = next;
+        }
+        symbols->blocks->next = NULL;
+    }
+    symbols->block_used = 0;
+    symbols->count = 0;
+    if (symbols->slots) {
+        memset(symbols->slots, 0, symbols->slot_capacity * sizeof(uint32_t));
+    }
+}
+
+// FNV-1a
+static uint32_t hash_name(const char* name, size_t length) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Slot holding the ID of a name, or the empty slot where it would go
+static uint32_t* find_slot(const SymbolTable* symbols, const char* name, size_t length, uint32_t hash) {
+    uint32_t mask = symbols->slot_capacity - 1;
+    uint32_t slot = hash & mask;
+    for (;;) {
+        uint32_t* entry = &symbols->slots[slot];
+        if (*entry == 0) return entry;
+        uint32_t id = *entry - 1;
+        if (symbols->hashes[id] == hash && strncmp(symbols->names[id], name, length) == 0 &&
+            symbols->names[id][length] == '\0') {
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+uint32_t symbol_find(const SymbolTable* symbols, const char* name, size_t length) {
+    if (symbols->count == 0) return SYMBOL_NONE;
+    uint32_t* entry = find_slot(symbols, name, length, hash_name(name, length));
+    return *entry ? *entry - 1 : SYMBOL_NONE;
+}
+
+// Keep the index at most half full
+static int grow_slots(SymbolTable* symbols) {
+    uint32_t capacity = symbols->slot_capacity ? symbols->slot_capacity * 2 : 64;
+    uint32_t* slots = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    if (!slots) return 0;
+
+    for (uint32_t id = 0; id < symbols->count; id++) {
+        uint32_t slot = symbols->hashes[id] & (capacity - 1);
+        while (slots[slot]) slot = (slot + 1) & (capacity - 1);
+        slots[slot] = id + 1;
+    }
+    free(symbols->slots);
+    symbols->slots = slots;
+    symbols->slot_capacity = capacity;
+    return 1;
+}
+
+// Copy a name into the block storage
+static const char* store_name(SymbolTable* symbols, const char* name, size_t length) {
+    SymbolBlock* block = symbols->blocks;
+    if (!block || symbols->block_used + length + 1 > block->size) {
+        size_t size = length + 1 > SYMBOL_BLOCK_SIZE ? length + 1 : SYMBOL_BLOCK_SIZE;
+        block = (SymbolBlock*)malloc(sizeof(SymbolBlock) + size);
+        if (!block) return NULL;
+        block->next = symbols->blocks;
+        block->size = size;
+        symbols->blocks = block;
+        symbols->block_used = 0;
+    }
+
+    char* stored = block->data + symbols->block_used;
+    memcpy(stored, name, length);
+    stored[length] = '\0';
+    symbols->block_used += length + 1;
+    return stored;
+}
+
+uint32_t symbol_intern(SymbolTable* symbols, const char* name, size_t length) {
+    if ((symbols->count + 1) * 2 > symbols->slot_capacity && !grow_slots(symbols)) {
+        return SYMBOL_NONE;
+    }
+    uint32_t hash = hash_name(name, length);
+    uint32_t* entry = find_slot(symbols, name, length, hash);
+    if (*entry) return *entry - 1;
+
+    if (symbols->count == symbols->capacity) {
+        uint32_t capacity = symbols->capacity ? symbols->capacity * 2 : 32;
+        const char** names = (const char**)realloc((void*)symbols->names, capacity * sizeof(char*));
+        if (!names) return SYMBOL_NONE;
+        symbols->names = names;
+        uint32_t* hashes = (uint32_t*)realloc(symbols->hashes, capacity * sizeof(uint32_t));
+        if (!hashes) return SYMBOL_NONE;
+        symbols->hashes = hashes;
+        symbols->capacity = capacity;
+    }
+
+    const char* stored = store_name(symbols, name, length);
+    if (!stored) return SYMBOL_NONE;
+    uint32_t id = symbols->count++;
+    symbols->names[id] = stored;
+    symbols->hashes[id] = hash;
+    *entry = id + 1;
+    return id;
+}
+
+int symbol_is_name(const char* name, size_t length) {
+    if (length == 0) return 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = name[i];
+        int letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        if (!letter && !(i > 0 && c >= '0' && c <= '9')) return 0;
+    }
+    return 1;
+}
+
+void symbol_bindings_init(SymbolBindings* bindings) {
+    symbol_table_init(&bindings->names);
+    bindings->values = NULL;
+    bindings->capacity = 0;
+}
+
+void symbol_bindings_free(SymbolBindings* bindings) {
+    symbol_table_free(&bindings->names);
+    free(bindings->values);
+    symbol_bindings_init(bindings);
+}
+
+int symbol_bindings_set(SymbolBindings* bindings, const char* name, size_t length, double value) {
+    uint32_t id = symbol_intern(&bindings->names, name, length);
+    if (id == SYMBOL_NONE) return 0;
+    if (id >= bindings->capacity) {
+        uint32_t capacity = bindings->names.capacity;
+        double* values = (double*)realloc(bindings->values, capacity * sizeof(double));
+        if (!values) return 0;
+        bindings->values = values;
+        bindings->capacity = capacity;
+    }
+    bindings->values[id] = value;
+    return 1;
+}
+
+void symbol_values_init(SymbolValues* values) {
+    values->values = NULL;
+    values->count = 0;
+    values->capacity = 0;
+}
+
+void symbol_values_free(SymbolValues* values) {
+    free(values->values);
+    symbol_values_init(values);
+}
+
+int symbol_values_resolve(SymbolValues* values, const SymbolTable* symbols,
+                          const SymbolBindings* bindings) {
+    if (symbols->count > values->capacity) {
+        uint32_t capacity = symbols->capacity;
+        double* grown = (double*)realloc(values->values, capacity * sizeof(double));
+        if (!grown) return 0;
+        values->values = grown;
+        values->capacity = capacity;
+    }
+
+    for (uint32_t id = values->count; id < symbols->count; id++) {
+        const char* name = symbols->names[id];
+        uint32_t bound = bindings ? symbol_find(&bindings->names, name, strlen(name)) : SYMBOL_NONE;
+        values->values[id] = bound != SYMBOL_NONE ? bindings->values[bound] : 0.0;
+    }
+    values->count = symbols->count;
+    return 1;
+}
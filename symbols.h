@@ -0,0 +1,93 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Interned variable names
+ *
+ * Every distinct name is stored once and numbered densely from 0 in the
+ * order it is first seen. Everything after the lexer refers to variables
+ * by these IDs: AST nodes, IR operands and bytecode LOADs, and evaluators
+ * keep variable values in arrays indexed by ID. Names are NUL-terminated
+ * and never move, so their pointers stay valid until the table is freed
+ * or cleared.
+ */
+
+#define SYMBOL_NONE UINT32_MAX
+
+typedef struct SymbolBlock SymbolBlock;
+
+typedef struct {
+    const char** names;       // Name of each ID
+    uint32_t* hashes;         // Hash of each name
+    uint32_t count;
+    uint32_t capacity;
+
+    uint32_t* slots;          // Open-addressing index: ID + 1, 0 if empty
+    uint32_t slot_capacity;   // Power of two
+
+    SymbolBlock* blocks;      // Name storage, newest block first
+    size_t block_used;        // Bytes used in the newest block
+} SymbolTable;
+
+void symbol_table_init(SymbolTable* symbols);
+void symbol_table_free(SymbolTable* symbols);
+
+/* Forget every name, keeping the memory for the next ones
+ * (their IDs restart from 0)
+ */
+void symbol_table_clear(SymbolTable* symbols);
+
+/* ID of a name, adding it if it is new
+ * @param name The name; it need not be NUL-terminated
+ * @param length Bytes of the name
+ * @return The ID, or SYMBOL_NONE if out of memory
+ */
+uint32_t symbol_intern(SymbolTable* symbols, const char* name, size_t length);
+
+/* ID of a name without adding it
+ * @return The ID, or SYMBOL_NONE if the name is not in the table
+ */
+uint32_t symbol_find(const SymbolTable* symbols, const char* name, size_t length);
+
+/* Check that a string is a valid variable name: a letter or '_', then
+ * letters, digits or '_'
+ */
+int symbol_is_name(const char* name, size_t length);
+
+/* Values bound to names (--set), shared by all compilers */
+typedef struct {
+    SymbolTable names;
+    double* values;           // By ID in names
+    uint32_t capacity;
+} SymbolBindings;
+
+void symbol_bindings_init(SymbolBindings* bindings);
+void symbol_bindings_free(SymbolBindings* bindings);
+
+/* Bind a name to a value, replacing an earlier binding
+ * @return 1 on success, 0 if out of memory
+ */
+int symbol_bindings_set(SymbolBindings* bindings, const char* name, size_t length, double value);
+
+/* Variable values of one compiler's symbols, indexed by its IDs
+ * (set count to 0 to resolve again after the table was cleared)
+ */
+typedef struct {
+    double* values;
+    uint32_t count;           // Symbols resolved so far
+    uint32_t capacity;
+} SymbolValues;
+
+void symbol_values_init(SymbolValues* values);
+void symbol_values_free(SymbolValues* values);
+
+/* Look up the symbols added to a table since the last call in the
+ * bindings (0 if unbound), so values->values covers every ID in use
+ * @return 1 on success, 0 if out of memory
+ */
+int symbol_values_resolve(SymbolValues* values, const SymbolTable* symbols,
+                          const SymbolBindings* bindings);
+
+#endif // SYMBOLS_H
@@ -1,6 +1,8 @@
 #ifndef TOKENS_H
 #define TOKENS_H
 
+#include <stdint.h>
+
 typedef enum {
     TOKEN_INT,
     TOKEN_FLOAT,
@@ -12,6 +14,9 @@ typedef enum {
     TOKEN_LPAREN,
     TOKEN_RPAREN,
     TOKEN_VARIABLE,
+    TOKEN_ASSIGN,
+    TOKEN_SEMICOLON,
+    TOKEN_NEWLINE,
     TOKEN_UNKNOWN,
     TOKEN_EOF
 } TokenType;
@@ -19,11 +24,15 @@ typedef enum {
 typedef union {
     int ival;
     double fval;
-    char cval;
+    uint32_t symbol;    // Variable: ID in the compiler's symbol table
 } TokenValue;
 
-extern TokenValue yylval;
-extern int yylineno;
-extern int yycolumn;
+// A scanned token with the scanner position after it
+typedef struct {
+    TokenType type;
+    TokenValue value;
+    int line;
+    int column;
+} Token;
 
 #endif // TOKENS_H
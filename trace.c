@@ -0,0 +1,27 @@
+#include "trace.h"
+#include <stdarg.h>
+
+int trace_level = TRACE_NONE;
+static FILE* trace_sink = NULL;
+
+int trace_init(int level, FILE* sink) {
+    trace_sink = sink ? sink : stderr;
+#ifdef PARSEIQ_TRACE
+    trace_level = level;
+    return 1;
+#else
+    (void)level;
+    return level == TRACE_NONE;
+#endif
+}
+
+void trace_emit(const char* format, ...) {
+    FILE* sink = trace_sink ? trace_sink : stderr;
+    va_list args;
+    
+    fputs("TRACE: ", sink);
+    va_start(args, format);
+    vfprintf(sink, format, args);
+    va_end(args);
+    fputc('\n', sink);
+}
@@ -0,0 +1,32 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+// Trace levels, each one includes everything below it
+typedef enum {
+    TRACE_NONE = 0,
+    TRACE_TOKENS = 1,   // One event per token returned by the lexer
+    TRACE_RULES = 2,    // Parser rule entry/exit and node creation
+    TRACE_ALL = 3       // Everything, including per-character lexer events
+} TraceLevel;
+
+// Tracing is compiled in only when PARSEIQ_TRACE is defined. In the default
+// build TRACE() expands to nothing, so the lexer and parser hot paths carry
+// no trace branches at all.
+#ifdef PARSEIQ_TRACE
+extern int trace_level;
+#define TRACE(level, ...) \
+    do { if (trace_level >= (level)) trace_emit(__VA_ARGS__); } while (0)
+#else
+#define TRACE(level, ...) ((void)0)
+#endif
+
+// Select the trace level and sink (NULL means stderr)
+// @return 1 on success, 0 if tracing was not compiled in
+int trace_init(int level, FILE* sink);
+
+// Write one trace event (a newline is appended)
+void trace_emit(const char* format, ...);
+
+#endif // TRACE_H
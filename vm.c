@@ -0,0 +1,580 @@
+#include "vm.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void bytecode_init(Bytecode* bc) {
+    bc->code = NULL;
+    bc->length = 0;
+    bc->capacity = 0;
+    bc->constants = NULL;
+    bc->constant_count = 0;
+    bc->constant_capacity = 0;
+    bc->max_stack = 0;
+    bc->var_count = 0;
+    bc->local_count = 0;
+}
+
+void bytecode_free(Bytecode* bc) {
+    free(bc->code);
+    free(bc->constants);
+    bytecode_init(bc);
+}
+
+// Make room for `extra` more code bytes
+static int reserve_code(Bytecode* bc, uint32_t extra) {
+    if (bc->length + extra <= bc->capacity) return 1;
+    
+    uint32_t capacity = bc->capacity ? bc->capacity : 64;
+    while (capacity < bc->length + extra) capacity *= 2;
+    
+    uint8_t* code = (uint8_t*)realloc(bc->code, capacity);
+    if (!code) return 0;
+    bc->code = code;
+    bc->capacity = capacity;
+    return 1;
+}
+
+static int emit_op(Bytecode* bc, BytecodeOp op) {
+    if (!reserve_code(bc, 1)) return 0;
+    bc->code[bc->length++] = (uint8_t)op;
+    return 1;
+}
+
+static int emit_push(Bytecode* bc, double value) {
+    if (bc->constant_count == bc->constant_capacity) {
+        uint32_t capacity = bc->constant_capacity ? bc->constant_capacity * 2 : 16;
+        double* constants = (double*)realloc(bc->constants, capacity * sizeof(double));
+        if (!constants) return 0;
+        bc->constants = constants;
+        bc->constant_capacity = capacity;
+    }
+    
+    uint32_t index = bc->constant_count++;
+    bc->constants[index] = value;
+    
+    if (!reserve_code(bc, 1 + sizeof(uint32_t))) return 0;
+    bc->code[bc->length++] = BC_PUSH;
+    memcpy(bc->code + bc->length, &index, sizeof(uint32_t));
+    bc->length += sizeof(uint32_t);
+    return 1;
+}
+
+static int emit_load(Bytecode* bc, uint32_t symbol) {
+    if (!reserve_code(bc, 1 + sizeof(uint32_t))) return 0;
+    bc->code[bc->length++] = BC_LOAD;
+    memcpy(bc->code + bc->length, &symbol, sizeof(uint32_t));
+    bc->length += sizeof(uint32_t);
+    if (symbol >= bc->var_count) bc->var_count = symbol + 1;
+    return 1;
+}
+
+// STORE or LOCAL of the local slot of definition `def` of a variable
+static int emit_local(Bytecode* bc, BytecodeOp op, uint32_t def, uint32_t symbol) {
+    if (!reserve_code(bc, 1 + 2 * sizeof(uint32_t))) return 0;
+    bc->code[bc->length++] = (uint8_t)op;
+    memcpy(bc->code + bc->length, &def, sizeof(uint32_t));
+    memcpy(bc->code + bc->length + sizeof(uint32_t), &symbol, sizeof(uint32_t));
+    bc->length += 2 * sizeof(uint32_t);
+    if (op == BC_STORE && def >= bc->local_count) bc->local_count = def + 1;
+    return 1;
+}
+
+// Remove the PUSH just emitted, whose constant is the last in the pool, to
+// fuse it with the following POW into SQRT
+static void unpush(Bytecode* bc) {
+    bc->length -= 1 + sizeof(uint32_t);
+    bc->constant_count--;
+}
+
+// pow(x, 0.5) through sqrt, which differs from it only for -0 (sqrt keeps
+// the sign) and -inf (sqrt gives NaN)
+static inline double sqrt_pow(double x) {
+    return x == -INFINITY ? INFINITY : sqrt(x) + 0.0;
+}
+
+// Emit the instruction of one node after its operands; `depth` tracks the operand stack
+static int compile_instr(Bytecode* bc, const ASTNode* node, uint32_t* depth) {
+    switch (node->type) {
+        case NODE_NUMBER:
+            if (!emit_push(bc, node->data.value)) return 0;
+            break;
+            
+        case NODE_VARIABLE:
+            if (node->data.variable.def != AST_NO_DEF) {
+                if (!emit_local(bc, BC_LOCAL, node->data.variable.def, node->data.variable.symbol)) {
+                    return 0;
+                }
+            } else if (!emit_load(bc, node->data.variable.symbol)) {
+                return 0;
+            }
+            break;
+            
+        case NODE_BINARY_OP: {
+            BytecodeOp op = BC_ERROR;
+            switch (node->data.binary_op.operator) {
+                case OP_ADD: op = BC_ADD; break;
+                case OP_SUBTRACT: op = BC_SUB; break;
+                case OP_MULTIPLY: op = BC_MUL; break;
+                case OP_DIVIDE: op = BC_DIV; break;
+                case OP_POWER: {
+                    // The exponent, if a constant, was emitted just before
+                    const ASTNode* exponent = node->data.binary_op.right;
+                    if (exponent && exponent->type == NODE_NUMBER && exponent->data.value == 0.5) {
+                        unpush(bc);
+                        op = BC_SQRT;
+                    } else {
+                        op = BC_POW;
+                    }
+                    break;
+                }
+            }
+            if (!emit_op(bc, op)) return 0;
+            (*depth) -= 2; // Two operands popped, one result pushed below
+            break;
+        }
+            
+        case NODE_ASSIGN:
+            // The value stays on the stack as the statement's value
+            return emit_local(bc, BC_STORE, node->data.assign.def, node->data.assign.symbol);
+            
+        case NODE_SEQUENCE:
+            return 1; // POP was emitted between the statements
+            
+        case NODE_ERROR:
+            return emit_op(bc, BC_ERROR);
+    }
+    
+    (*depth)++;
+    if (*depth > bc->max_stack) bc->max_stack = *depth;
+    return 1;
+}
+
+int bytecode_compile(Bytecode* bc, const ASTNode* node) {
+    bc->length = 0;
+    bc->constant_count = 0;
+    bc->max_stack = 0;
+    bc->var_count = 0;
+    bc->local_count = 0;
+    if (!node) return emit_op(bc, BC_ERROR) && emit_op(bc, BC_HALT);
+    
+    // Postorder walk: operands first, then the operator
+    ASTWalkStack stack;
+    ast_walk_init(&stack);
+    uint32_t depth = 0;
+    int ok = ast_walk_push(&stack, node, 0) != NULL;
+    while (ok && stack.count > 0) {
+        ASTWalkFrame* frame = &stack.frames[stack.count - 1];
+        const ASTNode* current = frame->node;
+        const ASTNode* first;
+        const ASTNode* second;
+        if (frame->state < ast_children(current, &first, &second)) {
+            // Only the value of the last statement stays on the stack
+            if (frame->state == 1 && current->type == NODE_SEQUENCE) {
+                ok = emit_op(bc, BC_POP);
+                if (depth > 0) depth--;
+            }
+            const ASTNode* child = frame->state++ == 0 ? first : second;
+            if (ok) ok = child ? ast_walk_push(&stack, child, 0) != NULL : emit_op(bc, BC_ERROR);
+            continue;
+        }
+        stack.count--;
+        ok = compile_instr(bc, current, &depth);
+    }
+    ast_walk_free(&stack);
+    
+    return ok && emit_op(bc, BC_HALT);
+}
+
+int bytecode_assemble(Bytecode* bc, const IRProgram* ir) {
+    bc->length = 0;
+    bc->constant_count = 0;
+    bc->max_stack = 0;
+    bc->var_count = 0;
+    bc->local_count = 0;
+    if (ir->form != IR_FORM_STACK) return 0;
+    
+    uint32_t depth = 0;
+    for (uint32_t i = 0; i < ir->count; i++) {
+        const IRInstr* instr = &ir->code[i];
+        int ok = 1;
+        switch ((IROpcode)instr->opcode) {
+            case IR_PUSH:
+                ok = emit_push(bc, ir->constants[instr->left.index]);
+                depth++;
+                break;
+            case IR_LOAD:
+                ok = instr->right.kind == IR_DEF
+                   ? emit_local(bc, BC_LOCAL, instr->right.index, instr->left.index)
+                   : emit_load(bc, instr->left.index);
+                depth++;
+                break;
+            case IR_STORE:
+                ok = emit_local(bc, BC_STORE, instr->right.index, instr->left.index);
+                break;
+            case IR_POP:
+                ok = emit_op(bc, BC_POP);
+                if (depth > 0) depth--;
+                break;
+            case IR_ADD: ok = emit_op(bc, BC_ADD); break;
+            case IR_SUB: ok = emit_op(bc, BC_SUB); break;
+            case IR_MUL: ok = emit_op(bc, BC_MUL); break;
+            case IR_DIV: ok = emit_op(bc, BC_DIV); break;
+            case IR_POW:
+                if (i > 0 && ir->code[i - 1].opcode == IR_PUSH &&
+                    ir->constants[ir->code[i - 1].left.index] == 0.5) {
+                    unpush(bc);
+                    ok = emit_op(bc, BC_SQRT);
+                } else {
+                    ok = emit_op(bc, BC_POW);
+                }
+                break;
+            case IR_COPY:
+            case IR_ERROR:
+                ok = emit_op(bc, BC_ERROR);
+                depth++;
+                break;
+        }
+        if (!ok) return 0;
+        
+        // Operators pop two operands and push one result (operands missing
+        // from an invalid expression make the program fail at run time)
+        if (instr->opcode >= IR_ADD && instr->opcode <= IR_POW && depth > 0) depth--;
+        if (depth > bc->max_stack) bc->max_stack = depth;
+    }
+    return emit_op(bc, BC_HALT);
+}
+
+int bytecode_valid(const Bytecode* bc) {
+    // Every push and every STORE takes a byte of code: larger sizes would
+    // only make the VM allocate for nothing
+    if (bc->max_stack > bc->length || bc->local_count > bc->length) return 0;
+
+    uint32_t pc = 0;
+    uint32_t depth = 0;
+    int reachable = 1;      // No ERROR so far: the stack is really used
+    while (pc < bc->length) {
+        BytecodeOp op = (BytecodeOp)bc->code[pc++];
+        uint32_t pops = 0;
+        uint32_t pushes = 0;
+        uint32_t operands[2];
+        uint32_t operand_count = 0;
+        switch (op) {
+            case BC_HALT:
+                return pc == bc->length;
+            case BC_PUSH:
+            case BC_LOAD: operand_count = 1; pushes = 1; break;
+            case BC_LOCAL: operand_count = 2; pushes = 1; break;
+            case BC_STORE: operand_count = 2; pops = 1; pushes = 1; break;
+            case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_POW:
+                pops = 2; pushes = 1; break;
+            case BC_SQRT: pops = 1; pushes = 1; break;
+            case BC_POP: pops = 1; break;
+            case BC_ERROR: reachable = 0; break;
+            default: return 0;
+        }
+
+        if (bc->length - pc < operand_count * sizeof(uint32_t)) return 0;
+        memcpy(operands, bc->code + pc, operand_count * sizeof(uint32_t));
+        pc += operand_count * sizeof(uint32_t);
+        if ((op == BC_PUSH && operands[0] >= bc->constant_count) ||
+            (op == BC_LOAD && operands[0] >= bc->var_count) ||
+            ((op == BC_LOCAL || op == BC_STORE) &&
+             (operands[0] >= bc->local_count || operands[1] >= bc->var_count))) {
+            return 0;
+        }
+
+        if (reachable) {
+            if (depth < pops) return 0;
+            depth += pushes - pops;
+            if (depth > bc->max_stack) return 0;
+        }
+    }
+    return 0; // No HALT
+}
+
+void bytecode_disassemble(const Bytecode* bc, const SymbolTable* symbols, FILE* output) {
+    uint32_t pc = 0;
+    while (pc < bc->length) {
+        switch ((BytecodeOp)bc->code[pc++]) {
+            case BC_HALT:
+                return;
+            case BC_PUSH: {
+                uint32_t index;
+                memcpy(&index, bc->code + pc, sizeof(uint32_t));
+                pc += sizeof(uint32_t);
+                fprintf(output, "PUSH %.2f\n", bc->constants[index]);
+                break;
+            }
+            case BC_LOAD: {
+                uint32_t symbol;
+                memcpy(&symbol, bc->code + pc, sizeof(uint32_t));
+                pc += sizeof(uint32_t);
+                fprintf(output, "LOAD %s\n", symbols->names[symbol]);
+                break;
+            }
+            case BC_STORE:
+            case BC_LOCAL: {
+                // The text names the variable, not the slot
+                const char* op = bc->code[pc - 1] == BC_STORE ? "STORE" : "LOAD";
+                uint32_t symbol;
+                memcpy(&symbol, bc->code + pc + sizeof(uint32_t), sizeof(uint32_t));
+                pc += 2 * sizeof(uint32_t);
+                fprintf(output, "%s %s\n", op, symbols->names[symbol]);
+                break;
+            }
+            case BC_POP: fprintf(output, "POP\n"); break;
+            case BC_ADD: fprintf(output, "ADD\n"); break;
+            case BC_SUB: fprintf(output, "SUB\n"); break;
+            case BC_MUL: fprintf(output, "MUL\n"); break;
+            case BC_DIV: fprintf(output, "DIV\n"); break;
+            case BC_POW: fprintf(output, "POW\n"); break;
+            case BC_ERROR: fprintf(output, "ERROR\n"); break;
+            case BC_SQRT: fprintf(output, "PUSH %.2f\nPOW\n", 0.5); break;
+        }
+    }
+}
+
+int vm_init(VM* vm, uint32_t stack_capacity) {
+    vm->locals = NULL;
+    vm->local_capacity = 0;
+    vm->block_stack = NULL;
+    vm->block_stack_capacity = 0;
+    vm->block_locals = NULL;
+    vm->block_local_capacity = 0;
+    vm->stack = (double*)malloc((stack_capacity ? stack_capacity : 1) * sizeof(double));
+    vm->stack_capacity = vm->stack ? stack_capacity : 0;
+    return vm->stack != NULL;
+}
+
+void vm_free(VM* vm) {
+    free(vm->locals);
+    vm->locals = NULL;
+    vm->local_capacity = 0;
+    free(vm->block_locals);
+    vm->block_locals = NULL;
+    vm->block_local_capacity = 0;
+    free(vm->block_stack);
+    vm->block_stack = NULL;
+    vm->block_stack_capacity = 0;
+    free(vm->stack);
+    vm->stack = NULL;
+    vm->stack_capacity = 0;
+}
+
+int vm_execute(VM* vm, const Bytecode* bc, const double* vars, double* result) {
+    // The compiler knows the maximum depth, so the loop needs no bounds checks
+    if (bc->max_stack > vm->stack_capacity) {
+        double* stack = (double*)realloc(vm->stack, bc->max_stack * sizeof(double));
+        if (!stack) return 0;
+        vm->stack = stack;
+        vm->stack_capacity = bc->max_stack;
+    }
+    if (bc->local_count > vm->local_capacity) {
+        double* locals = (double*)realloc(vm->locals, bc->local_count * sizeof(double));
+        if (!locals) return 0;
+        vm->locals = locals;
+        vm->local_capacity = bc->local_count;
+    }
+    if (!bc->code) return 0;
+    
+    const uint8_t* pc = bc->code;
+    const double* constants = bc->constants;
+    double* locals = vm->locals;
+    double* sp = vm->stack; // Points one past the top of the stack
+    
+#if defined(__GNUC__) && !defined(PARSEIQ_SWITCH_DISPATCH)
+    // Threaded dispatch: every handler jumps straight to the next one
+    static const void* dispatch[] = {
+        &&op_halt, &&op_push, &&op_load, &&op_add, &&op_sub,
+        &&op_mul, &&op_div, &&op_pow, &&op_error, &&op_sqrt,
+        &&op_store, &&op_local, &&op_pop
+    };
+#define DISPATCH() goto *dispatch[*pc++]
+#define CASE(label, op) label:
+    DISPATCH();
+#else
+    // Portable switch dispatch
+#define DISPATCH() continue
+#define CASE(label, op) case op:
+    for (;;) switch (*pc++) {
+#endif
+    
+    CASE(op_push, BC_PUSH) {
+        uint32_t index;
+        memcpy(&index, pc, sizeof(uint32_t));
+        pc += sizeof(uint32_t);
+        *sp++ = constants[index];
+        DISPATCH();
+    }
+    CASE(op_load, BC_LOAD) {
+        uint32_t symbol;
+        memcpy(&symbol, pc, sizeof(uint32_t));
+        pc += sizeof(uint32_t);
+        *sp++ = vars[symbol];
+        DISPATCH();
+    }
+    CASE(op_store, BC_STORE) {
+        uint32_t slot;
+        memcpy(&slot, pc, sizeof(uint32_t));
+        pc += 2 * sizeof(uint32_t);
+        locals[slot] = sp[-1];
+        DISPATCH();
+    }
+    CASE(op_local, BC_LOCAL) {
+        uint32_t slot;
+        memcpy(&slot, pc, sizeof(uint32_t));
+        pc += 2 * sizeof(uint32_t);
+        *sp++ = locals[slot];
+        DISPATCH();
+    }
+    CASE(op_pop, BC_POP) {
+        sp--;
+        DISPATCH();
+    }
+    CASE(op_add, BC_ADD) {
+        sp--;
+        sp[-1] += sp[0];
+        DISPATCH();
+    }
+    CASE(op_sub, BC_SUB) {
+        sp--;
+        sp[-1] -= sp[0];
+        DISPATCH();
+    }
+    CASE(op_mul, BC_MUL) {
+        sp--;
+        sp[-1] *= sp[0];
+        DISPATCH();
+    }
+    CASE(op_div, BC_DIV) {
+        sp--;
+        sp[-1] /= sp[0];
+        DISPATCH();
+    }
+    CASE(op_pow, BC_POW) {
+        sp--;
+        sp[-1] = pow(sp[-1], sp[0]);
+        DISPATCH();
+    }
+    CASE(op_sqrt, BC_SQRT) {
+        sp[-1] = sqrt_pow(sp[-1]);
+        DISPATCH();
+    }
+    CASE(op_error, BC_ERROR) {
+        return 0;
+    }
+    CASE(op_halt, BC_HALT) {
+        if (sp == vm->stack) return 0;
+        *result = sp[-1];
+        return 1;
+    }
+    
+#if !defined(__GNUC__) || defined(PARSEIQ_SWITCH_DISPATCH)
+    default:
+        return 0;
+    }
+#endif
+#undef DISPATCH
+#undef CASE
+}
+
+int vm_execute_columns(VM* vm, const Bytecode* bc, const double* const* columns,
+                       double* output, size_t rows) {
+    if (!bc->code) return 0;
+    if (bc->max_stack > vm->block_stack_capacity) {
+        double* stack = (double*)realloc(vm->block_stack,
+                                         (size_t)bc->max_stack * VM_BLOCK_SIZE * sizeof(double));
+        if (!stack) return 0;
+        vm->block_stack = stack;
+        vm->block_stack_capacity = bc->max_stack;
+    }
+    if (bc->local_count > vm->block_local_capacity) {
+        double* locals = (double*)realloc(vm->block_locals,
+                                          (size_t)bc->local_count * VM_BLOCK_SIZE * sizeof(double));
+        if (!locals) return 0;
+        vm->block_locals = locals;
+        vm->block_local_capacity = bc->local_count;
+    }
+    
+    for (size_t start = 0; start < rows; start += VM_BLOCK_SIZE) {
+        size_t n = rows - start < VM_BLOCK_SIZE ? rows - start : VM_BLOCK_SIZE;
+        const uint8_t* pc = bc->code;
+        double* next = vm->block_stack; // Vector the next push fills
+        
+        for (;;) {
+            BytecodeOp op = (BytecodeOp)*pc++;
+            if (op == BC_HALT) break;
+            
+            switch (op) {
+                case BC_PUSH: {
+                    uint32_t index;
+                    memcpy(&index, pc, sizeof(uint32_t));
+                    pc += sizeof(uint32_t);
+                    double value = bc->constants[index];
+                    for (size_t i = 0; i < VM_BLOCK_SIZE; i++) next[i] = value;
+                    next += VM_BLOCK_SIZE;
+                    break;
+                }
+                case BC_LOAD: {
+                    uint32_t symbol;
+                    memcpy(&symbol, pc, sizeof(uint32_t));
+                    pc += sizeof(uint32_t);
+                    const double* column = columns[symbol];
+                    if (!column) return 0;
+                    memcpy(next, column + start, n * sizeof(double));
+                    if (n < VM_BLOCK_SIZE) {
+                        // Pad the last partial block so every vector is full width
+                        memset(next + n, 0, (VM_BLOCK_SIZE - n) * sizeof(double));
+                    }
+                    next += VM_BLOCK_SIZE;
+                    break;
+                }
+                case BC_STORE:
+                case BC_LOCAL: {
+                    uint32_t slot;
+                    memcpy(&slot, pc, sizeof(uint32_t));
+                    pc += 2 * sizeof(uint32_t);
+                    double* local = vm->block_locals + (size_t)slot * VM_BLOCK_SIZE;
+                    if (op == BC_STORE) {
+                        memcpy(local, next - VM_BLOCK_SIZE, VM_BLOCK_SIZE * sizeof(double));
+                    } else {
+                        memcpy(next, local, VM_BLOCK_SIZE * sizeof(double));
+                        next += VM_BLOCK_SIZE;
+                    }
+                    break;
+                }
+                case BC_POP:
+                    next -= VM_BLOCK_SIZE;
+                    break;
+                case BC_ADD: case BC_SUB: case BC_MUL: case BC_DIV: case BC_POW: {
+                    next -= VM_BLOCK_SIZE;
+                    double* restrict a = next - VM_BLOCK_SIZE;
+                    const double* restrict b = next;
+                    
+                    // Fixed-width loops over disjoint vectors, which the
+                    // compiler turns into packed SIMD arithmetic
+                    switch (op) {
+                        case BC_ADD: for (size_t i = 0; i < VM_BLOCK_SIZE; i++) a[i] += b[i]; break;
+                        case BC_SUB: for (size_t i = 0; i < VM_BLOCK_SIZE; i++) a[i] -= b[i]; break;
+                        case BC_MUL: for (size_t i = 0; i < VM_BLOCK_SIZE; i++) a[i] *= b[i]; break;
+                        case BC_DIV: for (size_t i = 0; i < VM_BLOCK_SIZE; i++) a[i] /= b[i]; break;
+                        default: for (size_t i = 0; i < n; i++) a[i] = pow(a[i], b[i]); break;
+                    }
+                    break;
+                }
+                case BC_SQRT: {
+                    double* a = next - VM_BLOCK_SIZE;
+                    for (size_t i = 0; i < n; i++) a[i] = sqrt_pow(a[i]);
+                    break;
+                }
+                default:
+                    return 0;
+            }
+        }
+        
+        if (next == vm->block_stack) return 0;
+        memcpy(output + start, next - VM_BLOCK_SIZE, n * sizeof(double));
+    }
+    return 1;
+}
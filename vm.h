@@ -0,0 +1,126 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ast.h"
+#include "ir.h"
+#include "symbols.h"
+
+/* Binary encoding of the stack machine instruction set written by
+ * generate_stack_code. Every instruction is a one-byte opcode; PUSH is
+ * followed by a 4-byte constant pool index and LOAD by a 4-byte variable
+ * symbol ID. Programs always end with BC_HALT.
+ * SQRT is "PUSH 0.5; POW" fused by the compilers: it runs as a square
+ * root (same result as pow) and disassembles to those two instructions.
+ * Programs of several statements keep the value of every assignment in a
+ * local slot numbered by its definition: STORE copies the top of the
+ * stack into one and LOCAL pushes one, both followed by a 4-byte slot
+ * number and the 4-byte symbol ID of the variable (for disassembly).
+ * POP drops the value of a statement that is not the last.
+ */
+typedef enum {
+    BC_HALT,
+    BC_PUSH,
+    BC_LOAD,
+    BC_ADD,
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,
+    BC_POW,
+    BC_ERROR,
+    BC_SQRT,
+    BC_STORE,
+    BC_LOCAL,
+    BC_POP
+} BytecodeOp;
+
+typedef struct {
+    uint8_t* code;
+    uint32_t length;
+    uint32_t capacity;
+    double* constants;           // Constant pool referenced by BC_PUSH
+    uint32_t constant_count;
+    uint32_t constant_capacity;
+    uint32_t max_stack;          // Deepest operand stack the program needs
+    uint32_t var_count;          // Highest symbol ID loaded + 1 (0 if none)
+    uint32_t local_count;        // Highest local slot stored + 1 (0 if none)
+} Bytecode;
+
+/* Rows evaluated together by vm_execute_columns */
+#define VM_BLOCK_SIZE 256
+
+/* Interpreter state: operand stacks and local slots, allocated up front
+ * and reused */
+typedef struct {
+    double* stack;
+    uint32_t stack_capacity;
+    double* locals;
+    uint32_t local_capacity;
+    double* block_stack;            // Stack of VM_BLOCK_SIZE-wide vectors
+    uint32_t block_stack_capacity;  // In vectors
+    double* block_locals;           // Local slots of VM_BLOCK_SIZE-wide vectors
+    uint32_t block_local_capacity;  // In vectors
+} VM;
+
+void bytecode_init(Bytecode* bc);
+void bytecode_free(Bytecode* bc);
+
+/* Compile an AST to bytecode (replacing previous contents)
+ * @param bc The bytecode buffer to fill
+ * @param node The root node of the AST
+ * @return 1 on success, 0 on failure (out of memory)
+ */
+int bytecode_compile(Bytecode* bc, const ASTNode* node);
+
+/* Encode stack-form IR (generate_stack_ir) as bytecode, replacing previous contents
+ * @param bc The bytecode buffer to fill
+ * @param ir A program in IR_FORM_STACK
+ * @return 1 on success, 0 on failure (out of memory or not stack IR)
+ */
+int bytecode_assemble(Bytecode* bc, const IRProgram* ir);
+
+/* Check bytecode read from a file before it is used: every opcode is
+ * known, operands lie inside the code and their indices below
+ * constant_count, var_count and local_count, the program ends with its
+ * first HALT, and the operand stack stays within max_stack without
+ * underflowing up to the first ERROR (which stops execution); max_stack
+ * and local_count may not exceed the code length.
+ * Linear and allocation-free.
+ * @return 1 if the program can be run, JIT-compiled and disassembled safely
+ */
+int bytecode_valid(const Bytecode* bc);
+
+/* Write the bytecode as stack machine text (same format as generate_stack_code)
+ * @param symbols The symbol table the LOAD IDs refer to
+ */
+void bytecode_disassemble(const Bytecode* bc, const SymbolTable* symbols, FILE* output);
+
+/* Create a VM whose operand stack holds stack_capacity values */
+int vm_init(VM* vm, uint32_t stack_capacity);
+void vm_free(VM* vm);
+
+/* Run a compiled program
+ * @param vm The VM (its stack and locals are grown once if the program needs more room)
+ * @param bc The program
+ * @param vars Values of the variables indexed by symbol ID (at least bc->var_count)
+ * @param result Receives the value left on the stack
+ * @return 1 on success, 0 if the program hit an ERROR instruction
+ */
+int vm_execute(VM* vm, const Bytecode* bc, const double* vars, double* result);
+
+/* Evaluate one program over many rows of variable values
+ * Rows are processed VM_BLOCK_SIZE at a time: each instruction is
+ * dispatched once per block and runs a tight loop over the block.
+ * @param vm The VM
+ * @param bc The program
+ * @param columns Input column of each variable indexed by symbol ID (at
+ *                least bc->var_count; NULL if unused)
+ * @param output Receives one result per row
+ * @param rows Number of rows
+ * @return 1 on success, 0 on an ERROR instruction or a missing column
+ */
+int vm_execute_columns(VM* vm, const Bytecode* bc, const double* const* columns,
+                       double* output, size_t rows);
+
+#endif // VM_H